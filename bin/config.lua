@@ -24,7 +24,20 @@ Renderer = "DirectX" --valid options are "DirectX", "OpenGL", or "Software"
 ScreenWidth = 800
 ScreenHeight = 600
 Vsync = true
+TargetFPS = 60 --frames drawn per second at most, 0 for no limit; movement is simulated at 60 steps a second either way
 Fullscreen = false
+Use32BitIndices = true --draw large zone materials in one call each, if the video card supports it
+PrefetchBudget = 256 --megabytes of neighbouring zones to load ahead of time, 0 to disable
+FileCacheBudget = 256 --megabytes of archives kept in memory after use, so that shared ones aren't read again
+AnimationThreads = -1 --worker threads that help the main thread skin nearby mobs each frame, -1 for all of them
+AnimationFullRateDistance = 150 --mobs closer than this are animated every frame
+AnimationHalfRateDistance = 400 --every 2nd frame up to here, every 4th frame beyond it
+AnimationRange = 1000 --mobs further away than this, or out of view, are not animated at all
+MergeZoneObjects = true --bake static trees, rocks and props into a few big buffers per area of the zone
+DrawDistance = 0 --nothing further away than this is drawn, and the zone fades into fog before it; 0 for no limit
+UseRegionVisibility = true --in older zones, skip drawing the parts that the zone says can't be seen from where the camera is
 
 --[[ Debug / GM ]]--
 ShowZoneWalls = false
+Headless = false --no window or drawing, for running many clients on one machine; also -h on the command line
+Profiler = false --time parts of every frame from startup; F11 shows the last frame's times either way, F12 saves a chrome://tracing file
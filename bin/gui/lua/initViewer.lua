@@ -6,4 +6,7 @@ doc:Show()
 doc.id = "viewer"
 
 r.document = doc
+
+require "load_progress"
+
 return doc
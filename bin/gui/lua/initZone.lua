@@ -8,5 +8,6 @@ doc.id = "zone"
 r.document = doc
 
 require "chat_window"
+require "load_progress"
 
 return doc
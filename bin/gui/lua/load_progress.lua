@@ -0,0 +1,15 @@
+
+local r = r
+
+local progress = r.document:GetElementById("loadprogress")
+
+--called by the client while a zone loads in the background
+function onLoadProgress(fraction, stage)
+	if fraction >= 1 then
+		progress.style.display = "none"
+		return
+	end
+
+	progress.style.display = "block"
+	progress.inner_rml = stage .. "... " .. math.floor(fraction * 100) .. "%"
+end
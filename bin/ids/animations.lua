@@ -0,0 +1,89 @@
+------------------------------------------------------
+-- 3 letter animation identifiers to animation ids
+-- 0 is reserved for "no animation"
+------------------------------------------------------
+
+--combat
+C01 = 1 --kick
+C02 = 2 --piercing
+C03 = 3 --2h slashing
+C04 = 4 --2h blunt
+C05 = 5 --throwing
+C06 = 6 --offhand
+C07 = 7 --bash
+C08 = 8 --main hand
+C09 = 9 --archery
+C10 = 10 --swimming attack
+C11 = 11 --round kick
+
+--damage
+D01 = 12 --minor damage
+D02 = 13 --heavy damage
+D03 = 14 --trap damage
+D04 = 15 --drowning
+D05 = 16 --dying
+
+--locomotion
+L01 = 17 --walk
+L02 = 18 --run
+L03 = 19 --jump (running)
+L04 = 20 --jump (standing)
+L05 = 21 --falling
+L06 = 22 --crouch walk
+L07 = 23 --climbing
+L08 = 24 --crouching
+L09 = 25 --swimming (treading water)
+
+--other
+O01 = 26 --idle (alternate)
+
+--passive
+P01 = 27 --stand
+P02 = 28 --sit up / stand up
+P03 = 29 --shuffle feet (rotating)
+P04 = 30 --float
+P05 = 31 --kneel
+P06 = 32 --swim
+P07 = 33 --sitting
+P08 = 34 --stand (arms at sides)
+
+--social
+S01 = 35 --cheer
+S02 = 36 --mourn
+S03 = 37 --wave
+S04 = 38 --rude
+S05 = 39 --yawn
+S06 = 40 --nod
+S07 = 41 --amazed
+S08 = 42 --plead
+S09 = 43 --clap
+S10 = 44 --distress
+S11 = 45 --blush
+S12 = 46 --chuckle
+S13 = 47 --burp
+S14 = 48 --duck
+S15 = 49 --look around
+S16 = 50 --dance
+S17 = 51 --blink
+S18 = 52 --glare
+S19 = 53 --drool
+S20 = 54 --kneel
+S21 = 55 --laugh
+S22 = 56 --point
+S23 = 57 --shrug
+S24 = 58 --raise hand
+S25 = 59 --salute
+S26 = 60 --shiver
+S27 = 61 --tap foot
+S28 = 62 --bow
+
+--casting
+T01 = 63 --unused
+T02 = 64 --stringed instrument
+T03 = 65 --wind instrument
+T04 = 66 --cast 1
+T05 = 67 --cast 2
+T06 = 68 --cast 3
+T07 = 69 --flying kick
+T08 = 70 --rapid punches
+T09 = 71 --large punch
@@ -0,0 +1,191 @@
+------------------------------------------------
+-- zone shortnames to zone id numbers
+------------------------------------------------
+
+qeynos = 1
+qeynos2 = 2
+qrg = 3
+qeytoqrg = 4
+highpass = 5
+highkeep = 6
+freportn = 8
+freportw = 9
+freporte = 10
+runnyeye = 11
+qey2hh1 = 12
+northkarana = 13
+southkarana = 14
+eastkarana = 15
+beholder = 16
+blackburrow = 17
+paw = 18
+rivervale = 19
+kithicor = 20
+commons = 21
+ecommons = 22
+erudnint = 23
+erudnext = 24
+nektulos = 25
+cshome = 26
+lavastorm = 27
+nektropos = 28
+halas = 29
+everfrost = 30
+soldunga = 31
+soldungb = 32
+misty = 33
+nro = 34
+sro = 35
+befallen = 36
+oasis = 37
+tox = 38
+hole = 39
+neriaka = 40
+neriakb = 41
+neriakc = 42
+neriakd = 43
+najena = 44
+qcat = 45
+innothule = 46
+feerrott = 47
+cazicthule = 48
+oggok = 49
+rathemtn = 50
+lakerathe = 51
+grobb = 52
+aviak = 53
+gfaydark = 54
+akanon = 55
+steamfont = 56
+lfaydark = 57
+crushbone = 58
+mistmoore = 59
+kaladima = 60
+felwithea = 61
+felwitheb = 62
+unrest = 63
+kedge = 64
+guktop = 65
+gukbottom = 66
+kaladimb = 67
+butcher = 68
+oot = 69
+cauldron = 70
+airplane = 71
+fearplane = 72
+permafrost = 73
+kerraridge = 74
+paineel = 75
+hateplane = 76
+arena = 77
+fieldofbone = 78
+warslikswood = 79
+soltemple = 80
+droga = 81
+cabwest = 82
+swampofnohope = 83
+firiona = 84
+lakeofillomen = 85
+dreadlands = 86
+burningwood = 87
+kaesora = 88
+sebilis = 89
+citymist = 90
+skyfire = 91
+frontiermtns = 92
+overthere = 93
+emeraldjungle = 94
+trakanon = 95
+timorous = 96
+kurn = 97
+erudsxing = 98
+
+stonebrunt = 100
+warrens = 101
+karnor = 102
+chardok = 103
+dalnir = 104
+charasis = 105
+cabeast = 106
+nurga = 107
+veeshan = 108
+veksar = 109
+iceclad = 110
+frozenshadow = 111
+velketor = 112
+kael = 113
+skyshrine = 114
+thurgadina = 115
+eastwastes = 116
+cobaltscar = 117
+greatdivide = 118
+wakening = 119
+westwastes = 120
+crystal = 121
+necropolis = 123
+templeveeshan = 124
+sirens = 125
+mischiefplane = 126
+growthplane = 127
+sleeper = 128
+thurgadinb = 129
+
+shadowhaven = 150
+bazaar = 151
+nexus = 152
+echo = 153
+acrylia = 154
+sharvahl = 155
+paludal = 156
+fungusgrove = 157
+vexthal = 158
+sseru = 159
+katta = 160
+netherbian = 161
+ssratemple = 162
+griegsend = 163
+thedeep = 164
+shadeweaver = 165
+hollowshade = 166
+grimling = 167
+mseru = 168
+letalis = 169
+twilight = 170
+thegrey = 171
+tenebrous = 172
+maiden = 173
+dawnshroud = 174
+scarlet = 175
+umbral = 176
+akheva = 179
+
+jaggedpine = 181
+nedaria = 182
+tutorial = 183
+load = 184
+load2 = 185
+clz = 186
+codecay = 187
+pojustice = 188
+poknowledge = 189
+potranquility = 190
+ponightmare = 191
+podisease = 192
+poinnovation = 193
+potorment = 194
+povalor = 195
+bothunder = 196
+postorms = 197
+hohonora = 198
+solrotower = 199
+powar = 200
+potactics = 201
+poair = 202
+powater = 203
+pofire = 204
+poeartha = 205
+potimea = 206
+hohonorb = 207
+nightmareb = 208
+poearthb = 209
+potimeb = 210
@@ -25,7 +25,7 @@ void AnimatedTexture::advanceFrame()
 	if (++cur_frame == num_frames)
 		cur_frame = 0;
 	video::ITexture* texture = texture_array[cur_frame];
-	scene::IMeshSceneNode* node = (scene::IMeshSceneNode*)mesh;
+	scene::ISceneNode* node = (scene::ISceneNode*)mesh;
 	for (uint32 i = 0; i < num_material_indices; ++i)
 		node->getMaterial(material_index_array[i]).setTexture(0, texture);
 }
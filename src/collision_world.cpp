@@ -0,0 +1,811 @@
+
+#include "collision_world.h"
+#include "zone_model.h"
+#include "micro_timer.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float EPSILON = 1e-6f;
+
+const float CollisionWorld::SKIN_WIDTH = 0.05f;
+
+static float surfaceArea(const core::aabbox3df& box)
+{
+	core::vector3df e = box.getExtent();
+	return 2.0f * (e.X * e.Y + e.Y * e.Z + e.Z * e.X);
+}
+
+void CollisionWorld::clear()
+{
+	mNodes.clear();
+	mTriangles.clear();
+}
+
+void CollisionWorld::build(ZoneModel* zoneModel)
+{
+	clear();
+
+	MicroTimer timer;
+	std::vector<core::vector3df> verts; //3 per triangle, world space
+
+	core::matrix4 zone;
+	zone.setTranslation(core::vector3df(zoneModel->getX(), zoneModel->getY(), zoneModel->getZ()));
+
+	if (zoneModel->getMesh())
+		addMesh(zoneModel->getMesh()->getMesh(0), zone, verts);
+
+	//placed objects are children of the zone node, transformed the way irrlicht would: translate, rotate, scale
+	for (const ObjectPlacement& obj : zoneModel->getObjectPlacements())
+	{
+		if (!obj.collidable)
+			continue;
+
+		core::matrix4 local;
+		local.setRotationDegrees(core::vector3df(obj.rotX, obj.rotY, obj.rotZ));
+		local.setTranslation(core::vector3df(obj.x, obj.y, obj.z));
+		if (obj.scaleX != 1.0f || obj.scaleY != 1.0f || obj.scaleZ != 1.0f)
+		{
+			core::matrix4 scale;
+			scale.setScale(core::vector3df(obj.scaleX, obj.scaleY, obj.scaleZ));
+			local *= scale;
+		}
+
+		addMesh(obj.mesh->getMesh(0), zone * local, verts);
+	}
+
+	buildTree(verts);
+
+	printf("collision world: %u triangles, %u nodes, %.2f MB, built in %.1f ms\n", getTriangleCount(), getNodeCount(),
+		(double)getMemoryUsage() / (1024.0 * 1024.0), (double)timer.getElapsed() / 1000.0);
+}
+
+void CollisionWorld::addMesh(scene::IMesh* mesh, const core::matrix4& transform, std::vector<core::vector3df>& verts)
+{
+	for (uint32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+	{
+		scene::IMeshBuffer* buf = mesh->getMeshBuffer(i);
+		const uint32 count = buf->getIndexCount() - buf->getIndexCount() % 3;
+		const bool large = buf->getIndexType() == video::EIT_32BIT;
+		const uint16* indices16 = buf->getIndices();
+		const uint32* indices32 = (const uint32*)buf->getIndices();
+
+		for (uint32 j = 0; j < count; j += 3)
+		{
+			core::vector3df v[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32 index = large ? indices32[j + k] : indices16[j + k];
+				v[k] = buf->getPosition(index);
+				transform.transformVect(v[k]);
+			}
+
+			//slivers can't be hit and only make the tree worse
+			if ((v[1] - v[0]).crossProduct(v[2] - v[0]).getLengthSQ() <= EPSILON * EPSILON)
+				continue;
+
+			verts.push_back(v[0]);
+			verts.push_back(v[1]);
+			verts.push_back(v[2]);
+		}
+	}
+}
+
+void CollisionWorld::buildTree(std::vector<core::vector3df>& verts)
+{
+	const uint32 n = verts.size() / 3;
+	if (n == 0)
+		return;
+
+	std::vector<core::aabbox3df> boxes(n);
+	std::vector<core::vector3df> centers(n);
+	std::vector<uint32> order(n);
+	for (uint32 i = 0; i < n; ++i)
+	{
+		boxes[i].reset(verts[i * 3]);
+		boxes[i].addInternalPoint(verts[i * 3 + 1]);
+		boxes[i].addInternalPoint(verts[i * 3 + 2]);
+		centers[i] = boxes[i].getCenter();
+		order[i] = i;
+	}
+
+	struct Task
+	{
+		uint32 node;
+		uint32 depth;
+	};
+
+	struct Bin
+	{
+		core::aabbox3df box;
+		uint32 count;
+	};
+
+	mNodes.reserve(n * 2);
+	Node root;
+	root.first = 0;
+	root.count = n;
+	mNodes.push_back(root);
+
+	std::vector<Task> work;
+	Task rootTask = { 0, 1 };
+	work.push_back(rootTask);
+
+	while (!work.empty())
+	{
+		Task task = work.back();
+		work.pop_back();
+
+		const uint32 begin = mNodes[task.node].first;
+		const uint32 count = mNodes[task.node].count;
+		const uint32 end = begin + count;
+
+		core::aabbox3df box(boxes[order[begin]]);
+		core::aabbox3df centerBox(centers[order[begin]]);
+		for (uint32 i = begin + 1; i < end; ++i)
+		{
+			box.addInternalBox(boxes[order[i]]);
+			centerBox.addInternalPoint(centers[order[i]]);
+		}
+
+		Node& node = mNodes[task.node];
+		node.min[0] = box.MinEdge.X; node.min[1] = box.MinEdge.Y; node.min[2] = box.MinEdge.Z;
+		node.max[0] = box.MaxEdge.X; node.max[1] = box.MaxEdge.Y; node.max[2] = box.MaxEdge.Z;
+
+		if (count <= MAX_LEAF_TRIANGLES || task.depth >= MAX_DEPTH - 1)
+			continue;
+
+		//binned SAH: try a plane between each pair of bins on every axis, keep the cheapest
+		const uint32 lastBin = SAH_BINS - 1;
+		float bestCost = (float)count * surfaceArea(box); //as a leaf
+		int bestAxis = -1;
+		uint32 bestSplit = 0;
+		float cmin[3] = { centerBox.MinEdge.X, centerBox.MinEdge.Y, centerBox.MinEdge.Z };
+		float cmax[3] = { centerBox.MaxEdge.X, centerBox.MaxEdge.Y, centerBox.MaxEdge.Z };
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float extent = cmax[axis] - cmin[axis];
+			if (extent <= EPSILON)
+				continue;
+
+			Bin bins[SAH_BINS];
+			for (uint32 b = 0; b < SAH_BINS; ++b)
+				bins[b].count = 0;
+
+			float scale = (float)SAH_BINS / extent;
+			for (uint32 i = begin; i < end; ++i)
+			{
+				const core::vector3df& c = centers[order[i]];
+				float v = (axis == 0) ? c.X : (axis == 1) ? c.Y : c.Z;
+				uint32 b = std::min(lastBin, (uint32)((v - cmin[axis]) * scale));
+				if (bins[b].count++ == 0)
+					bins[b].box = boxes[order[i]];
+				else
+					bins[b].box.addInternalBox(boxes[order[i]]);
+			}
+
+			//areas and counts to the left of each plane, then sweep back from the right
+			float leftArea[SAH_BINS];
+			uint32 leftCount[SAH_BINS];
+			core::aabbox3df acc;
+			uint32 accCount = 0;
+			for (uint32 b = 0; b < SAH_BINS - 1; ++b)
+			{
+				if (bins[b].count)
+				{
+					if (accCount == 0)
+						acc = bins[b].box;
+					else
+						acc.addInternalBox(bins[b].box);
+					accCount += bins[b].count;
+				}
+				leftCount[b] = accCount;
+				leftArea[b] = accCount ? surfaceArea(acc) : 0.0f;
+			}
+
+			accCount = 0;
+			for (uint32 b = SAH_BINS - 1; b > 0; --b)
+			{
+				if (bins[b].count)
+				{
+					if (accCount == 0)
+						acc = bins[b].box;
+					else
+						acc.addInternalBox(bins[b].box);
+					accCount += bins[b].count;
+				}
+
+				if (accCount == 0 || leftCount[b - 1] == 0)
+					continue;
+
+				float cost = leftArea[b - 1] * (float)leftCount[b - 1] + surfaceArea(acc) * (float)accCount;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		if (bestAxis < 0)
+			continue;
+
+		const float splitMin = cmin[bestAxis];
+		const float splitScale = (float)SAH_BINS / (cmax[bestAxis] - cmin[bestAxis]);
+		uint32* mid = std::partition(&order[0] + begin, &order[0] + end, [&](uint32 i)
+		{
+			const core::vector3df& c = centers[i];
+			float v = (bestAxis == 0) ? c.X : (bestAxis == 1) ? c.Y : c.Z;
+			return std::min(lastBin, (uint32)((v - splitMin) * splitScale)) < bestSplit;
+		});
+		uint32 split = mid - &order[0];
+		if (split == begin || split == end)
+			continue;
+
+		Node left;
+		left.first = begin;
+		left.count = split - begin;
+		Node right;
+		right.first = split;
+		right.count = end - split;
+
+		uint32 child = mNodes.size();
+		mNodes[task.node].first = child;
+		mNodes[task.node].count = 0;
+		mNodes.push_back(left);
+		mNodes.push_back(right);
+
+		Task l = { child, task.depth + 1 };
+		Task r = { child + 1, task.depth + 1 };
+		work.push_back(l);
+		work.push_back(r);
+	}
+
+	//triangles in leaf order, so a leaf's are contiguous
+	mTriangles.resize(n);
+	for (uint32 i = 0; i < n; ++i)
+	{
+		const core::vector3df* v = &verts[order[i] * 3];
+		Triangle& tri = mTriangles[i];
+		tri.v0 = v[0];
+		tri.e1 = v[1] - v[0];
+		tri.e2 = v[2] - v[0];
+	}
+
+	std::vector<Node>(mNodes).swap(mNodes);
+}
+
+//slab test against the node's box grown by pad, and by reach more downwards; dir is not necessarily unit length
+static inline bool rayBox(const float* bmin, const float* bmax, float pad, float reach, const float* origin, const float* inv,
+	float tmax, float& tnear)
+{
+	float tmin = 0.0f;
+	for (int a = 0; a < 3; ++a)
+	{
+		float t1 = (bmin[a] - pad - (a == 1 ? reach : 0.0f) - origin[a]) * inv[a];
+		float t2 = (bmax[a] + pad - origin[a]) * inv[a];
+		if (t1 > t2)
+			std::swap(t1, t2);
+		if (t1 > tmin)
+			tmin = t1;
+		if (t2 < tmax)
+			tmax = t2;
+		if (tmin > tmax)
+			return false;
+	}
+
+	tnear = tmin;
+	return true;
+}
+
+bool CollisionWorld::rayTriangle(const core::vector3df& origin, const core::vector3df& dir, const Triangle& tri, float& t)
+{
+	//moller-trumbore, both sides
+	core::vector3df p = dir.crossProduct(tri.e2);
+	float det = tri.e1.dotProduct(p);
+	if (fabsf(det) < 1e-12f)
+		return false;
+
+	float invDet = 1.0f / det;
+	core::vector3df s = origin - tri.v0;
+	float u = s.dotProduct(p) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	core::vector3df q = s.crossProduct(tri.e1);
+	float v = dir.dotProduct(q) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = tri.e2.dotProduct(q) * invDet;
+	return t >= 0.0f;
+}
+
+bool CollisionWorld::raycast(const core::vector3df& origin, const core::vector3df& dir, float max_dist, CollisionHit& hit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	const float o[3] = { origin.X, origin.Y, origin.Z };
+	const float inv[3] = { 1.0f / dir.X, 1.0f / dir.Y, 1.0f / dir.Z };
+	float best = max_dist;
+	uint32 bestTri = 0xFFFFFFFF;
+
+	uint32 stack[MAX_DEPTH];
+	uint32 sp = 0;
+	float tnear;
+	if (!rayBox(mNodes[0].min, mNodes[0].max, 0.0f, 0.0f, o, inv, best, tnear))
+		return false;
+	stack[sp++] = 0;
+
+	while (sp)
+	{
+		const Node& node = mNodes[stack[--sp]];
+
+		if (node.count)
+		{
+			for (uint32 i = node.first; i < node.first + node.count; ++i)
+			{
+				float t;
+				if (rayTriangle(origin, dir, mTriangles[i], t) && t < best)
+				{
+					best = t;
+					bestTri = i;
+				}
+			}
+			continue;
+		}
+
+		//nearer child on top of the stack, so hits there can cull the other one
+		const Node& left = mNodes[node.first];
+		const Node& right = mNodes[node.first + 1];
+		float tl, tr;
+		bool hl = rayBox(left.min, left.max, 0.0f, 0.0f, o, inv, best, tl);
+		bool hr = rayBox(right.min, right.max, 0.0f, 0.0f, o, inv, best, tr);
+
+		if (hl && hr)
+		{
+			if (tl <= tr)
+			{
+				stack[sp++] = node.first + 1;
+				stack[sp++] = node.first;
+			}
+			else
+			{
+				stack[sp++] = node.first;
+				stack[sp++] = node.first + 1;
+			}
+		}
+		else if (hl)
+		{
+			stack[sp++] = node.first;
+		}
+		else if (hr)
+		{
+			stack[sp++] = node.first + 1;
+		}
+	}
+
+	if (bestTri == 0xFFFFFFFF)
+		return false;
+
+	const Triangle& tri = mTriangles[bestTri];
+	hit.distance = best;
+	hit.point = origin + dir * best;
+	hit.normal = tri.e1.crossProduct(tri.e2).normalize();
+	if (hit.normal.dotProduct(dir) > 0.0f)
+		hit.normal = -hit.normal;
+	hit.triangle = bestTri;
+	return true;
+}
+
+bool CollisionWorld::segment(const core::vector3df& start, const core::vector3df& end, CollisionHit& hit) const
+{
+	core::vector3df dir = end - start;
+	float len = dir.getLength();
+	if (len <= EPSILON)
+		return false;
+
+	return raycast(start, dir / len, len, hit);
+}
+
+static bool pointInTriangle(const core::vector3df& p, const core::vector3df& v0, const core::vector3df& e1,
+	const core::vector3df& e2)
+{
+	core::vector3df w = p - v0;
+	float d11 = e1.dotProduct(e1);
+	float d12 = e1.dotProduct(e2);
+	float d22 = e2.dotProduct(e2);
+	float dw1 = w.dotProduct(e1);
+	float dw2 = w.dotProduct(e2);
+	float denom = d11 * d22 - d12 * d12;
+	if (denom <= 0.0f)
+		return false;
+
+	float u = (d22 * dw1 - d12 * dw2) / denom;
+	float v = (d11 * dw2 - d12 * dw1) / denom;
+	return u >= 0.0f && v >= 0.0f && u + v <= 1.0f;
+}
+
+//earliest t in [0, t_max] at which a sphere at start + move * t touches the sphere at center
+static bool sweepPoint(const core::vector3df& start, const core::vector3df& move, float radius, const core::vector3df& center,
+	float t_max, float& t)
+{
+	core::vector3df m = start - center;
+	float a = move.dotProduct(move);
+	float b = m.dotProduct(move);
+	float c = m.dotProduct(m) - radius * radius;
+	if (c < 0.0f || b >= 0.0f)
+		return false; //already touching, or moving away
+
+	float disc = b * b - a * c;
+	if (disc < 0.0f)
+		return false;
+
+	float hit = (-b - sqrtf(disc)) / a;
+	if (hit < 0.0f || hit > t_max)
+		return false;
+
+	t = hit;
+	return true;
+}
+
+//same against the sides of the cylinder around edge a-b; the ends are covered by sweepPoint at the vertices
+static bool sweepEdge(const core::vector3df& start, const core::vector3df& move, float radius, const core::vector3df& a,
+	const core::vector3df& b, float t_max, float& t, core::vector3df& point)
+{
+	core::vector3df d = b - a;
+	core::vector3df m = start - a;
+	float dd = d.dotProduct(d);
+	float nd = move.dotProduct(d);
+	float md = m.dotProduct(d);
+	float nn = move.dotProduct(move);
+	float mn = m.dotProduct(move);
+
+	float qa = dd * nn - nd * nd;
+	if (fabsf(qa) < EPSILON)
+		return false; //moving along the edge
+
+	float qb = dd * mn - nd * md;
+	float qc = dd * (m.dotProduct(m) - radius * radius) - md * md;
+	if (qc < 0.0f)
+		return false; //already touching
+
+	float disc = qb * qb - qa * qc;
+	if (disc < 0.0f)
+		return false;
+
+	float hit = (-qb - sqrtf(disc)) / qa;
+	if (hit < 0.0f || hit > t_max)
+		return false;
+
+	float along = md + hit * nd;
+	if (along < 0.0f || along > dd)
+		return false;
+
+	t = hit;
+	point = a + d * (along / dd);
+	return true;
+}
+
+bool CollisionWorld::sweepTriangle(const core::vector3df& start, const core::vector3df& move, float radius, const Triangle& tri,
+	float& t, core::vector3df& point)
+{
+	core::vector3df normal = tri.e1.crossProduct(tri.e2);
+	normal.normalize();
+
+	float dist = normal.dotProduct(start - tri.v0);
+	if (dist < 0.0f)
+	{
+		normal = -normal;
+		dist = -dist;
+	}
+
+	float approach = -normal.dotProduct(move);
+
+	//the face: if the sphere meets the plane inside the triangle, nothing else can come first
+	if (dist <= radius)
+	{
+		core::vector3df p = start - normal * dist;
+		if (approach > 0.0f && pointInTriangle(p, tri.v0, tri.e1, tri.e2))
+		{
+			t = 0.0f;
+			point = p;
+			return true;
+		}
+	}
+	else if (approach > EPSILON)
+	{
+		float hit = (dist - radius) / approach;
+		if (hit > t)
+			return false; //can't reach the plane in time, so can't touch anything on it either
+
+		core::vector3df p = start + move * hit - normal * radius;
+		if (pointInTriangle(p, tri.v0, tri.e1, tri.e2))
+		{
+			t = hit;
+			point = p;
+			return true;
+		}
+	}
+	else
+	{
+		return false; //clear of the plane and not heading towards it
+	}
+
+	//otherwise the first contact is on an edge or a corner
+	const core::vector3df v[3] = { tri.v0, tri.v0 + tri.e1, tri.v0 + tri.e2 };
+	bool found = false;
+	for (int i = 0; i < 3; ++i)
+	{
+		float hit;
+		core::vector3df p;
+		if (sweepEdge(start, move, radius, v[i], v[(i + 1) % 3], t, hit, p))
+		{
+			t = hit;
+			point = p;
+			found = true;
+		}
+
+		if (sweepPoint(start, move, radius, v[i], t, hit))
+		{
+			t = hit;
+			point = v[i];
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+//the capsule's axis, a to b, sliding by move against the triangle edge c to d: when the two lines come within radius,
+//if the closest points are then inside both segments; the other ways a capsule can touch an edge are covered by the end
+//spheres and the vertices
+static bool sweepAxisEdge(const core::vector3df& a, const core::vector3df& b, const core::vector3df& move, float radius,
+	const core::vector3df& c, const core::vector3df& d, float t_max, float& t, core::vector3df& point)
+{
+	core::vector3df u = b - a;
+	core::vector3df v = d - c;
+	core::vector3df n = u.crossProduct(v);
+	float len = n.getLength();
+	if (len < EPSILON)
+		return false; //parallel
+
+	n /= len;
+	float dist = n.dotProduct(a - c);
+	float approach = -n.dotProduct(move);
+	if (dist < 0.0f)
+	{
+		dist = -dist;
+		approach = -approach;
+	}
+	if (dist <= radius || approach <= EPSILON)
+		return false;
+
+	float hit = (dist - radius) / approach;
+	if (hit > t_max)
+		return false;
+
+	core::vector3df r = a + move * hit - c;
+	float uu = u.dotProduct(u);
+	float uv = u.dotProduct(v);
+	float vv = v.dotProduct(v);
+	float ur = u.dotProduct(r);
+	float vr = v.dotProduct(r);
+	float denom = uu * vv - uv * uv;
+	if (denom <= EPSILON)
+		return false;
+
+	float s = (uv * vr - vv * ur) / denom;
+	float w = (uu * vr - uv * ur) / denom;
+	if (s < 0.0f || s > 1.0f || w < 0.0f || w > 1.0f)
+		return false;
+
+	t = hit;
+	point = c + v * w;
+	return true;
+}
+
+bool CollisionWorld::sweepCapsuleTriangle(const core::vector3df& start, const core::vector3df& move, float radius, float height,
+	const Triangle& tri, float& t, core::vector3df& point)
+{
+	if (height <= 0.0f)
+		return sweepTriangle(start, move, radius, tri, t, point);
+
+	//the two end spheres, then what's left of the sides: the axis against each edge and each corner
+	const core::vector3df top = start + core::vector3df(0.0f, height, 0.0f);
+	bool found = sweepTriangle(start, move, radius, tri, t, point);
+	if (sweepTriangle(top, move, radius, tri, t, point))
+		found = true;
+
+	const core::vector3df v[3] = { tri.v0, tri.v0 + tri.e1, tri.v0 + tri.e2 };
+	for (int i = 0; i < 3; ++i)
+	{
+		float hit;
+		core::vector3df p;
+
+		//a corner moving the other way into the cylinder around the axis
+		if (sweepEdge(v[i], -move, radius, start, top, t, hit, p))
+		{
+			t = hit;
+			point = v[i];
+			found = true;
+		}
+
+		if (sweepAxisEdge(start, top, move, radius, v[i], v[(i + 1) % 3], t, hit, p))
+		{
+			t = hit;
+			point = p;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+bool CollisionWorld::sweepSphere(const core::vector3df& start, const core::vector3df& end, float radius, CollisionHit& hit) const
+{
+	return sweepCapsule(start, end, radius, 0.0f, hit);
+}
+
+bool CollisionWorld::sweepCapsule(const core::vector3df& start, const core::vector3df& end, float radius, float height,
+	CollisionHit& hit) const
+{
+	if (mNodes.empty())
+		return false;
+
+	core::vector3df move = end - start;
+	float len = move.getLength();
+	if (len <= EPSILON)
+		return false;
+
+	//t is a fraction of move here
+	const float o[3] = { start.X, start.Y, start.Z };
+	const float inv[3] = { 1.0f / move.X, 1.0f / move.Y, 1.0f / move.Z };
+	float best = 1.0f;
+	uint32 bestTri = 0xFFFFFFFF;
+	core::vector3df bestPoint;
+
+	uint32 stack[MAX_DEPTH];
+	uint32 sp = 0;
+	float tnear;
+	if (!rayBox(mNodes[0].min, mNodes[0].max, radius, height, o, inv, best, tnear))
+		return false;
+	stack[sp++] = 0;
+
+	while (sp)
+	{
+		const Node& node = mNodes[stack[--sp]];
+
+		if (node.count)
+		{
+			for (uint32 i = node.first; i < node.first + node.count; ++i)
+			{
+				float t = best;
+				core::vector3df p;
+				if (sweepCapsuleTriangle(start, move, radius, height, mTriangles[i], t, p))
+				{
+					best = t;
+					bestTri = i;
+					bestPoint = p;
+				}
+			}
+			continue;
+		}
+
+		const Node& left = mNodes[node.first];
+		const Node& right = mNodes[node.first + 1];
+		float tl, tr;
+		bool hl = rayBox(left.min, left.max, radius, height, o, inv, best, tl);
+		bool hr = rayBox(right.min, right.max, radius, height, o, inv, best, tr);
+
+		if (hl && hr)
+		{
+			if (tl <= tr)
+			{
+				stack[sp++] = node.first + 1;
+				stack[sp++] = node.first;
+			}
+			else
+			{
+				stack[sp++] = node.first;
+				stack[sp++] = node.first + 1;
+			}
+		}
+		else if (hl)
+		{
+			stack[sp++] = node.first;
+		}
+		else if (hr)
+		{
+			stack[sp++] = node.first + 1;
+		}
+	}
+
+	if (bestTri == 0xFFFFFFFF)
+		return false;
+
+	//the normal pushes out from the nearest point on the axis
+	core::vector3df center = start + move * best;
+	center.Y += core::clamp(bestPoint.Y - center.Y, 0.0f, height);
+	hit.distance = best * len;
+	hit.point = bestPoint;
+	hit.normal = center - bestPoint;
+	if (hit.normal.getLengthSQ() <= EPSILON * EPSILON)
+	{
+		const Triangle& tri = mTriangles[bestTri];
+		hit.normal = tri.e1.crossProduct(tri.e2);
+		if (hit.normal.dotProduct(move) > 0.0f)
+			hit.normal = -hit.normal;
+	}
+	hit.normal.normalize();
+	hit.triangle = bestTri;
+	return true;
+}
+
+core::vector3df CollisionWorld::slideCapsule(const core::vector3df& start, const core::vector3df& end, float radius,
+	float height) const
+{
+	core::vector3df pos = start;
+	core::vector3df target = end;
+
+	for (uint32 i = 0; i < SLIDE_ITERATIONS; ++i)
+	{
+		core::vector3df move = target - pos;
+		float len = move.getLength();
+		if (len <= EPSILON)
+			break;
+
+		CollisionHit hit;
+		if (!sweepCapsule(pos, target, radius, height, hit))
+		{
+			pos = target;
+			break;
+		}
+
+		//stop a little short, so the next sweep doesn't start out touching
+		pos += move * (core::max_(0.0f, hit.distance - SKIN_WIDTH) / len);
+
+		//whatever is left of the move, minus the part going into the surface
+		core::vector3df rest = target - pos;
+		rest -= hit.normal * rest.dotProduct(hit.normal);
+		target = pos + rest;
+	}
+
+	return pos;
+}
+
+core::vector3df CollisionWorld::moveCapsule(const core::vector3df& start, const core::vector3df& end, float radius, float height,
+	float step_height) const
+{
+	core::vector3df flat = slideCapsule(start, end, radius, height);
+	if (step_height <= 0.0f || flat.getDistanceFromSQ(end) <= EPSILON)
+		return flat;
+
+	//blocked: see if it gets further going up a step, across, and back down
+	core::vector3df up = slideCapsule(start, start + core::vector3df(0.0f, step_height, 0.0f), radius, height);
+	float lift = up.Y - start.Y;
+	if (lift <= EPSILON)
+		return flat;
+
+	core::vector3df across = slideCapsule(up, end + core::vector3df(0.0f, lift, 0.0f), radius, height);
+	core::vector3df down = across - core::vector3df(0.0f, lift, 0.0f);
+	CollisionHit hit;
+	if (sweepCapsule(across, down, radius, height, hit))
+		down = across - core::vector3df(0.0f, core::max_(0.0f, hit.distance - SKIN_WIDTH), 0.0f);
+
+	core::vector3df flatMove(flat.X - start.X, 0.0f, flat.Z - start.Z);
+	core::vector3df stepMove(down.X - start.X, 0.0f, down.Z - start.Z);
+	return (stepMove.getLengthSQ() > flatMove.getLengthSQ()) ? down : flat;
+}
+
+core::aabbox3df CollisionWorld::getBoundingBox() const
+{
+	if (mNodes.empty())
+		return core::aabbox3df(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+
+	const Node& root = mNodes[0];
+	return core::aabbox3df(root.min[0], root.min[1], root.min[2], root.max[0], root.max[1], root.max[2]);
+}
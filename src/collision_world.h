@@ -0,0 +1,91 @@
+
+#ifndef _ZEQ_COLLISION_WORLD_H
+#define _ZEQ_COLLISION_WORLD_H
+
+#include <irrlicht.h>
+
+#include <vector>
+
+#include "types.h"
+
+using namespace irr;
+
+class ZoneModel;
+
+struct CollisionHit
+{
+	CollisionHit() : distance(0.0f), triangle(0) { }
+
+	float distance; //along the ray or sweep, in world units
+	core::vector3df point; //on the triangle
+	core::vector3df normal; //facing back towards the query
+	uint32 triangle;
+};
+
+//static zone geometry in world space, for queries that don't go through irrlicht's scene graph:
+//the collidable zone mesh plus every collidable placed object, baked into one SAH BVH over triangles
+class CollisionWorld
+{
+private:
+	static const uint32 MAX_LEAF_TRIANGLES = 4;
+	static const uint32 SAH_BINS = 16;
+	static const uint32 MAX_DEPTH = 64;
+	static const uint32 SLIDE_ITERATIONS = 4;
+	static const float SKIN_WIDTH; //gap kept between a sliding capsule and what it slid against
+
+	//32 bytes, two to a cache line; children of an interior node are always adjacent
+	struct Node
+	{
+		float min[3];
+		uint32 first; //leaf: first triangle, interior: left child (right is first + 1)
+		float max[3];
+		uint32 count; //triangles, 0 for interior nodes
+	};
+
+	//stored ready for the ray test: one corner and the two edges out of it
+	struct Triangle
+	{
+		core::vector3df v0;
+		core::vector3df e1;
+		core::vector3df e2;
+	};
+
+	std::vector<Node> mNodes;
+	std::vector<Triangle> mTriangles;
+
+private:
+	void addMesh(scene::IMesh* mesh, const core::matrix4& transform, std::vector<core::vector3df>& verts);
+	void buildTree(std::vector<core::vector3df>& verts);
+
+	static bool rayTriangle(const core::vector3df& origin, const core::vector3df& dir, const Triangle& tri, float& t);
+	static bool sweepTriangle(const core::vector3df& start, const core::vector3df& move, float radius, const Triangle& tri,
+		float& t, core::vector3df& point);
+	static bool sweepCapsuleTriangle(const core::vector3df& start, const core::vector3df& move, float radius, float height,
+		const Triangle& tri, float& t, core::vector3df& point);
+	core::vector3df slideCapsule(const core::vector3df& start, const core::vector3df& end, float radius, float height) const;
+
+public:
+	//reads the meshes only, safe on a worker thread
+	void build(ZoneModel* zoneModel);
+	void clear();
+
+	//nearest hit along dir (unit length) within max_dist
+	bool raycast(const core::vector3df& origin, const core::vector3df& dir, float max_dist, CollisionHit& hit) const;
+	bool segment(const core::vector3df& start, const core::vector3df& end, CollisionHit& hit) const;
+	//first contact of a sphere moved from start to end; distance is how far its center gets
+	bool sweepSphere(const core::vector3df& start, const core::vector3df& end, float radius, CollisionHit& hit) const;
+	//same for an upright capsule: positions are the center of its bottom sphere, the top one is height above
+	bool sweepCapsule(const core::vector3df& start, const core::vector3df& end, float radius, float height,
+		CollisionHit& hit) const;
+	//character movement: slides along whatever the capsule runs into, and climbs ledges up to step_height
+	core::vector3df moveCapsule(const core::vector3df& start, const core::vector3df& end, float radius, float height,
+		float step_height) const;
+
+	bool empty() const { return mTriangles.empty(); }
+	uint32 getTriangleCount() const { return mTriangles.size(); }
+	uint32 getNodeCount() const { return mNodes.size(); }
+	uint64 getMemoryUsage() const { return (uint64)mNodes.size() * sizeof(Node) + (uint64)mTriangles.size() * sizeof(Triangle); }
+	core::aabbox3df getBoundingBox() const;
+};
+
+#endif
@@ -1,5 +1,25 @@
 
 #include "file_loader.h"
+#include "zeq_lua.h"
+
+FileLoader::FileLoader() :
+	mCacheBudget((uint64)DEFAULT_CACHE_BUDGET_MB * 1024 * 1024)
+{
+	memset(&mStats, 0, sizeof(CacheStats));
+}
+
+FileLoader::~FileLoader()
+{
+	for (auto& pair : mWLDs)
+		delete pair.second.wld;
+	for (auto& pair : mS3Ds)
+		delete pair.second.s3d;
+}
+
+void FileLoader::initialize()
+{
+	mCacheBudget = (uint64)Lua::getConfigInt(CONFIG_VAR_FILE_CACHE_BUDGET, DEFAULT_CACHE_BUDGET_MB) * 1024 * 1024;
+}
 
 void FileLoader::setPathToEQ(std::string path)
 {
@@ -16,9 +36,17 @@ void FileLoader::setPathToEQ(std::string path)
 
 S3D* FileLoader::getS3D(std::string name)
 {
-	if (mS3Ds.count(name) != 0)
-		return mS3Ds[name];
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
 
+	auto it = mS3Ds.find(name);
+	if (it != mS3Ds.end())
+	{
+		++mStats.hits;
+		mS3DLRU.splice(mS3DLRU.begin(), mS3DLRU, it->second.lru);
+		return it->second.s3d;
+	}
+
+	++mStats.misses;
 	std::string ext_name = mPathToEQ + name + ".s3d";
 	
 	//try .s3d, then .eqg (live client does it in the opposite order, but oh well)
@@ -30,7 +58,13 @@ S3D* FileLoader::getS3D(std::string name)
 			try
 			{
 				S3D* s3d = new S3D(file);
-				mS3Ds[name] = s3d;
+				//make room before adding, so that the new archive can't be the one to go
+				trimCache();
+				mS3DLRU.push_front(name);
+				CachedS3D cached;
+				cached.s3d = s3d;
+				cached.lru = mS3DLRU.begin();
+				mS3Ds[name] = cached;
 				return s3d;
 			}
 			catch (ZEQException& e)
@@ -48,52 +82,173 @@ S3D* FileLoader::getS3D(std::string name)
 
 void FileLoader::unloadS3D(std::string name)
 {
-	if (mS3Ds.count(name) == 0)
-		return;
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
+	evictS3D(name);
+}
 
-	delete mS3Ds[name];
-	mS3Ds.erase(name);
+std::string FileLoader::wldKey(const std::string& name, const char* fromS3D)
+{
+	//some WLDs have generic names (e.g. 'objects.wld'), use fromS3D to specify source
+	if (fromS3D == nullptr)
+		return name;
+	std::string key = fromS3D;
+	key += '/';
+	key += name;
+	return key;
 }
 
 WLD* FileLoader::getWLD(std::string name, const char* fromS3D, bool cache)
 {
-	//some WLDs have generic names (e.g. 'objects.wld'), use fromS3D to specify source
-	std::string orig_name;
-	if (fromS3D)
+	std::string key = wldKey(name, fromS3D);
+
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+	if (cache)
 	{
-		orig_name = name;
-		name = fromS3D + '/' + name;
+		auto it = mWLDs.find(key);
+		if (it != mWLDs.end())
+		{
+			++mStats.hits;
+			++it->second.pins;
+			mWLDLRU.splice(mWLDLRU.begin(), mWLDLRU, it->second.lru);
+			return it->second.wld;
+		}
 	}
 
-	if (cache && mWLDs.count(name) != 0)
-		return mWLDs[name];
-
 	S3D* s3d = getS3D(fromS3D ? fromS3D : name);
 	if (s3d == nullptr)
 		return nullptr;
 
-	std::string ext_name = fromS3D ? (orig_name + ".wld") : (name + ".wld");
-	MemoryStream* file = s3d->getFile(ext_name.c_str());
+	std::string ext_name = name + ".wld";
+	MemoryStream* file = s3d->copyFile(ext_name.c_str());
 	if (file == nullptr)
 		return nullptr;
 
 	try
 	{
-		WLD* wld = new WLD(file, s3d, name);
+		//the WLD pins its archive as soon as it is constructed, still under the lock
+		WLD* wld = new WLD(file, s3d, key);
 		if (cache)
-			mWLDs[name] = wld;
+		{
+			mWLDLRU.push_front(key);
+			CachedWLD cached;
+			cached.wld = wld;
+			cached.pins = 1;
+			cached.lru = mWLDLRU.begin();
+			mWLDs[key] = cached;
+		}
 		return wld;
 	}
 	catch (ZEQException& e)
 	{
 		printf("Error: %s\n", e.what());
+		delete file;
 	}
 
 	return nullptr;
 }
 
+void FileLoader::releaseWLD(std::string name, const char* fromS3D)
+{
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+	auto it = mWLDs.find(wldKey(name, fromS3D));
+	if (it != mWLDs.end() && it->second.pins > 0 && --it->second.pins == 0)
+	{
+		//the cache may have gone over budget while this was in use, and it couldn't be evicted until now
+		trimCache();
+	}
+}
+
+void FileLoader::checkCacheBudget()
+{
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
+	trimCache();
+}
+
+uint64 FileLoader::getCacheSize()
+{
+	//decompressed files come and go inside archives, so this is summed fresh each time
+	uint64 bytes = 0;
+	for (auto& pair : mS3Ds)
+		bytes += pair.second.s3d->getMemoryUsage();
+	return bytes;
+}
+
+bool FileLoader::evictS3D(const std::string& name)
+{
+	auto it = mS3Ds.find(name);
+	if (it == mS3Ds.end() || it->second.s3d->isPinned())
+		return false;
+
+	++mStats.evictions;
+	mStats.bytesEvicted += it->second.s3d->getMemoryUsage();
+
+	mS3DLRU.erase(it->second.lru);
+	delete it->second.s3d;
+	mS3Ds.erase(it);
+	return true;
+}
+
+void FileLoader::trimCache()
+{
+	uint64 size = getCacheSize();
+
+	while (size > mCacheBudget)
+	{
+		bool evicted = false;
+
+		//oldest unpinned archive first
+		for (auto it = mS3DLRU.rbegin(); it != mS3DLRU.rend(); ++it)
+		{
+			uint64 bytes = mS3Ds[*it].s3d->getMemoryUsage();
+			if (evictS3D(*it))
+			{
+				size -= bytes;
+				evicted = true;
+				break;
+			}
+		}
+
+		if (evicted)
+			continue;
+
+		//every archive is pinned; the oldest cached WLD nobody holds is keeping one of them that way
+		for (auto it = mWLDLRU.rbegin(); it != mWLDLRU.rend(); ++it)
+		{
+			CachedWLD& cached = mWLDs[*it];
+			if (cached.pins == 0)
+			{
+				++mStats.evictions;
+				delete cached.wld;
+				mWLDs.erase(*it);
+				mWLDLRU.erase(std::next(it).base());
+				evicted = true;
+				break;
+			}
+		}
+
+		//everything left is in use; going over budget is better than pulling files out from under a load
+		if (!evicted)
+			return;
+	}
+}
+
+void FileLoader::printCacheStats()
+{
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+	static const double MB = 1.0 / (1024.0 * 1024.0);
+	printf("FileLoader cache: %u archives, %.2f / %.2f MB, %u hits, %u misses, %u evictions (%.2f MB)\n",
+		(uint32)mS3Ds.size(), (double)getCacheSize() * MB, (double)mCacheBudget * MB,
+		mStats.hits, mStats.misses, mStats.evictions, (double)mStats.bytesEvicted * MB);
+}
+
 ZON* FileLoader::getZON(std::string name)
 {
+	//held until the ZON exists and has pinned the archive
+	std::lock_guard<std::recursive_mutex> lock(mMutex);
+
 	//the zon may not be in the s3d, but we need it regardless because that's where everything else is
 	S3D* s3d = getS3D(name);
 	if (s3d == nullptr)
@@ -115,6 +270,11 @@ ZON* FileLoader::getZON(std::string name)
 			catch (ZEQException& e)
 			{
 				printf("Error: %s\n", e.what());
+				if (i == 0)
+				{
+					s3d->releaseFile(file);
+					file = nullptr;
+				}
 			}
 		}
 
@@ -142,6 +302,7 @@ ZON* FileLoader::getZON(std::string name)
 			catch (ZEQException& e)
 			{
 				printf("Error: %s\n", e.what());
+				s3d->releaseFile(file);
 			}
 		}
 	}
@@ -152,17 +313,20 @@ ZON* FileLoader::getZON(std::string name)
 void FileLoader::handleGlobalLoad()
 {
 	//just global_chr for now
-	WLD* wld = getWLD("global_chr", nullptr, false);
-	wld->convertAllMobModels();
-	delete wld; //don't need to keep it loaded since all the assets are extracted for sure
-	unloadS3D("global_chr");
+	//models are only indexed here, each is converted when something first spawns with it (see MobManager)
+	WLD* wld = getWLD("global_chr");
+	if (wld == nullptr)
+		return;
+	wld->indexMobModels();
+	releaseWLD("global_chr");
 }
 
 void FileLoader::handleZoneChr(std::string shortname)
 {
 	shortname += "_chr";
-	WLD* wld = getWLD(shortname, nullptr, false);
-	wld->convertAllMobModels();
-	delete wld;
-	unloadS3D(shortname);
+	WLD* wld = getWLD(shortname);
+	if (wld == nullptr)
+		return;
+	wld->indexMobModels();
+	releaseWLD(shortname);
 }
@@ -3,7 +3,9 @@
 #define _ZEQ_FILE_LOADER_H
 
 #include <unordered_map>
+#include <list>
 #include <string>
+#include <mutex>
 
 #include "types.h"
 #include "memory_stream.h"
@@ -12,28 +14,81 @@
 #include "wld.h"
 #include "zon.h"
 
+//archives (and any WLDs asked to be cached) are kept around after use, least recently used first out
+//once they go over the memory budget; anything still being read from is pinned and never evicted
 class FileLoader
 {
+private:
+	static const uint32 DEFAULT_CACHE_BUDGET_MB = 256;
+
+	struct CachedS3D
+	{
+		S3D* s3d;
+		std::list<std::string>::iterator lru;
+	};
+
+	struct CachedWLD
+	{
+		WLD* wld;
+		uint32 pins; //callers that haven't called releaseWLD() yet
+		std::list<std::string>::iterator lru;
+	};
+
+	struct CacheStats
+	{
+		uint32 hits;
+		uint32 misses;
+		uint32 evictions;
+		uint64 bytesEvicted;
+	};
+
 private:
 	std::string mPathToEQ;
 
-	std::unordered_map<std::string, S3D*> mS3Ds;
-	std::unordered_map<std::string, WLD*> mWLDs;
+	std::unordered_map<std::string, CachedS3D> mS3Ds;
+	std::unordered_map<std::string, CachedWLD> mWLDs;
+	//most recently used at the front
+	std::list<std::string> mS3DLRU;
+	std::list<std::string> mWLDLRU;
+
+	uint64 mCacheBudget;
+	CacheStats mStats;
+
+	//zones are loaded on worker threads while the main thread may be loading other things
+	std::recursive_mutex mMutex;
+
+private:
+	uint64 getCacheSize();
+	void trimCache();
+	bool evictS3D(const std::string& name);
+	std::string wldKey(const std::string& name, const char* fromS3D);
 
 public:
+	FileLoader();
+	~FileLoader();
+
+	void initialize();
 	void setPathToEQ(std::string path);
 	std::string getPathToEQ() { return mPathToEQ; }
 
 	//omit file extension
+	//the archive stays valid while something pins it (any WLD, ZON etc. reading from it does)
 	S3D* getS3D(std::string name);
+	//evicts the archive right away if nothing is using it, for things we know won't be needed again
 	void unloadS3D(std::string name);
 	//omit file extension
+	//cached WLDs are shared and must be given back with releaseWLD(); uncached ones belong to the caller
 	WLD* getWLD(std::string name, const char* fromS3D = nullptr, bool cache = true); //no point in caching zone wlds
+	void releaseWLD(std::string name, const char* fromS3D = nullptr);
+	//for archives whose memory use has grown since they were added, e.g. by decompressing a file
+	void checkCacheBudget();
 	//emit file extension
 	ZON* getZON(std::string name);
 
 	void handleGlobalLoad();
 	void handleZoneChr(std::string shortname);
+
+	void printCacheStats();
 };
 
 #endif
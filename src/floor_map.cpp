@@ -0,0 +1,289 @@
+
+#include "floor_map.h"
+#include "worker_pool.h"
+#include "micro_timer.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+
+extern WorkerPool gWorkerPool;
+
+const float FloorMap::MIN_CELL_SIZE = 4.0f;
+const float FloorMap::HEIGHT_TOLERANCE = 0.25f;
+const float FloorMap::WALKABLE_NORMAL_Y = 0.7f;
+const float FloorMap::SLOPE_SCALE = 1024.0f;
+
+FloorMap::FloorMap() :
+	mWorld(nullptr),
+	mMinX(0.0f), mMinZ(0.0f),
+	mCellSize(MIN_CELL_SIZE),
+	mInvCellSize(1.0f / MIN_CELL_SIZE),
+	mCellsX(0), mCellsZ(0)
+{
+
+}
+
+void FloorMap::clear()
+{
+	mCellsX = 0;
+	mCellsZ = 0;
+	mCellStart.clear();
+	mLayers.clear();
+}
+
+void FloorMap::build(const CollisionWorld* world)
+{
+	clear();
+	mWorld = world;
+	if (world->empty())
+		return;
+
+	MicroTimer timer;
+	core::aabbox3df bounds = world->getBoundingBox();
+	core::vector3df extent = bounds.getExtent();
+
+	mCellSize = core::max_(MIN_CELL_SIZE, core::max_(extent.X, extent.Z) / (float)MAX_CELLS_PER_SIDE);
+	mInvCellSize = 1.0f / mCellSize;
+	mMinX = bounds.MinEdge.X;
+	mMinZ = bounds.MinEdge.Z;
+	mCellsX = (uint32)ceilf(extent.X * mInvCellSize) + 1;
+	mCellsZ = (uint32)ceilf(extent.Z * mInvCellSize) + 1;
+
+	const uint32 cells = mCellsX * mCellsZ;
+	const float top = bounds.MaxEdge.Y + 1.0f;
+	const float bottom = bounds.MinEdge.Y - 1.0f;
+	std::vector<Layer> found(cells * MAX_LAYERS);
+	std::vector<uint8> counts(cells);
+
+	//a row of cells per chunk, rows are independent
+	gWorkerPool.parallelFor(mCellsZ, 1, [&](uint32 begin, uint32 end)
+	{
+		for (uint32 z = begin; z < end; ++z)
+		{
+			for (uint32 x = 0; x < mCellsX; ++x)
+			{
+				uint32 cell = z * mCellsX + x;
+				counts[cell] = (uint8)findLayers(mMinX + ((float)x + 0.5f) * mCellSize, mMinZ + ((float)z + 0.5f) * mCellSize,
+					top, bottom, &found[cell * MAX_LAYERS]);
+			}
+		}
+	});
+
+	mCellStart.resize(cells + 1);
+	uint32 total = 0;
+	for (uint32 i = 0; i < cells; ++i)
+	{
+		mCellStart[i] = total;
+		total += counts[i];
+	}
+	mCellStart[cells] = total;
+
+	mLayers.resize(total);
+	uint32 inexact = 0;
+	for (uint32 i = 0; i < cells; ++i)
+	{
+		for (uint32 j = 0; j < counts[i]; ++j)
+		{
+			mLayers[mCellStart[i] + j] = found[i * MAX_LAYERS + j];
+			if (found[i * MAX_LAYERS + j].slopeX == INEXACT)
+				++inexact;
+		}
+	}
+
+	printf("floor map: %ux%u cells of %g units, %u layers (%u left to raycasts), %.2f MB, built in %.1f ms\n",
+		mCellsX, mCellsZ, mCellSize, total, inexact, (double)getMemoryUsage() / (1024.0 * 1024.0),
+		(double)timer.getElapsed() / 1000.0);
+}
+
+uint32 FloorMap::findLayers(float x, float z, float top, float bottom, Layer* out) const
+{
+	static const float PROBE = 1.0f;
+	const core::vector3df down(0.0f, -1.0f, 0.0f);
+	const float inset = mCellSize * 0.45f;
+	const float cornerX[4] = { -inset, inset, -inset, inset };
+	const float cornerZ[4] = { -inset, -inset, inset, inset };
+
+	uint32 n = 0;
+	float y = top;
+	CollisionHit hit;
+
+	//down through everything at the center of the cell
+	while (n < MAX_LAYERS && y > bottom && mWorld->raycast(core::vector3df(x, y, z), down, y - bottom, hit))
+	{
+		const float above = y; //just under the previous surface, or the top of the world
+		y = hit.point.Y - 0.01f;
+
+		//too steep to stand on, but the raycast would still land on it; a run of these needs only the lowest
+		if (hit.normal.Y < WALKABLE_NORMAL_Y)
+		{
+			if (n > 0 && out[n - 1].slopeX == INEXACT)
+			{
+				out[n - 1].y = hit.point.Y;
+			}
+			else
+			{
+				Layer& layer = out[n++];
+				layer.y = hit.point.Y;
+				layer.slopeX = INEXACT;
+				layer.slopeZ = 0;
+			}
+			continue;
+		}
+
+		float dx = core::clamp(-hit.normal.X / hit.normal.Y, -31.0f, 31.0f);
+		float dz = core::clamp(-hit.normal.Z / hit.normal.Y, -31.0f, 31.0f);
+
+		Layer& layer = out[n++];
+		layer.y = hit.point.Y;
+		layer.slopeX = (int16)(dx * SLOPE_SCALE);
+		layer.slopeZ = (int16)(dz * SLOPE_SCALE);
+
+		//the plane has to hold at the corners too, or this cell straddles an edge, a step or a hole; the probes start
+		//from the surface above, so anything between the two at a corner is found as well
+		for (int c = 0; c < 4; ++c)
+		{
+			float predicted = layer.y + dx * cornerX[c] + dz * cornerZ[c];
+			float start = core::max_(above, predicted + PROBE);
+			CollisionHit corner;
+			if (!mWorld->raycast(core::vector3df(x + cornerX[c], start, z + cornerZ[c]), down, start - predicted + PROBE, corner) ||
+				fabsf(corner.point.Y - predicted) > HEIGHT_TOLERANCE)
+			{
+				layer.slopeX = INEXACT;
+				break;
+			}
+		}
+	}
+
+	//out of layers with more below: the last one stands for everything from there down, which only a raycast can answer
+	if (n == MAX_LAYERS && y > bottom && mWorld->raycast(core::vector3df(x, y, z), down, y - bottom, hit))
+	{
+		out[n - 1].y = bottom;
+		out[n - 1].slopeX = INEXACT;
+		out[n - 1].slopeZ = 0;
+	}
+
+	return n;
+}
+
+int FloorMap::lookup(float x, float y, float z, float& out) const
+{
+	int32 cx = (int32)floorf((x - mMinX) * mInvCellSize);
+	int32 cz = (int32)floorf((z - mMinZ) * mInvCellSize);
+	if (cx < 0 || cz < 0 || (uint32)cx >= mCellsX || (uint32)cz >= mCellsZ)
+		return LOOKUP_INEXACT;
+
+	uint32 cell = (uint32)cz * mCellsX + (uint32)cx;
+	float dx = x - (mMinX + ((float)cx + 0.5f) * mCellSize);
+	float dz = z - (mMinZ + ((float)cz + 0.5f) * mCellSize);
+
+	for (uint32 i = mCellStart[cell]; i < mCellStart[cell + 1]; ++i)
+	{
+		const Layer& layer = mLayers[i];
+		if (layer.slopeX == INEXACT)
+		{
+			//might be above or below us anywhere but the center
+			if (layer.y - mCellSize <= y)
+				return LOOKUP_INEXACT;
+			continue;
+		}
+
+		float h = layer.y + ((float)layer.slopeX * dx + (float)layer.slopeZ * dz) * (1.0f / SLOPE_SCALE);
+		if (h <= y + HEIGHT_TOLERANCE)
+		{
+			out = h;
+			return LOOKUP_FOUND;
+		}
+	}
+
+	//the cell's whole column was scanned, see findLayers
+	return LOOKUP_NONE;
+}
+
+bool FloorMap::raycastFloor(float x, float y, float z, float& out) const
+{
+	CollisionHit hit;
+	if (!mWorld || !mWorld->raycast(core::vector3df(x, y, z), core::vector3df(0.0f, -1.0f, 0.0f), 1e6f, hit))
+		return false;
+
+	out = hit.point.Y;
+	return true;
+}
+
+bool FloorMap::getFloorHeight(float x, float y, float z, float& out) const
+{
+	switch (lookup(x, y, z, out))
+	{
+	case LOOKUP_FOUND:
+		return true;
+	case LOOKUP_NONE:
+		return false;
+	default:
+		return raycastFloor(x, y, z, out);
+	}
+}
+
+void FloorMap::benchmark(uint32 lookups) const
+{
+	if (mWorld == nullptr || mWorld->empty())
+		return;
+
+	core::aabbox3df bounds = mWorld->getBoundingBox();
+	Random rng;
+	std::uniform_real_distribution<float> rx(bounds.MinEdge.X, bounds.MaxEdge.X);
+	std::uniform_real_distribution<float> ry(bounds.MinEdge.Y, bounds.MaxEdge.Y);
+	std::uniform_real_distribution<float> rz(bounds.MinEdge.Z, bounds.MaxEdge.Z);
+
+	//points just above a floor are what gravity asks about; half of them, the rest anywhere
+	std::vector<core::vector3df> points;
+	while (points.size() < lookups)
+	{
+		core::vector3df p(rx(rng), ry(rng), rz(rng));
+		float floor;
+		if ((points.size() & 1) && raycastFloor(p.X, bounds.MaxEdge.Y + 1.0f, p.Z, floor))
+			p.Y = floor + 5.0f;
+		points.push_back(p);
+	}
+
+	std::vector<float> mapHeights(lookups);
+	std::vector<uint8> mapFound(lookups);
+	MicroTimer mapTimer;
+	for (uint32 i = 0; i < lookups; ++i)
+		mapFound[i] = getFloorHeight(points[i].X, points[i].Y, points[i].Z, mapHeights[i]) ? 1 : 0;
+	uint32 mapTime = mapTimer.getElapsed();
+
+	std::vector<float> rayHeights(lookups);
+	std::vector<uint8> rayFound(lookups);
+	MicroTimer rayTimer;
+	for (uint32 i = 0; i < lookups; ++i)
+		rayFound[i] = raycastFloor(points[i].X, points[i].Y, points[i].Z, rayHeights[i]) ? 1 : 0;
+	uint32 rayTime = rayTimer.getElapsed();
+
+	uint32 fast = 0;
+	uint32 agree = 0;
+	float worst = 0.0f;
+	for (uint32 i = 0; i < lookups; ++i)
+	{
+		float unused;
+		if (lookup(points[i].X, points[i].Y, points[i].Z, unused) != LOOKUP_INEXACT)
+			++fast;
+
+		if (mapFound[i] != rayFound[i])
+			continue;
+		if (!mapFound[i])
+		{
+			++agree;
+			continue;
+		}
+
+		float diff = fabsf(mapHeights[i] - rayHeights[i]);
+		if (diff <= HEIGHT_TOLERANCE)
+			++agree;
+		else
+			worst = core::max_(worst, diff);
+	}
+
+	printf("floor map, %u lookups: %.1f M/s (%.1f%% without a raycast), raycasts %.1f M/s\n", lookups,
+		mapTime ? (double)lookups / mapTime : 0.0, 100.0 * fast / lookups, rayTime ? (double)lookups / rayTime : 0.0);
+	printf("  %u/%u within %g of the raycast, worst of the rest off by %g\n", agree, lookups, HEIGHT_TOLERANCE, worst);
+}
@@ -0,0 +1,70 @@
+
+#ifndef _ZEQ_FLOOR_MAP_H
+#define _ZEQ_FLOOR_MAP_H
+
+#include <irrlicht.h>
+
+#include <vector>
+
+#include "types.h"
+#include "collision_world.h"
+
+using namespace irr;
+
+//the walkable surfaces of a zone on a grid over X and Z, several layers per cell for bridges, buildings and caves;
+//each layer is a plane good to within HEIGHT_TOLERANCE over its cell, or marked for an exact raycast instead
+class FloorMap
+{
+private:
+	static const uint32 MAX_LAYERS = 8;
+	static const uint32 MAX_CELLS_PER_SIDE = 512;
+	static const float MIN_CELL_SIZE;
+	static const float HEIGHT_TOLERANCE;
+	static const float WALKABLE_NORMAL_Y; //surfaces steeper than this aren't floors
+	static const float SLOPE_SCALE; //fixed point for the stored slopes
+	static const int16 INEXACT = -32768; //in slopeX: ask the collision world instead
+
+	enum LookupResult
+	{
+		LOOKUP_FOUND,
+		LOOKUP_NONE,
+		LOOKUP_INEXACT
+	};
+
+	//8 bytes; the height is at the cell's center
+	struct Layer
+	{
+		float y;
+		int16 slopeX; //dy/dx * SLOPE_SCALE
+		int16 slopeZ;
+	};
+
+	const CollisionWorld* mWorld;
+	float mMinX, mMinZ;
+	float mCellSize;
+	float mInvCellSize;
+	uint32 mCellsX, mCellsZ;
+	std::vector<uint32> mCellStart; //index of each cell's first layer, plus one past the end
+	std::vector<Layer> mLayers; //highest first within a cell
+
+private:
+	uint32 findLayers(float x, float z, float top, float bottom, Layer* out) const;
+	int lookup(float x, float y, float z, float& out) const;
+	bool raycastFloor(float x, float y, float z, float& out) const;
+
+public:
+	FloorMap();
+
+	//casts rays down through the whole world, spread over the worker pool; call after the world is built
+	void build(const CollisionWorld* world);
+	void clear();
+
+	//height of the highest floor at or below y at (x, z), false if there is none
+	bool getFloorHeight(float x, float y, float z, float& out) const;
+
+	uint64 getMemoryUsage() const { return (uint64)mCellStart.size() * sizeof(uint32) + (uint64)mLayers.size() * sizeof(Layer); }
+	//times lookups at random points against exact raycasts and checks they agree
+	void benchmark(uint32 lookups) const;
+};
+
+#endif
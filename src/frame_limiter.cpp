@@ -0,0 +1,99 @@
+
+#include "frame_limiter.h"
+
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <mmsystem.h>
+#endif
+
+FrameLimiter::FrameLimiter() :
+	mFrameCount(0),
+	mNextStat(0)
+{
+#ifdef _WIN32
+	//the default scheduler tick makes a 1 ms sleep last up to 15 ms
+	timeBeginPeriod(1);
+#endif
+	mFrameTimes.reserve(STATS_FRAMES);
+	mWorkTimes.reserve(STATS_FRAMES);
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void FrameLimiter::reset()
+{
+	mTimer = MicroTimer();
+	mFrameCount = 0;
+	mFrameTimes.clear();
+	mWorkTimes.clear();
+	mNextStat = 0;
+}
+
+uint32 FrameLimiter::endFrame(uint32 fps)
+{
+	uint32 work = mTimer.getElapsed();
+	uint32 elapsed = work;
+
+	if (fps > 0)
+	{
+		const uint32 target = 1000000 / fps;
+		while (elapsed + SPIN_MICROSECONDS < target)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			elapsed = mTimer.getElapsed();
+		}
+		while (elapsed < target)
+		{
+			std::this_thread::yield();
+			elapsed = mTimer.getElapsed();
+		}
+	}
+
+	mTimer = MicroTimer();
+	++mFrameCount;
+
+	if (mFrameTimes.size() < STATS_FRAMES)
+	{
+		mFrameTimes.push_back(elapsed);
+		mWorkTimes.push_back(work);
+	}
+	else
+	{
+		mFrameTimes[mNextStat] = elapsed;
+		mWorkTimes[mNextStat] = work;
+		mNextStat = (mNextStat + 1) % STATS_FRAMES;
+	}
+
+	return elapsed;
+}
+
+void FrameLimiter::printStats() const
+{
+	if (mFrameTimes.empty())
+		return;
+
+	std::vector<uint32> sorted = mFrameTimes;
+	std::sort(sorted.begin(), sorted.end());
+
+	uint64 total = 0;
+	uint64 work = 0;
+	for (uint32 i = 0; i < mFrameTimes.size(); ++i)
+	{
+		total += mFrameTimes[i];
+		work += mWorkTimes[i];
+	}
+
+	double avg = (double)total / mFrameTimes.size();
+	printf("frame times, last %u frames: %.2f ms average (%.1f fps), %.2f ms 99th percentile, %.2f ms worst, %.2f ms average before waiting\n",
+		(uint32)mFrameTimes.size(), avg * 0.001, avg > 0.0 ? 1000000.0 / avg : 0.0, sorted[sorted.size() * 99 / 100] * 0.001,
+		sorted.back() * 0.001, (double)work / mFrameTimes.size() * 0.001);
+}
@@ -0,0 +1,39 @@
+
+#ifndef _ZEQ_FRAME_LIMITER_H
+#define _ZEQ_FRAME_LIMITER_H
+
+#include <vector>
+
+#include "types.h"
+#include "micro_timer.h"
+
+//paces the main loop to a target frame rate off the high-resolution timer, and keeps frame times for statistics;
+//sleeps are only accurate to a millisecond or so, the last stretch of each frame is spent yielding instead
+class FrameLimiter
+{
+private:
+	static const uint32 SPIN_MICROSECONDS = 2000;
+	static const uint32 STATS_FRAMES = 1024;
+
+	MicroTimer mTimer; //since the end of the previous frame
+	uint32 mFrameCount;
+
+	//last STATS_FRAMES frames, in microseconds: start to start, and how much of that wasn't waiting
+	std::vector<uint32> mFrameTimes;
+	std::vector<uint32> mWorkTimes;
+	uint32 mNextStat;
+
+public:
+	FrameLimiter();
+	~FrameLimiter();
+
+	void reset();
+	//waits out the rest of the frame, 0 fps for no limit; returns how long the frame took in microseconds
+	uint32 endFrame(uint32 fps);
+
+	uint32 getFrameCount() const { return mFrameCount; }
+	//average, 99th percentile and worst frame times of recent frames
+	void printStats() const;
+};
+
+#endif
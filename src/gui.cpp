@@ -64,6 +64,26 @@ void GUI::displayChat(int channel, String str)
 	wnd->elem->SetScrollTop(9999999.0f);
 }
 
+void GUI::displayLoadProgress(float progress, const char* stage)
+{
+	//the gui scripts decide how (and whether) to show this
+	lua_State* L = ::Lua::getState();
+	lua_getglobal(L, "onLoadProgress");
+	if (!lua_isfunction(L, -1))
+	{
+		lua_pop(L, 1);
+		return;
+	}
+
+	lua_pushnumber(L, progress);
+	lua_pushstring(L, stage);
+	if (lua_pcall(L, 2, 0, 0) != 0)
+	{
+		printf("Error in onLoadProgress: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
 void GUI::registerChatWindow(ChatChannel channel, Element* elem)
 {
 	ChatWindow wnd;
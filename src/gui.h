@@ -35,6 +35,7 @@ public:
 	void initialize();
 
 	void displayChat(int channel, Rocket::Core::String str);
+	void displayLoadProgress(float progress, const char* stage);
 
 	void registerChatWindow(ChatChannel channel, Rocket::Core::Element* window);
 
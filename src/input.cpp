@@ -3,6 +3,7 @@
 #include "player.h"
 
 extern Player gPlayer;
+extern Renderer gRenderer;
 
 using namespace irr;
 
@@ -84,6 +85,14 @@ bool Input::zoneKeyboardEvent(const SEvent::SKeyInput& ev)
 		else if (mTurnDirection == TURN_RIGHT)
 			mTurnDirection = TURN_NONE;
 		break;
+	case KEY_F11:
+		if (!ev.PressedDown)
+			gRenderer.toggleProfilerOverlay();
+		break;
+	case KEY_F12:
+		if (!ev.PressedDown)
+			Profiler::exportTrace("zeq_trace.json");
+		break;
 	case KEY_ESCAPE:
 		throw ExitException();
 	default:
@@ -173,6 +182,10 @@ bool Input::zoneViewerKeyboardEvent(const SEvent::SKeyInput& ev)
 			zv->applyCollision = !zv->applyCollision;
 		}
 		break;
+	case KEY_KEY_R:
+		if (!ev.PressedDown)
+			gPlayer.toggleMovementRecording();
+		break;
 	case KEY_KEY_L:
 		if (!ev.PressedDown)
 		{
@@ -180,6 +193,14 @@ bool Input::zoneViewerKeyboardEvent(const SEvent::SKeyInput& ev)
 			printf("Loc: %g, %g, %g\n", pos.X, pos.Y, pos.Z);
 		}
 		break;
+	case KEY_F11:
+		if (!ev.PressedDown)
+			gRenderer.toggleProfilerOverlay();
+		break;
+	case KEY_F12:
+		if (!ev.PressedDown)
+			Profiler::exportTrace("zeq_trace.json");
+		break;
 	case KEY_ESCAPE:
 		throw ExitException();
 	default:
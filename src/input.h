@@ -94,6 +94,9 @@ public:
 
 	bool isMoving() { return mMoveDirection || mTurnDirection || mRelativeMouseX != 0.0f || mRelativeMouseY != 0.0f; }
 	void resetMoved() { mRelativeMouseX = 0; mRelativeMouseY = 0; }
+	//for driving the player without a keyboard
+	void setMoveDirection(int8 dir) { mMoveDirection = dir; }
+	void setTurnDirection(int8 dir) { mTurnDirection = dir; }
 
 	void setGUIContext(Rocket::Core::Context* cxt) { mGUIContext = cxt; }
 
@@ -20,6 +20,9 @@
 #include "eqstr.h"
 #include "rocket.h"
 #include "gui.h"
+#include "worker_pool.h"
+#include "zone_loader.h"
+#include "zone_prefetcher.h"
 
 #include "s3d.h"
 #include "wld.h"
@@ -31,6 +34,8 @@ FileLoader gFileLoader;
 Player gPlayer;
 MobManager gMobMgr;
 GUI gGUI;
+WorkerPool gWorkerPool;
+ZonePrefetcher gZonePrefetcher;
 EqState g_EqState;
 
 void showError(const char* fmt, ...)
@@ -42,7 +47,9 @@ void showError(const char* fmt, ...)
 
 	printf("%s\n", buf);
 #ifdef _WIN32
-	MessageBox(NULL, buf, NULL, MB_OK | MB_ICONERROR | MB_TASKMODAL);
+	//nobody is there to close it
+	if (!gRenderer.isHeadless())
+		MessageBox(NULL, buf, NULL, MB_OK | MB_ICONERROR | MB_TASKMODAL);
 #endif
 }
 
@@ -54,6 +61,9 @@ struct Args
 	std::string charName;
 	std::string pathToEQ;
 	std::string zoneShortname;
+	std::string benchmarkModel;
+	std::string benchmarkZone;
+	bool headless;
 };
 
 void readArgs(int c, char** args, Args& out);
@@ -78,22 +88,52 @@ int main(int argc, char** argv)
 		Args args;
 		readArgs(argc, argv, args);
 
+		gRenderer.setHeadless(args.headless);
 		gRenderer.initializeGUI();
 		gRenderer.initialize();
+		gFileLoader.initialize();
 		gFileLoader.setPathToEQ(args.pathToEQ);
+		gWorkerPool.initialize();
+		gMobMgr.initialize();
+		gZonePrefetcher.initialize();
 
-		if (!args.zoneShortname.empty())
+		if (!args.benchmarkModel.empty())
+		{
+			gMobMgr.benchmarkSkinning(args.benchmarkModel, 1000);
+			MobGrid::benchmark(2000);
+		}
+		else if (!args.benchmarkZone.empty())
+		{
+			ZoneLoader loader(args.benchmarkZone, false, nullptr);
+			loader.start();
+			while (!loader.update())
+				gRenderer.loopStep();
+
+			gRenderer.useZoneModel(loader.takeZoneModel());
+			gRenderer.benchmarkCollision(20000);
+			gPlayer.benchmarkMovement(args.benchmarkZone);
+			gRenderer.getFloorMap()->benchmark(100000);
+			gRenderer.getRegionMap()->benchmark(1000000, gRenderer.getCollisionWorld()->getBoundingBox());
+			gRenderer.benchmarkObjectBatching(300);
+			gRenderer.benchmarkRegionVisibility(200);
+		}
+		else if (!args.zoneShortname.empty())
 		{
 			std::string shortname = args.zoneShortname;
 
 			gRenderer.loadGUI(Renderer::GUI_VIEWER);
 			gPlayer.setZoneViewer(new ZoneViewerData);
+			gPlayer.getZoneViewer()->shortname = shortname;
 
-			ZoneModel* zoneModel = ZoneModel::load(shortname);
-			if (zoneModel == nullptr)
-				throw ZEQException("bad zone shortname '%s'", shortname.c_str());
+			ZoneLoader loader(shortname, false, [](float progress, const char* stage)
+			{
+				gGUI.displayLoadProgress(progress, stage);
+			});
+			loader.start();
+			while (!loader.update())
+				gRenderer.loopStep();
 
-			gRenderer.useZoneModel(zoneModel);
+			gRenderer.useZoneModel(loader.takeZoneModel());
 
 			gInput.setMode(Input::ZONE_VIEWER);
 			gPlayer.setCamera(gRenderer.createCamera());
@@ -191,10 +231,13 @@ int main(int argc, char** argv)
 		printf("Exiting\n");
 	}
 
-	gRenderer.close();
+	//connections first: an unfinished zone load needs the renderer to wind down
 	if (login) delete login;
 	if (world) delete world;
 	if (zone) delete zone;
+	gZonePrefetcher.close();
+	gWorkerPool.close();
+	gRenderer.close();
 
 	Lua::close();
 	Socket::closeLibrary();
@@ -210,6 +253,7 @@ void readArgs(int c, char** args, Args& out)
 	out.acctName = Lua::getConfigString(CONFIG_VAR_ACCOUNT, "");
 	out.charName = Lua::getConfigString(CONFIG_VAR_CHARACTER, "");
 	out.serverName = Lua::getConfigString(CONFIG_VAR_SERVER, "");
+	out.headless = Lua::getConfigBool(CONFIG_VAR_HEADLESS, false);
 
 	//read command line arguments
 	int i = 1;
@@ -217,6 +261,13 @@ void readArgs(int c, char** args, Args& out)
 	{
 		if (args[i][0] != '-')
 			break;
+		//the one flag without a value
+		if (args[i][1] == 'h' && args[i][2] == 0)
+		{
+			out.headless = true;
+			++i;
+			continue;
+		}
 		if (i + 1 == c)
 			break;
 		switch (args[i][1])
@@ -239,13 +290,19 @@ void readArgs(int c, char** args, Args& out)
 		case 'z':
 			out.zoneShortname = args[i + 1];
 			break;
+		case 'b':
+			out.benchmarkModel = args[i + 1];
+			break;
+		case 'r':
+			out.benchmarkZone = args[i + 1];
+			break;
 		default:
 			goto FINISH;
 		}
 		i += 2;
 	}
 FINISH:
-	if (out.pathToEQ.size() && out.zoneShortname.size())
+	if (out.pathToEQ.size() && (out.zoneShortname.size() || out.benchmarkModel.size() || out.benchmarkZone.size()))
 		return;
 	if (!out.pathToEQ.size() || !out.acctName.size() || !out.password.size() || !out.charName.size() || !out.serverName.size())
 	{
@@ -263,7 +320,14 @@ void printUsage()
 		"\t-p <password>\n"
 		"\t-c <character name>\n"
 		"\t-s <server longname>\n"
+		"\t-h to run without a window or drawing, e.g. for load testing\n"
 		"To launch the zone viewer:\n"
 		"\t-e <path\\to\\eq>\n"
-		"\t-z <zone shortname>\n");
+		"\t-z <zone shortname>\n"
+		"To benchmark skinning a model from global_chr:\n"
+		"\t-e <path\\to\\eq>\n"
+		"\t-b <3 letter model id, e.g. HUM>\n"
+		"To benchmark collision queries in a zone (replays <zone>_path.txt if recorded with R in the viewer):\n"
+		"\t-e <path\\to\\eq>\n"
+		"\t-r <zone shortname>\n");
 }
@@ -0,0 +1,306 @@
+
+#include "mesh_optimizer.h"
+
+const uint32 VertexRemap::NONE;
+
+VertexRemap::VertexRemap(uint32 source_count) :
+	mBufferIDs(source_count, NONE),
+	mIndices(source_count, NONE)
+{
+
+}
+
+bool VertexRemap::find(uint32 buffer_id, uint32 source_index, uint32& out_index)
+{
+	if (mBufferIDs[source_index] == buffer_id)
+	{
+		out_index = mIndices[source_index];
+		return true;
+	}
+
+	if (mBufferIDs[source_index] == NONE || mOverflow.empty())
+		return false;
+
+	uint64 key = ((uint64)buffer_id << 32) | source_index;
+	auto it = mOverflow.find(key);
+	if (it == mOverflow.end())
+		return false;
+
+	out_index = it->second;
+	return true;
+}
+
+void VertexRemap::insert(uint32 buffer_id, uint32 source_index, uint32 index)
+{
+	if (mBufferIDs[source_index] == NONE)
+	{
+		mBufferIDs[source_index] = buffer_id;
+		mIndices[source_index] = index;
+		return;
+	}
+
+	//vertex is shared between buffers (e.g. a material boundary), fall back to the hash
+	uint64 key = ((uint64)buffer_id << 32) | source_index;
+	mOverflow[key] = index;
+}
+
+void MeshStats::add(const MeshStats& o)
+{
+	triangles += o.triangles;
+	vertices += o.vertices;
+	transformsBefore += o.transformsBefore;
+	transformsAfter += o.transformsAfter;
+}
+
+void MeshStats::print(const char* label) const
+{
+	if (triangles == 0)
+		return;
+
+	static const double MB = 1.0 / (1024.0 * 1024.0);
+	const double vertSize = (double)sizeof(video::S3DVertex);
+	const double tris = (double)triangles;
+
+	printf("%s: %llu triangles, vertices %llu -> %llu (%.2f MB -> %.2f MB), "
+		"transforms per triangle 3.00 -> %.2f indexed -> %.2f reordered\n",
+		label, (unsigned long long)triangles, (unsigned long long)(triangles * 3), (unsigned long long)vertices,
+		tris * 3.0 * vertSize * MB, (double)vertices * vertSize * MB,
+		(double)transformsBefore / tris, (double)transformsAfter / tris);
+}
+
+namespace MeshOptimizer
+{
+	static const float CACHE_DECAY_POWER = 1.5f;
+	static const float LAST_TRI_SCORE = 0.75f;
+	static const float VALENCE_BOOST_SCALE = 2.0f;
+	static const float VALENCE_BOOST_POWER = 0.5f;
+
+	static float vertexScore(int cache_pos, uint32 remaining)
+	{
+		//vertices with no triangles left to add should never be picked
+		if (remaining == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cache_pos >= 0)
+		{
+			if (cache_pos < 3)
+			{
+				//used by the last triangle, fixed score so that the next triangle doesn't just reuse the same edge
+				score = LAST_TRI_SCORE;
+			}
+			else
+			{
+				const float scaler = 1.0f / (float)(CACHE_SIZE - 3);
+				score = 1.0f - (float)(cache_pos - 3) * scaler;
+				score = powf(score, CACHE_DECAY_POWER);
+			}
+		}
+
+		//bonus for vertices with few triangles left, to get rid of lone triangles quickly
+		score += VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	void optimizeVertexCache(std::vector<uint32>& index_buf, uint32 vert_count)
+	{
+		const uint32 tri_count = index_buf.size() / 3;
+		if (tri_count < 2 || vert_count == 0)
+			return;
+
+		//triangle adjacency per vertex, flattened
+		std::vector<uint32> offsets(vert_count + 1, 0);
+		std::vector<uint32> remaining(vert_count, 0);
+
+		for (uint32 idx : index_buf)
+			++remaining[idx];
+
+		for (uint32 v = 0; v < vert_count; ++v)
+			offsets[v + 1] = offsets[v] + remaining[v];
+
+		std::vector<uint32> adjacency(offsets[vert_count]);
+		{
+			std::vector<uint32> fill(offsets.begin(), offsets.end() - 1);
+			for (uint32 t = 0; t < tri_count; ++t)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					uint32 v = index_buf[t * 3 + i];
+					adjacency[fill[v]++] = t;
+				}
+			}
+		}
+
+		std::vector<int> cachePos(vert_count, -1);
+		std::vector<float> vertScore(vert_count);
+		for (uint32 v = 0; v < vert_count; ++v)
+			vertScore[v] = vertexScore(-1, remaining[v]);
+
+		std::vector<float> triScore(tri_count);
+		std::vector<byte> triAdded(tri_count, 0);
+		for (uint32 t = 0; t < tri_count; ++t)
+		{
+			const uint32* tri = &index_buf[t * 3];
+			triScore[t] = vertScore[tri[0]] + vertScore[tri[1]] + vertScore[tri[2]];
+		}
+
+		std::vector<uint32> out;
+		out.reserve(index_buf.size());
+
+		//cache holds CACHE_SIZE entries, plus room for the 3 vertices of the triangle being added
+		uint32 cache[CACHE_SIZE + 3];
+		uint32 newCache[CACHE_SIZE + 3];
+		uint32 cacheCount = 0;
+
+		//the first triangle is the best scoring one overall; after that we only look at triangles touching the cache
+		int best = 0;
+		for (uint32 t = 1; t < tri_count; ++t)
+		{
+			if (triScore[t] > triScore[best])
+				best = t;
+		}
+
+		uint32 cursor = 0; //fallback when the cache runs dry (disconnected pieces): next unadded triangle in input order
+		uint32 added = 0;
+
+		while (added < tri_count)
+		{
+			if (best < 0)
+			{
+				while (triAdded[cursor])
+					++cursor;
+				best = cursor;
+			}
+
+			const uint32* tri = &index_buf[best * 3];
+			out.push_back(tri[0]);
+			out.push_back(tri[1]);
+			out.push_back(tri[2]);
+			triAdded[best] = 1;
+			++added;
+
+			//remove the triangle from its vertices' adjacency lists
+			for (int i = 0; i < 3; ++i)
+			{
+				uint32 v = tri[i];
+				uint32* adj = &adjacency[offsets[v]];
+				uint32 n = remaining[v];
+				for (uint32 j = 0; j < n; ++j)
+				{
+					if (adj[j] == (uint32)best)
+					{
+						adj[j] = adj[n - 1];
+						break;
+					}
+				}
+				--remaining[v];
+			}
+
+			//the triangle's vertices go to the front of the cache, everything else shifts back
+			uint32 newCount = 0;
+			for (int i = 0; i < 3; ++i)
+				newCache[newCount++] = tri[i];
+			for (uint32 i = 0; i < cacheCount; ++i)
+			{
+				uint32 v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					newCache[newCount++] = v;
+			}
+
+			//vertices that fell out of the cache lose their cache bonus
+			for (uint32 i = CACHE_SIZE; i < newCount; ++i)
+			{
+				uint32 v = newCache[i];
+				cachePos[v] = -1;
+				float score = vertexScore(-1, remaining[v]);
+				float diff = score - vertScore[v];
+				vertScore[v] = score;
+
+				const uint32* adj = &adjacency[offsets[v]];
+				for (uint32 j = 0; j < remaining[v]; ++j)
+					triScore[adj[j]] += diff;
+			}
+			if (newCount > CACHE_SIZE)
+				newCount = CACHE_SIZE;
+
+			for (uint32 i = 0; i < newCount; ++i)
+			{
+				cache[i] = newCache[i];
+				cachePos[cache[i]] = i;
+			}
+			cacheCount = newCount;
+
+			//rescore everything in the cache...
+			for (uint32 i = 0; i < cacheCount; ++i)
+			{
+				uint32 v = cache[i];
+				float score = vertexScore(cachePos[v], remaining[v]);
+				float diff = score - vertScore[v];
+				vertScore[v] = score;
+
+				const uint32* adj = &adjacency[offsets[v]];
+				for (uint32 j = 0; j < remaining[v]; ++j)
+					triScore[adj[j]] += diff;
+			}
+
+			//...then pick the best triangle among their neighbours
+			best = -1;
+			float bestScore = -1.0f;
+			for (uint32 i = 0; i < cacheCount; ++i)
+			{
+				uint32 v = cache[i];
+				const uint32* adj = &adjacency[offsets[v]];
+				for (uint32 j = 0; j < remaining[v]; ++j)
+				{
+					uint32 t = adj[j];
+					if (triScore[t] > bestScore)
+					{
+						bestScore = triScore[t];
+						best = t;
+					}
+				}
+			}
+		}
+
+		index_buf.swap(out);
+	}
+
+	void optimizeVertexFetch(std::vector<video::S3DVertex>& vert_buf, std::vector<uint32>& index_buf)
+	{
+		static const uint32 NONE = 0xFFFFFFFF;
+		std::vector<uint32> remap(vert_buf.size(), NONE);
+		std::vector<video::S3DVertex> out;
+		out.reserve(vert_buf.size());
+
+		for (uint32& idx : index_buf)
+		{
+			if (remap[idx] == NONE)
+			{
+				remap[idx] = out.size();
+				out.push_back(vert_buf[idx]);
+			}
+			idx = remap[idx];
+		}
+
+		vert_buf.swap(out);
+	}
+
+	uint32 simulateTransforms(const std::vector<uint32>& index_buf, uint32 vert_count, uint32 cache_size)
+	{
+		//fifo cache simulated with timestamps: a vertex is cached if it was transformed less than cache_size misses ago
+		std::vector<uint32> transformedAt(vert_count, 0);
+		uint32 misses = 0;
+
+		for (uint32 idx : index_buf)
+		{
+			uint32 at = transformedAt[idx];
+			if (at == 0 || (misses + 1) - at > cache_size)
+			{
+				++misses;
+				transformedAt[idx] = misses;
+			}
+		}
+
+		return misses;
+	}
+}
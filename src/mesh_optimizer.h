@@ -0,0 +1,62 @@
+
+#ifndef _ZEQ_MESH_OPTIMIZER_H
+#define _ZEQ_MESH_OPTIMIZER_H
+
+#include <irrlicht.h>
+
+#include <vector>
+#include <unordered_map>
+
+#include "types.h"
+
+using namespace irr;
+
+//maps (destination buffer, source vertex index) pairs to indices within the destination buffer,
+//so that triangles sharing a source vertex also share the converted vertex
+class VertexRemap
+{
+private:
+	static const uint32 NONE = 0xFFFFFFFF;
+
+	//almost every source vertex only ever lands in a single buffer, so one slot per vertex covers the common case
+	std::vector<uint32> mBufferIDs;
+	std::vector<uint32> mIndices;
+	std::unordered_map<uint64, uint32> mOverflow;
+
+public:
+	VertexRemap(uint32 source_count);
+
+	bool find(uint32 buffer_id, uint32 source_index, uint32& out_index);
+	void insert(uint32 buffer_id, uint32 source_index, uint32 index);
+};
+
+struct MeshStats
+{
+	MeshStats() : triangles(0), vertices(0), transformsBefore(0), transformsAfter(0) { }
+
+	//without indexing, every triangle costs 3 vertices and 3 transforms
+	uint64 triangles;
+	uint64 vertices;
+	uint64 transformsBefore; //simulated vertex shader invocations, before and after cache reordering
+	uint64 transformsAfter;
+
+	void add(const MeshStats& other);
+	void print(const char* label) const;
+};
+
+namespace MeshOptimizer
+{
+	//post-transform cache size the optimizer targets
+	static const uint32 CACHE_SIZE = 32;
+	//fifo size used when simulating the cache for statistics
+	static const uint32 SIMULATED_CACHE_SIZE = 16;
+
+	//reorders triangles for post-transform vertex cache efficiency (Forsyth's linear-speed algorithm)
+	void optimizeVertexCache(std::vector<uint32>& index_buf, uint32 vert_count);
+	//reorders vertices by first use so that vertex fetches walk memory linearly; rewrites the indices to match
+	void optimizeVertexFetch(std::vector<video::S3DVertex>& vert_buf, std::vector<uint32>& index_buf);
+	//number of vertex transforms a fifo cache of the given size would perform for these indices
+	uint32 simulateTransforms(const std::vector<uint32>& index_buf, uint32 vert_count, uint32 cache_size = SIMULATED_CACHE_SIZE);
+}
+
+#endif
@@ -5,7 +5,7 @@
 #ifdef _WIN32
 #include <windows.h>
 #else
-#include <sys/time.h>
+#include <time.h>
 #endif
 
 #include "types.h"
@@ -48,14 +48,15 @@ public:
 	}
 #else
 private:
-	uint32 start_time;
+	uint64 start_time;
 
 private:
-	uint32 getTime()
+	uint64 getTime()
 	{
-		timeval t;
-		gettimeofday(&t, 0);
-		return t.tv_sec * 1000000 + t.tv_usec;
+		//not gettimeofday: the wall clock can be set back or forward under us, and frame pacing goes by this
+		timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return (uint64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
 	}
 
 public:
@@ -65,7 +66,7 @@ public:
 	}
 	uint32 getElapsed()
 	{
-		return getTime() - start_time;
+		return (uint32)(getTime() - start_time);
 	}
 #endif
 };
@@ -11,7 +11,10 @@ Mob::Mob(uint32 index, WLDSkeleton* skele, MobPosition* pos, WLDSkeleton* head)
 	mHeadNode(nullptr),
 	mRightHandNode(nullptr),
 	mLeftHandNode(nullptr),
-	mShieldNode(nullptr)
+	mShieldNode(nullptr),
+	mNameNode(nullptr),
+	mPlaceholder(0),
+	mAnimationTime(0.0f)
 {
 	initSkeleton(skele, pos, head);
 	setName("test");
@@ -22,7 +25,10 @@ Mob::Mob(Spawn_Struct* spawn, WLDSkeleton* skele, MobPosition* pos, WLDSkeleton*
 	mHeadNode(nullptr),
 	mRightHandNode(nullptr),
 	mLeftHandNode(nullptr),
-	mShieldNode(nullptr)
+	mShieldNode(nullptr),
+	mNameNode(nullptr),
+	mPlaceholder(0),
+	mAnimationTime(0.0f)
 {
 	readSpawnStruct(spawn);
 	initSkeleton(skele, pos, head);
@@ -38,7 +44,10 @@ Mob::Mob(Spawn_Struct* spawn) :
 	mHeadNode(nullptr),
 	mRightHandNode(nullptr),
 	mLeftHandNode(nullptr),
-	mShieldNode(nullptr)
+	mShieldNode(nullptr),
+	mNameNode(nullptr),
+	mPlaceholder(0),
+	mAnimationTime(0.0f)
 {
 	readSpawnStruct(spawn);
 }
@@ -52,14 +61,12 @@ void Mob::readSpawnStruct(Spawn_Struct* spawn)
 
 void Mob::initSkeleton(WLDSkeleton* skele, MobPosition* pos, WLDSkeleton* head)
 {
-	mSkeletonWLD = new WLDSkeletonInstance(gRenderer.copyMesh(skele->getReferenceMesh()), skele, this);
-	mSkeletonWLD->assumeBasePosition();
-
-	scene::IAnimatedMesh* mesh = new scene::SAnimatedMesh(mSkeletonWLD->getMesh());
+	//starts out showing the skeleton's shared base position mesh
+	mSkeletonWLD = new WLDSkeletonInstance(skele, this);
 	scene::ISceneManager* sceneMgr = gRenderer.getSceneManager();
 
-	mNode = sceneMgr->addAnimatedMeshSceneNode(mesh, nullptr, -1, *pos);
-	mesh->drop();
+	mNode = sceneMgr->addAnimatedMeshSceneNode(mSkeletonWLD->getMesh(), nullptr, -1, *pos);
+	mSkeletonWLD->setSceneNode(mNode);
 
 	mInvertHeadingRace = Translate::invertHeadingRace(skele->getModelRace());
 
@@ -70,24 +77,46 @@ void Mob::initSkeleton(WLDSkeleton* skele, MobPosition* pos, WLDSkeleton* head)
 
 	if (head)
 	{
-		mHeadSkeleWLD = new WLDSkeletonInstance(gRenderer.copyMesh(head->getReferenceMesh()), head, this);
-		mHeadSkeleWLD->assumeBasePosition();
-
-		mesh = new scene::SAnimatedMesh(mHeadSkeleWLD->getMesh());
-
-		sceneMgr->addAnimatedMeshSceneNode(mesh, mNode);
-		mesh->drop();
+		mHeadSkeleWLD = new WLDSkeletonInstance(head, this);
+		mHeadSkeleWLD->setSceneNode(sceneMgr->addAnimatedMeshSceneNode(mHeadSkeleWLD->getMesh(), mNode));
 	}
 	else
 	{
 		mHeadSkeleWLD = nullptr;
 	}
 
+	//stand idle until told otherwise
+	static const int idle = Translate::animationID("P01");
+	if (skele->hasAnimation(idle))
+		startAnimation(idle);
+
 	//should be placed above the HEAD_POINT node rather than the base node
 	//default font is pretty terrible
+	//hidden until the MobManager sees that we are close enough for it to matter
 	core::stringw wide_name(mDisplayName);
-	gRenderer.getSceneManager()->addBillboardTextSceneNode(nullptr, wide_name.c_str(), mNode,
+	mNameNode = gRenderer.getSceneManager()->addBillboardTextSceneNode(nullptr, wide_name.c_str(), mNode,
 		core::dimension2df(5.0f, 2.0f), core::vector3df(0, 5.0f, 0));
+	mNameNode->setVisible(false);
+}
+
+void Mob::clearSkeleton()
+{
+	if (mSkeletonWLD)
+		delete mSkeletonWLD;
+	if (mHeadSkeleWLD)
+		delete mHeadSkeleWLD;
+	//takes the head, name and attachment nodes with it
+	if (mNode)
+		mNode->remove();
+
+	mSkeletonWLD = nullptr;
+	mHeadSkeleWLD = nullptr;
+	mNode = nullptr;
+	mHeadNode = nullptr;
+	mRightHandNode = nullptr;
+	mLeftHandNode = nullptr;
+	mShieldNode = nullptr;
+	mNameNode = nullptr;
 }
 
 Mob::~Mob()
@@ -130,60 +159,65 @@ void Mob::setHeading(float heading)
 		mNode->setRotation(core::vector3df(0.0f, heading, 0.0f));
 }
 
-void Mob::animate(float delta)
+void Mob::updateAnimation(float delta, SkinningWork& work)
 {
 	if (mSkeletonWLD)
 	{
-		mSkeletonWLD->animate(delta);
+		mSkeletonWLD->update(delta, work);
 		if (mHeadSkeleWLD)
-			mHeadSkeleWLD->animate(delta);
+			mHeadSkeleWLD->update(delta, work);
 
 		//check point node position and rotation changes
 		//head doesn't rotate
 	}
 }
 
-void Mob::startAnimation(std::string id)
+void Mob::startAnimation(int anim_id)
 {
 	if (mSkeletonWLD)
 	{
-		mSkeletonWLD->setAnimation(id);
+		mSkeletonWLD->setAnimation(anim_id);
 		if (mHeadSkeleWLD)
-			mHeadSkeleWLD->setAnimation(id);
+			mHeadSkeleWLD->setAnimation(anim_id);
 	}
 }
 
 void Mob::updatePosition(MobPositionUpdate_Struct* update)
 {
-	//ignoring deltas / interpolation for now...
-	MobPosition* cur = gMobMgr.getMobPosition(mIndex);
-
-	core::vector3df pos(
+	//the deltas go to MobMotion as sent, it measures what they mean in units per second
+	MobPosition pos(
 		Util::EQ19toFloat(update->y_pos),
 		Util::EQ19toFloat(update->z_pos),
 		Util::EQ19toFloat(update->x_pos)
 	);
 
+	core::vector3df vel(
+		Util::EQ13PreciseToFloat(update->delta_y),
+		Util::EQ13PreciseToFloat(update->delta_z),
+		Util::EQ13PreciseToFloat(update->delta_x)
+	);
+
+	float heading;
+	float headingRate = 0.0f;
+
 	if (update->delta_x || update->delta_y || update->delta_z)
 	{
 		//we're walking/running
-		//the server doesn't tell us the heading the mob should have while moving - need to calculate based on difference
-		float heading = Util::getHeadingTo(*cur, pos);
-
-		/*printf("moving diff: %g, %g, %g - delta: %g, %g, %g\n", cur->X - pos.X, cur->Y - pos.Y, cur->Z - pos.Z,
-			Util::EQ13PreciseToFloat(update->delta_x), Util::EQ13PreciseToFloat(update->delta_y),
-			Util::EQ13PreciseToFloat(update->delta_z));*/
-
-		*cur = pos;
-		if (mNode)
-			mNode->setPosition(pos);
-		setHeading(heading);
+		//the server doesn't tell us the heading the mob should have while moving - face the way it's going
+		heading = Util::getHeadingTo(core::vector3df(0.0f, 0.0f, 0.0f), vel);
 	}
 	else
 	{
-		//we're teleporting
-		if(mNode)
-			mNode->setPosition(pos);
-		setHeading(Util::unpackHeading(update->heading));
+		//standing, turning or teleporting
+		heading = Util::unpackHeading(update->heading);
+		headingRate = Util::unpackDeltaHeading(update->delta_heading);
 	}
+
+	gMobMgr.correctMotion(mIndex, pos, vel, heading, headingRate);
+}
+
+void Mob::setDisplayPosition(const MobPosition& pos)
+{
+	if (mNode)
+		mNode->setPosition(pos);
 }
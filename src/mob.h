@@ -22,6 +22,7 @@ private:
 	scene::ISceneNode* mRightHandNode;
 	scene::ISceneNode* mLeftHandNode;
 	scene::ISceneNode* mShieldNode;
+	scene::ISceneNode* mNameNode;
 
 	int mEntityID;
 	char mDisplayName[64];
@@ -32,12 +33,15 @@ private:
 
 	//boolean block
 	unsigned mInvertHeadingRace:1;
+	unsigned mPlaceholder:1; //showing a stand-in model until our own has been converted
 	//end boolean block
 
 	uint32 mExactCurHP;
 	uint32 mExactMaxHP;
 	uint8 mPercentHP;
 
+	float mAnimationTime; //accumulated while animation LOD skips us
+
 private:
 	void readSpawnStruct(Spawn_Struct* spawn);
 
@@ -48,15 +52,23 @@ public:
 	~Mob();
 
 	void initSkeleton(WLDSkeleton* skele, MobPosition* pos, WLDSkeleton* head = nullptr);
+	void clearSkeleton();
 
 	void setHeading(float heading);
 
 	int getRace() { return mRace; }
 	int getGender() { return mGender; }
 
-	void animate(float delta);
-	void startAnimation(std::string id);
+	//main thread; any skinning this needs is added to work, to be done before the next draw
+	void updateAnimation(float delta, SkinningWork& work);
+	void addAnimationTime(float delta) { mAnimationTime += delta; }
+	float takeAnimationTime() { float t = mAnimationTime; mAnimationTime = 0.0f; return t; }
+	scene::ISceneNode* getSceneNode() { return mNode; }
+	void setNameplateVisible(bool visible) { if (mNameNode) mNameNode->setVisible(visible); }
+	void startAnimation(int anim_id); //see Translate::animationID
 	bool hasSkeleton() { return mSkeletonWLD != nullptr; }
+	bool isPlaceholder() { return mPlaceholder != 0; }
+	void setPlaceholder(bool placeholder) { mPlaceholder = placeholder ? 1 : 0; }
 
 	void setIndex(uint32 i) { mIndex = i; }
 	void setName(const char* name);
@@ -64,6 +76,8 @@ public:
 	void setExactHPMax(uint32 hp) { mExactMaxHP = hp; }
 	void setPercentHP(uint8 percent) { mPercentHP = percent; }
 	void updatePosition(MobPositionUpdate_Struct* update);
+	//where the scene node is drawn, which trails the simulated position while a correction is blended out
+	void setDisplayPosition(const MobPosition& pos);
 };
 
 #endif
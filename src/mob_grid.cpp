@@ -0,0 +1,273 @@
+
+#include "mob_grid.h"
+#include "micro_timer.h"
+#include "random.h"
+
+#include <algorithm>
+
+MobGrid::MobGrid(const std::vector<MobPosition>* positions, float cell_size) :
+	mCellSize(cell_size),
+	mInvCellSize(1.0f / cell_size),
+	mPositions(positions)
+{
+
+}
+
+void MobGrid::addToCell(uint64 key, uint32 index)
+{
+	mCells[key].push_back(index);
+}
+
+void MobGrid::removeFromCell(uint64 key, uint32 index)
+{
+	auto it = mCells.find(key);
+	if (it == mCells.end())
+		return;
+
+	std::vector<uint32>& cell = it->second;
+	for (uint32 i = 0; i < cell.size(); ++i)
+	{
+		if (cell[i] == index)
+		{
+			cell[i] = cell.back();
+			cell.pop_back();
+			break;
+		}
+	}
+
+	if (cell.empty())
+		mCells.erase(it);
+}
+
+void MobGrid::insert(uint32 index)
+{
+	if (index >= mCellOf.size())
+		mCellOf.resize(index + 1, NO_CELL);
+
+	uint64 key = cellKey((*mPositions)[index]);
+	mCellOf[index] = key;
+	addToCell(key, index);
+}
+
+void MobGrid::move(uint32 index)
+{
+	uint64 key = cellKey((*mPositions)[index]);
+	if (key == mCellOf[index])
+		return;
+
+	removeFromCell(mCellOf[index], index);
+	addToCell(key, index);
+	mCellOf[index] = key;
+}
+
+void MobGrid::remove(uint32 index)
+{
+	removeFromCell(mCellOf[index], index);
+	mCellOf[index] = NO_CELL;
+}
+
+void MobGrid::relocate(uint32 from, uint32 to)
+{
+	uint64 key = mCellOf[from];
+	auto it = mCells.find(key);
+	if (it != mCells.end())
+	{
+		for (uint32& idx : it->second)
+		{
+			if (idx == from)
+			{
+				idx = to;
+				break;
+			}
+		}
+	}
+
+	if (to >= mCellOf.size())
+		mCellOf.resize(to + 1, NO_CELL);
+	mCellOf[to] = key;
+	mCellOf[from] = NO_CELL;
+}
+
+void MobGrid::clear()
+{
+	mCells.clear();
+	mCellOf.clear();
+}
+
+template<typename F>
+void MobGrid::forEachInArea(float minX, float minZ, float maxX, float maxZ, F func) const
+{
+	const int32 x0 = cellCoord(minX);
+	const int32 x1 = cellCoord(maxX);
+	const int32 z0 = cellCoord(minZ);
+	const int32 z1 = cellCoord(maxZ);
+	const uint64 area = (uint64)(x1 - x0 + 1) * (uint64)(z1 - z0 + 1);
+
+	if (area > mCells.size())
+	{
+		//big area (e.g. a whole frustum) over a sparse grid, cheaper to check the occupied cells
+		for (auto& pair : mCells)
+		{
+			int32 x = (int32)(uint32)(pair.first >> 32);
+			int32 z = (int32)(uint32)(pair.first & 0xFFFFFFFF);
+			if (x < x0 || x > x1 || z < z0 || z > z1)
+				continue;
+
+			for (uint32 index : pair.second)
+				func(index);
+		}
+		return;
+	}
+
+	for (int32 x = x0; x <= x1; ++x)
+	{
+		for (int32 z = z0; z <= z1; ++z)
+		{
+			auto it = mCells.find(cellKey(x, z));
+			if (it == mCells.end())
+				continue;
+
+			for (uint32 index : it->second)
+				func(index);
+		}
+	}
+}
+
+void MobGrid::queryRadius(const MobPosition& center, float radius, std::vector<uint32>& out) const
+{
+	const std::vector<MobPosition>& positions = *mPositions;
+	const float radiusSq = radius * radius;
+
+	forEachInArea(center.X - radius, center.Z - radius, center.X + radius, center.Z + radius, [&](uint32 index)
+	{
+		if (positions[index].getDistanceFromSQ(center) <= radiusSq)
+			out.push_back(index);
+	});
+}
+
+void MobGrid::queryFrustum(const scene::SViewFrustum& frustum, float pad, std::vector<uint32>& out) const
+{
+	const std::vector<MobPosition>& positions = *mPositions;
+	const core::aabbox3df& box = frustum.getBoundingBox();
+
+	forEachInArea(box.MinEdge.X - pad, box.MinEdge.Z - pad, box.MaxEdge.X + pad, box.MaxEdge.Z + pad, [&](uint32 index)
+	{
+		//the planes face outwards
+		const MobPosition& pos = positions[index];
+		for (int p = 0; p < scene::SViewFrustum::VF_PLANE_COUNT; ++p)
+		{
+			if (frustum.planes[p].getDistanceTo(pos) > pad)
+				return;
+		}
+		out.push_back(index);
+	});
+}
+
+void MobGrid::queryNearest(const MobPosition& center, uint32 k, float max_radius, std::vector<uint32>& out) const
+{
+	out.clear();
+	if (k == 0)
+		return;
+
+	//widen the search until it holds at least k; the k closest of everything within r are the k closest overall
+	float radius = mCellSize;
+	for (;;)
+	{
+		if (radius > max_radius)
+			radius = max_radius;
+
+		out.clear();
+		queryRadius(center, radius, out);
+		if (out.size() >= k || radius >= max_radius)
+			break;
+		radius *= 2.0f;
+	}
+
+	const std::vector<MobPosition>& positions = *mPositions;
+	auto closer = [&](uint32 a, uint32 b)
+	{
+		return positions[a].getDistanceFromSQ(center) < positions[b].getDistanceFromSQ(center);
+	};
+
+	if (out.size() > k)
+	{
+		std::partial_sort(out.begin(), out.begin() + k, out.end(), closer);
+		out.resize(k);
+	}
+	else
+	{
+		std::sort(out.begin(), out.end(), closer);
+	}
+}
+
+void MobGrid::benchmark(uint32 count)
+{
+	static const float ZONE_SIZE = 4000.0f;
+	static const float RADIUS = 200.0f;
+	static const uint32 QUERIES = 1000;
+	static const uint32 NEAREST = 8;
+
+	Random rng;
+	std::uniform_real_distribution<float> coord(-ZONE_SIZE * 0.5f, ZONE_SIZE * 0.5f);
+	std::uniform_real_distribution<float> step(-5.0f, 5.0f);
+
+	std::vector<MobPosition> positions;
+	for (uint32 i = 0; i < count; ++i)
+		positions.push_back(MobPosition(coord(rng), 0.0f, coord(rng)));
+
+	std::vector<MobPosition> centers;
+	for (uint32 i = 0; i < QUERIES; ++i)
+		centers.push_back(MobPosition(coord(rng), 0.0f, coord(rng)));
+
+	MobGrid grid(&positions);
+	MicroTimer insertTimer;
+	for (uint32 i = 0; i < count; ++i)
+		grid.insert(i);
+	uint32 insertTime = insertTimer.getElapsed();
+
+	//everything takes a small step, the way position updates trickle in
+	MicroTimer moveTimer;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		positions[i].X += step(rng);
+		positions[i].Z += step(rng);
+		grid.move(i);
+	}
+	uint32 moveTime = moveTimer.getElapsed();
+
+	std::vector<uint32> out;
+	uint64 found = 0;
+	MicroTimer gridTimer;
+	for (const MobPosition& c : centers)
+	{
+		out.clear();
+		grid.queryRadius(c, RADIUS, out);
+		found += out.size();
+	}
+	uint32 gridTime = gridTimer.getElapsed();
+
+	uint64 scanFound = 0;
+	MicroTimer scanTimer;
+	for (const MobPosition& c : centers)
+	{
+		out.clear();
+		for (uint32 i = 0; i < count; ++i)
+		{
+			if (positions[i].getDistanceFromSQ(c) <= RADIUS * RADIUS)
+				out.push_back(i);
+		}
+		scanFound += out.size();
+	}
+	uint32 scanTime = scanTimer.getElapsed();
+
+	MicroTimer nearestTimer;
+	for (const MobPosition& c : centers)
+		grid.queryNearest(c, NEAREST, ZONE_SIZE * 2.0f, out);
+	uint32 nearestTime = nearestTimer.getElapsed();
+
+	printf("mob grid, %u mobs over %gx%g units:\n", count, ZONE_SIZE, ZONE_SIZE);
+	printf("  insert all %u us, move all %u us\n", insertTime, moveTime);
+	printf("  radius %g: grid %.2f us/query, linear scan %.2f us/query (%llu vs %llu found)\n", RADIUS,
+		(double)gridTime / QUERIES, (double)scanTime / QUERIES, (unsigned long long)found, (unsigned long long)scanFound);
+	printf("  nearest %u: grid %.2f us/query\n", NEAREST, (double)nearestTime / QUERIES);
+}
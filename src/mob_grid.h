@@ -0,0 +1,61 @@
+
+#ifndef _ZEQ_MOB_GRID_H
+#define _ZEQ_MOB_GRID_H
+
+#include <irrlicht.h>
+
+#include <vector>
+#include <unordered_map>
+
+#include "types.h"
+#include "structs_mob.h"
+
+using namespace irr;
+
+//uniform grid over the ground plane (X, Z), hashed so that only occupied cells take any memory
+//entries are mob indices into the caller's position list, which the grid reads but never owns
+class MobGrid
+{
+private:
+	static const uint64 NO_CELL = 0xFFFFFFFFFFFFFFFFULL;
+
+	float mCellSize;
+	float mInvCellSize;
+	std::unordered_map<uint64, std::vector<uint32>> mCells;
+	std::vector<uint64> mCellOf; //by mob index
+	const std::vector<MobPosition>* mPositions;
+
+private:
+	int32 cellCoord(float v) const { return (int32)floorf(v * mInvCellSize); }
+	static uint64 cellKey(int32 x, int32 z) { return ((uint64)(uint32)x << 32) | (uint32)z; }
+	uint64 cellKey(const MobPosition& pos) const { return cellKey(cellCoord(pos.X), cellCoord(pos.Z)); }
+	void addToCell(uint64 key, uint32 index);
+	void removeFromCell(uint64 key, uint32 index);
+	//calls func(index) for every entry in cells overlapping the square [min, max] on X and Z
+	template<typename F>
+	void forEachInArea(float minX, float minZ, float maxX, float maxZ, F func) const;
+
+public:
+	MobGrid(const std::vector<MobPosition>* positions, float cell_size = 128.0f);
+
+	//the position must already be in the list
+	void insert(uint32 index);
+	//call after the position at index has changed; cheap unless it crossed into another cell
+	void move(uint32 index);
+	void remove(uint32 index);
+	//for swap'n'pop removal: the entry at from is now at to
+	void relocate(uint32 from, uint32 to);
+	void clear();
+
+	//appends the indices of everything within radius (in 3D)
+	void queryRadius(const MobPosition& center, float radius, std::vector<uint32>& out) const;
+	//appends the indices of everything within pad units of being inside the frustum
+	void queryFrustum(const scene::SViewFrustum& frustum, float pad, std::vector<uint32>& out) const;
+	//replaces out with up to k indices, closest first; nothing further than max_radius is considered
+	void queryNearest(const MobPosition& center, uint32 k, float max_radius, std::vector<uint32>& out) const;
+
+	//times grid updates and queries against linear scans over count random positions
+	static void benchmark(uint32 count);
+};
+
+#endif
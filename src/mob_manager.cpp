@@ -2,38 +2,74 @@
 #include "mob_manager.h"
 #include "renderer.h"
 #include "player.h"
+#include "file_loader.h"
+#include "worker_pool.h"
+#include "micro_timer.h"
+#include "zeq_lua.h"
+
+#include <algorithm>
 
 extern Renderer gRenderer;
 extern Player gPlayer;
+extern FileLoader gFileLoader;
+extern WorkerPool gWorkerPool;
+
+const uint32 MobManager::NO_SLOT;
+
+MobManager::MobManager() :
+	mSlotByEntity(MAX_ENTITY_ID + 1, NO_SLOT),
+	mEntityGeneration(MAX_ENTITY_ID + 1, 0),
+	mGrid(&mMobPositionList),
+	mModelsConverted(false),
+	mAnimationHelpers(0xFFFFFFFF),
+	mAnimationFullRateDist(150.0f * 150.0f),
+	mAnimationHalfRateDist(400.0f * 400.0f),
+	mAnimationRange(1000.0f * 1000.0f),
+	mAnimationFrame(0)
+{
+
+}
+
+void MobManager::initialize()
+{
+	int threads = Lua::getConfigInt(CONFIG_VAR_ANIMATION_THREADS, -1);
+	mAnimationHelpers = (threads < 0) ? 0xFFFFFFFF : (uint32)threads;
+
+	float dist = (float)Lua::getConfigInt(CONFIG_VAR_ANIMATION_FULL_RATE_DIST, 150);
+	mAnimationFullRateDist = dist * dist;
+	dist = (float)Lua::getConfigInt(CONFIG_VAR_ANIMATION_HALF_RATE_DIST, 400);
+	mAnimationHalfRateDist = dist * dist;
+	dist = (float)Lua::getConfigInt(CONFIG_VAR_ANIMATION_RANGE, 1000);
+	mAnimationRange = dist * dist;
+}
 
 bool MobManager::modelPrototypeLoaded(int race_id, int gender)
 {
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
 	return !(mPrototypesWLD.count(race_id) == 0 || mPrototypesWLD[race_id].set[gender].skeleton == nullptr);
 }
 
-void MobManager::addModelPrototype(int race_id, int gender, WLDSkeleton* skele, bool head)
+void MobManager::addModelPrototype(int race_id, int gender, WLDSkeleton* skele, const std::vector<WLDSkeleton*>& heads)
 {
-	MobPrototypeSetWLD& proto = mPrototypesWLD[race_id];
-
 	skele->setModelRaceGender(race_id, gender);
+	for (WLDSkeleton* head : heads)
+		head->setModelRaceGender(race_id, gender);
 
-	if (!head)
-	{
-		if (proto.set[gender].skeleton) //don't overwrite
-			return;
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
+	MobPrototypeWLD& proto = mPrototypesWLD[race_id].set[gender];
 
-		proto.set[gender].skeleton = skele;
-		printf("added race %i gender %i\n", race_id, gender);
-	}
-	else
-	{
-		proto.set[gender].heads.push_back(skele);
-		printf("added head for race %i gender %i\n", race_id, gender);
-	}
+	//don't overwrite; once the skeleton is set the main thread reads the heads without locking
+	if (proto.skeleton)
+		return;
+
+	proto.heads = heads;
+	proto.skeleton = skele;
+	printf("added race %i gender %i with %u heads\n", race_id, gender, (uint32)heads.size());
 }
 
 MobPrototypeWLD* MobManager::getModelPrototype(int race_id, int gender)
 {
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
 	if (mPrototypesWLD.count(race_id) == 0 || mPrototypesWLD[race_id].set[gender].skeleton == nullptr)
 	{
 		return &mPrototypesWLD[DEFAULT_RACE].set[DEFAULT_GENDER];
@@ -42,12 +78,179 @@ MobPrototypeWLD* MobManager::getModelPrototype(int race_id, int gender)
 	return &mPrototypesWLD[race_id].set[gender];
 }
 
+void MobManager::benchmarkSkinning(const std::string& model_id, uint32 iterations)
+{
+	const int race = Translate::raceID(model_id);
+	const int gender = Translate::gender(model_id);
+
+	WLD* wld = gFileLoader.getWLD("global_chr");
+	if (wld == nullptr)
+		throw ZEQException("benchmark: could not open global_chr");
+	wld->convertMobModel(model_id.c_str());
+	gFileLoader.releaseWLD("global_chr");
+
+	if (!modelPrototypeLoaded(race, gender))
+		throw ZEQException("benchmark: no model '%s' in global_chr", model_id.c_str());
+
+	WLDSkeleton* skele = getModelPrototype(race, gender)->skeleton;
+	scene::SMesh* mesh = gRenderer.copyMesh(skele->getReferenceMesh());
+	printf("%s: ", model_id.c_str());
+	skele->benchmarkSkinning(mesh, iterations);
+	mesh->drop();
+
+	//a city's worth of the same model, looping whichever animation it has first
+	static const uint32 CROWD = 128;
+	static const uint32 FRAMES = 100;
+
+	int animID = 0;
+	for (int i = 1; i < 256 && animID == 0; ++i)
+	{
+		if (skele->hasAnimation(i))
+			animID = i;
+	}
+
+	//every mob skinning a copy of its own first, as if nothing were shared; this is the work that scales with threads
+	std::vector<scene::SMesh*> meshes(CROWD);
+	std::vector<uint32> curFrames(CROWD, 0);
+	std::vector<float> curTimes(CROWD, 0.0f);
+	std::vector<float> percents(CROWD, 0.0f);
+	for (uint32 i = 0; i < CROWD; ++i)
+		meshes[i] = gRenderer.copyMesh(skele->getReferenceMesh());
+
+	auto runCopies = [&](uint32 helpers) -> double
+	{
+		MicroTimer timer;
+		for (uint32 f = 0; f < FRAMES; ++f)
+		{
+			for (uint32 i = 0; i < CROWD; ++i)
+			{
+				bool ended;
+				curTimes[i] += (f == 0) ? 0.05f * i : 0.016f; //spread out over the animation to begin with
+				curFrames[i] = skele->advance(animID, curFrames[i], curTimes[i], ended, percents[i]);
+				if (ended)
+				{
+					curFrames[i] = 0;
+					curTimes[i] = 0.0f;
+				}
+			}
+
+			gWorkerPool.parallelFor(CROWD, ANIMATION_GRAIN, [&](uint32 begin, uint32 end)
+			{
+				for (uint32 i = begin; i < end; ++i)
+					skele->pose(animID, meshes[i], nullptr, curFrames[i], percents[i]);
+			}, helpers);
+		}
+		return (double)timer.getElapsed() / 1000.0 / (double)FRAMES;
+	};
+
+	double single = 0.0;
+	for (uint32 helpers = 0; helpers <= gWorkerPool.getNumThreads(); ++helpers)
+	{
+		double ms = runCopies(helpers);
+		if (helpers == 0)
+			single = ms;
+		printf("%u mobs, main thread + %u workers: %.2f ms/frame (%.1fx)\n", CROWD, helpers, ms, (ms > 0.0) ? single / ms : 0.0);
+	}
+
+	for (scene::SMesh* m : meshes)
+		m->drop();
+
+	//then sharing poses, the way spawned mobs do
+	std::vector<WLDSkeletonInstance*> crowd;
+	for (uint32 i = 0; i < CROWD; ++i)
+	{
+		WLDSkeletonInstance* inst = new WLDSkeletonInstance(skele, nullptr);
+		inst->setAnimation(animID);
+		crowd.push_back(inst);
+	}
+
+	SkinningWork work;
+	MicroTimer timer;
+	for (uint32 f = 0; f < FRAMES; ++f)
+	{
+		work.clear();
+		++work.frame;
+		for (uint32 i = 0; i < CROWD; ++i)
+			crowd[i]->update((f == 0) ? 0.05f * i : 0.016f, work);
+
+		gWorkerPool.parallelFor(work.size(), ANIMATION_GRAIN, [&work](uint32 begin, uint32 end)
+		{
+			work.run(begin, end);
+		});
+	}
+	double ms = (double)timer.getElapsed() / 1000.0 / (double)FRAMES;
+	printf("%u mobs sharing poses: %.2f ms/frame, %u poses cached\n", CROWD, ms, skele->getPoseCount());
+
+	for (WLDSkeletonInstance* inst : crowd)
+		delete inst;
+	skele->evictPoses(work.frame + 1, 0);
+}
+
+void MobManager::addModelSource(int race_id, int gender, const std::string& wld_name, const char* model_id)
+{
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
+
+	//first come first served, same as when everything was converted upfront (global_chr is indexed first)
+	int key = race_id * 3 + gender;
+	if (mModelSourcesWLD.count(key))
+		return;
+
+	MobModelSourceWLD& src = mModelSourcesWLD[key];
+	src.wldName = wld_name;
+	src.modelID = model_id;
+	src.requested = false;
+}
+
+MobPrototypeWLD* MobManager::requestModelPrototype(int race_id, int gender)
+{
+	MobModelSourceWLD src;
+
+	{
+		std::lock_guard<std::mutex> lock(mPrototypeMutex);
+		if (mPrototypesWLD.count(race_id) && mPrototypesWLD[race_id].set[gender].skeleton)
+			return &mPrototypesWLD[race_id].set[gender];
+
+		auto it = mModelSourcesWLD.find(race_id * 3 + gender);
+		if (it == mModelSourcesWLD.end() || it->second.requested)
+			return nullptr;
+
+		//only ever tried once; a model that fails to convert won't do any better the second time
+		it->second.requested = true;
+		src = it->second;
+	}
+
+	gWorkerPool.addJob([this, src]()
+	{
+		//the cache may have dropped the wld since it was indexed, getting it again reopens it if so
+		WLD* wld = gFileLoader.getWLD(src.wldName);
+		if (wld)
+		{
+			wld->convertMobModel(src.modelID.c_str());
+			gFileLoader.releaseWLD(src.wldName);
+		}
+
+		std::lock_guard<std::mutex> lock(mPrototypeMutex);
+		mModelsConverted = true;
+	});
+
+	return nullptr;
+}
+
+MobPrototypeWLD* MobManager::getPlaceholderPrototype()
+{
+	//stands in for mobs whose own model is still being converted, if it's ready itself
+	return requestModelPrototype(DEFAULT_RACE, DEFAULT_GENDER);
+}
+
 Mob* MobManager::spawnMob(int race_id, int gender, int level, float x, float y, float z)
 {
 	MobPrototypeWLD* proto = getModelPrototype(race_id, gender);
 
 	mMobPositionList.push_back(MobPosition(x, y, z));
 
+	mGrid.insert(mMobPositionList.size() - 1);
+	mMotion.add(mMobPositionList.back(), 0.0f);
+
 	MobEntry ent;
 	ent.entity_id = 0;
 	ent.ptr = new Mob(mMobList.size(), proto->skeleton, &mMobPositionList.back(),
@@ -60,16 +263,31 @@ Mob* MobManager::spawnMob(int race_id, int gender, int level, float x, float y,
 
 Mob* MobManager::spawnMob(Spawn_Struct* spawn)
 {
-	MobPrototypeWLD* proto = nullptr;
-	
-	if (modelPrototypeLoaded(spawn->race, spawn->gender))
-		proto = getModelPrototype(spawn->race, spawn->gender);
+	if (spawn->spawnId == 0 || spawn->spawnId > MAX_ENTITY_ID)
+	{
+		printf("ignoring spawn with out of range id %u - %s\n", spawn->spawnId, spawn->name);
+		return nullptr;
+	}
+
+	//the server may send a spawn again (e.g. on zone in), replace the old one
+	if (mSlotByEntity[spawn->spawnId] != NO_SLOT)
+		despawnMob(spawn->spawnId);
+
+	bool placeholder = false;
+	MobPrototypeWLD* proto = requestModelPrototype(spawn->race, spawn->gender);
+	if (proto == nullptr)
+	{
+		proto = getPlaceholderPrototype();
+		placeholder = true;
+	}
 
 	mMobPositionList.push_back(MobPosition(
 		Util::EQ19toFloat(spawn->y),
 		Util::EQ19toFloat(spawn->z),
 		Util::EQ19toFloat(spawn->x)
 	)); //yzx - don't ask
+	mGrid.insert(mMobPositionList.size() - 1);
+	mMotion.add(mMobPositionList.back(), Util::unpackHeading(spawn->heading));
 
 	MobEntry ent;
 	ent.entity_id = spawn->spawnId;
@@ -77,12 +295,15 @@ Mob* MobManager::spawnMob(Spawn_Struct* spawn)
 	{
 		ent.ptr = new Mob(spawn, proto->skeleton, &mMobPositionList.back(),
 			proto->heads.size() ? proto->heads[0] : nullptr);
+		ent.ptr->setPlaceholder(placeholder);
 	}
 	else
 	{
 		ent.ptr = new Mob(spawn);
 	}
 
+	ent.ptr->setIndex(mMobList.size());
+	mSlotByEntity[ent.entity_id] = mMobList.size();
 	mMobList.push_back(ent);
 	printf("spawning race %i gender %i at %g, %g, %g - %s\n", spawn->race, spawn->gender, Util::EQ19toFloat(spawn->y),
 		Util::EQ19toFloat(spawn->z), Util::EQ19toFloat(spawn->x), spawn->name);
@@ -92,38 +313,257 @@ Mob* MobManager::spawnMob(Spawn_Struct* spawn)
 
 void MobManager::despawnMob(int entity_id)
 {
-	for (uint32 i = 0; i < mMobList.size(); ++i)
+	if (entity_id <= 0 || entity_id > (int)MAX_ENTITY_ID)
+		return;
+
+	uint32 i = mSlotByEntity[entity_id];
+	if (i == NO_SLOT)
+		return;
+
+	mSlotByEntity[entity_id] = NO_SLOT;
+	++mEntityGeneration[entity_id];
+
+	Mob* mob = mMobList[i].ptr;
+	auto shown = std::find(mNameplatesShown.begin(), mNameplatesShown.end(), mob);
+	if (shown != mNameplatesShown.end())
+		mNameplatesShown.erase(shown);
+	delete mob;
+
+	mGrid.remove(i);
+	//we don't need to worry about re-entrance, the client makes no assumptions about connections between mobs
+	if (i < (mMobList.size() - 1))
+	{
+		//swap'n'pop
+		uint32 last = mMobList.size() - 1;
+		mMobList[i] = mMobList.back();
+		//position list too
+		mMobPositionList[i] = mMobPositionList.back();
+		mGrid.relocate(last, i);
+		//inform mob and lookup table of new indices
+		mMobList[i].ptr->setIndex(i);
+		if (mMobList[i].entity_id != 0)
+			mSlotByEntity[mMobList[i].entity_id] = i;
+	}
+	mMobList.pop_back();
+	mMobPositionList.pop_back();
+	mMotion.remove(i);
+}
+
+MobHandle MobManager::getHandle(int entity_id)
+{
+	MobHandle handle;
+	if (entity_id > 0 && entity_id <= (int)MAX_ENTITY_ID && mSlotByEntity[entity_id] != NO_SLOT)
+	{
+		handle.entity_id = (uint16)entity_id;
+		handle.generation = mEntityGeneration[entity_id];
+	}
+	return handle;
+}
+
+Mob* MobManager::getMob(const MobHandle& handle)
+{
+	if (handle.entity_id == 0 || mEntityGeneration[handle.entity_id] != handle.generation)
+		return nullptr;
+
+	uint32 i = mSlotByEntity[handle.entity_id];
+	return (i == NO_SLOT) ? nullptr : mMobList[i].ptr;
+}
+
+bool MobManager::isOutsideFrustum(const scene::SViewFrustum& frustum, core::aabbox3df box)
+{
+	//the box is from the base position, animations can reach a little outside it
+	core::vector3df pad = box.getExtent() * 0.25f;
+	box.MinEdge -= pad;
+	box.MaxEdge += pad;
+
+	core::vector3df edges[8];
+	box.getEdges(edges);
+
+	//outside if every corner is on the outer side of any one plane
+	for (int p = 0; p < scene::SViewFrustum::VF_PLANE_COUNT; ++p)
 	{
-		if (mMobList[i].entity_id == entity_id)
+		bool outside = true;
+		for (int e = 0; e < 8; ++e)
 		{
-			delete mMobList[i].ptr;
-			//we don't need to worry about re-entrance, the client makes no assumptions about connections between mobs
-			if (i < (mMobList.size() - 1))
+			if (frustum.planes[p].classifyPointRelation(edges[e]) != core::ISREL3D_FRONT)
 			{
-				//swap'n'pop
-				mMobList[i] = mMobList.back();
-				//position list too
-				mMobPositionList[i] = mMobPositionList.back();
-				//inform mob of new indices
-				mMobList[i].ptr->setIndex(i);
+				outside = false;
+				break;
 			}
-			mMobList.pop_back();
-			mMobPositionList.pop_back();
-			return;
 		}
+
+		if (outside)
+			return true;
+	}
+
+	return false;
+}
+
+void MobManager::correctMotion(uint32 index, const MobPosition& pos, const core::vector3df& vel, float heading, float heading_rate)
+{
+	mMotion.correct(index, pos, vel, heading, heading_rate);
+}
+
+void MobManager::updateMotion(float delta)
+{
+	mMotion.step(delta);
+
+	for (uint32 i = 0; i < mMobList.size(); ++i)
+	{
+		if (!mMotion.isActive(i))
+			continue;
+
+		//queries and culling go by where the server has the mob, the node shows the blended position
+		mMobPositionList[i] = mMotion.getPosition(i);
+		mGrid.move(i);
+
+		Mob* mob = mMobList[i].ptr;
+		mob->setDisplayPosition(mMotion.getDisplayPosition(i));
+		mob->setHeading(mMotion.getHeading(i));
 	}
 }
 
 void MobManager::animateNearbyMobs(float delta)
 {
 	const MobPosition& pos = gPlayer.getCoords();
+	Camera* camera = gPlayer.getCamera();
+	const scene::SViewFrustum* frustum = camera ? camera->getSceneNode()->getViewFrustum() : nullptr;
+
+	attachWaitingModels();
+
+	updateNameplates(pos);
+
+	++mAnimationFrame;
+	mSkinning.clear();
+	mSkinning.frame = mAnimationFrame;
+
+	mQueryScratch.clear();
+	mGrid.queryRadius(pos, sqrtf(mAnimationRange), mQueryScratch);
+	for (uint32 i : mQueryScratch)
+	{
+		float distSq = Util::getDistSquared(pos, mMobPositionList[i]);
+
+		Mob* mob = mMobList[i].ptr;
+		++mAnimationStats.inRange;
+		//time keeps building up while a mob is skipped, so it picks up where it should be when it is next skinned
+		mob->addAnimationTime(delta);
+
+		scene::ISceneNode* node = mob->getSceneNode();
+		if (frustum && node && isOutsideFrustum(*frustum, node->getTransformedBoundingBox()))
+		{
+			++mAnimationStats.culled;
+			continue;
+		}
+
+		//every frame up close, then every 2nd and 4th; staggered by index so the work is spread evenly
+		uint32 rate = (distSq <= mAnimationFullRateDist) ? 1 : (distSq <= mAnimationHalfRateDist) ? 2 : 4;
+		if ((mAnimationFrame + i) % rate != 0)
+		{
+			++mAnimationStats.skipped;
+			continue;
+		}
+
+		mob->updateAnimation(mob->takeAnimationTime(), mSkinning);
+		++mAnimationStats.animated;
+	}
+
+	mAnimationStats.skinned += mSkinning.size();
+	mAnimationStats.vertices += mSkinning.vertices;
+	++mAnimationStats.frames;
+	mAnimationStats.time += delta;
+	if (mAnimationStats.time >= (float)ANIMATION_STATS_INTERVAL)
+	{
+		const float frames = (float)mAnimationStats.frames;
+		printf("animation per frame: %.1f mobs in range, %.1f out of view, %.1f skipped, %.1f animated, "
+			"%.1f poses skinned, %.0f vertices; %u poses cached\n",
+			mAnimationStats.inRange / frames, mAnimationStats.culled / frames, mAnimationStats.skipped / frames,
+			mAnimationStats.animated / frames, mAnimationStats.skinned / frames, (float)mAnimationStats.vertices / frames,
+			getCachedPoseCount());
+		mAnimationStats.reset();
+	}
+
+	//each pose (or mob with its own mesh) only writes to its own mesh, so they can be skinned in any order on any thread;
+	//parallelFor doesn't return until they're all done, so nothing is mid-skin when the scene is next drawn
+	gWorkerPool.parallelFor(mSkinning.size(), ANIMATION_GRAIN, [this](uint32 begin, uint32 end)
+	{
+		mSkinning.run(begin, end);
+	}, mAnimationHelpers);
+
+	if (mAnimationFrame % POSE_EVICT_INTERVAL == 0)
+		evictUnusedPoses();
+}
+
+void MobManager::updateNameplates(const MobPosition& pos)
+{
+	//only nameplates close by are drawn; hide the ones that were shown but have gone out of range
+	mQueryScratch.clear();
+	mGrid.queryRadius(pos, (float)NAMEPLATE_RANGE, mQueryScratch);
 
-	const float dist = 1000.0f * 1000.0f;
+	for (Mob* mob : mNameplatesShown)
+		mob->setNameplateVisible(false);
+	mNameplatesShown.clear();
 
-	for (uint32 i = 0; i < mMobPositionList.size(); ++i)
+	for (uint32 i : mQueryScratch)
 	{
-		if (Util::getDistSquared(pos, mMobPositionList[i]) <= dist)
-			mMobList[i].ptr->animate(delta);
+		Mob* mob = mMobList[i].ptr;
+		mob->setNameplateVisible(true);
+		mNameplatesShown.push_back(mob);
+	}
+}
+
+void MobManager::getMobsInRadius(const MobPosition& center, float radius, std::vector<Mob*>& out)
+{
+	mQueryScratch.clear();
+	mGrid.queryRadius(center, radius, mQueryScratch);
+	for (uint32 i : mQueryScratch)
+		out.push_back(mMobList[i].ptr);
+}
+
+void MobManager::getMobsInView(const scene::SViewFrustum& frustum, std::vector<Mob*>& out)
+{
+	mQueryScratch.clear();
+	//positions are at the feet, pad by about a mob's height
+	mGrid.queryFrustum(frustum, 10.0f, mQueryScratch);
+	for (uint32 i : mQueryScratch)
+		out.push_back(mMobList[i].ptr);
+}
+
+void MobManager::getNearestMobs(const MobPosition& center, uint32 k, float max_radius, std::vector<Mob*>& out)
+{
+	mGrid.queryNearest(center, k, max_radius, mQueryScratch);
+	for (uint32 i : mQueryScratch)
+		out.push_back(mMobList[i].ptr);
+}
+
+uint32 MobManager::getCachedPoseCount()
+{
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
+	uint32 count = 0;
+	for (auto& pair : mPrototypesWLD)
+	{
+		for (MobPrototypeWLD& proto : pair.second.set)
+		{
+			if (proto.skeleton)
+				count += proto.skeleton->getPoseCount();
+			for (WLDSkeleton* head : proto.heads)
+				count += head->getPoseCount();
+		}
+	}
+	return count;
+}
+
+void MobManager::evictUnusedPoses()
+{
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
+	for (auto& pair : mPrototypesWLD)
+	{
+		for (MobPrototypeWLD& proto : pair.second.set)
+		{
+			if (proto.skeleton)
+				proto.skeleton->evictPoses(mAnimationFrame, POSE_LINGER_FRAMES);
+			for (WLDSkeleton* head : proto.heads)
+				head->evictPoses(mAnimationFrame, POSE_LINGER_FRAMES);
+		}
 	}
 }
 
@@ -136,13 +576,11 @@ Mob* MobManager::getMobByEntityID(int entity, bool& isPlayer)
 	}
 	isPlayer = false;
 
-	for (MobEntry& mob : mMobList)
-	{
-		if (mob.entity_id == entity)
-			return mob.ptr;
-	}
+	if (entity <= 0 || entity > (int)MAX_ENTITY_ID)
+		return nullptr;
 
-	return nullptr;
+	uint32 i = mSlotByEntity[entity];
+	return (i == NO_SLOT) ? nullptr : mMobList[i].ptr;
 }
 
 void MobManager::handleHPUpdate(HPUpdate_Struct* update)
@@ -185,13 +623,48 @@ void MobManager::handlePositionUpdate(MobPositionUpdate_Struct* update)
 
 void MobManager::correctPrematureSpawns()
 {
+	//the zone's models have just been indexed, anything spawned before that can ask for them now
+	getPlaceholderPrototype();
+	for (MobEntry& ent : mMobList)
+	{
+		if (!ent.ptr->hasSkeleton() || ent.ptr->isPlaceholder())
+			requestModelPrototype(ent.ptr->getRace(), ent.ptr->getGender());
+	}
+
+	std::lock_guard<std::mutex> lock(mPrototypeMutex);
+	mModelsConverted = true;
+}
+
+void MobManager::attachWaitingModels()
+{
+	{
+		std::lock_guard<std::mutex> lock(mPrototypeMutex);
+		if (!mModelsConverted)
+			return;
+		mModelsConverted = false;
+	}
+
+	MobPrototypeWLD* placeholder = getPlaceholderPrototype();
+
 	for (uint32 i = 0; i < mMobList.size(); ++i)
 	{
 		Mob* mob = mMobList[i].ptr;
-		if (mob->hasSkeleton())
+		if (mob->hasSkeleton() && !mob->isPlaceholder())
 			continue;
 
-		MobPrototypeWLD* proto = getModelPrototype(mob->getRace(), mob->getGender());
+		bool isPlaceholder = false;
+		MobPrototypeWLD* proto = requestModelPrototype(mob->getRace(), mob->getGender());
+		if (proto == nullptr)
+		{
+			//still waiting, but the placeholder may have become available in the meantime
+			if (mob->hasSkeleton() || placeholder == nullptr)
+				continue;
+			proto = placeholder;
+			isPlaceholder = true;
+		}
+
+		mob->clearSkeleton();
 		mob->initSkeleton(proto->skeleton, &mMobPositionList[i], proto->heads.size() ? proto->heads[0] : nullptr);
+		mob->setPlaceholder(isPlaceholder);
 	}
 }
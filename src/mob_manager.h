@@ -5,11 +5,14 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
 
 #include "types.h"
 #include "util.h"
 #include "mob.h"
 #include "wld_skeleton.h"
+#include "mob_grid.h"
+#include "mob_motion.h"
 #include "structs_titanium.h"
 
 struct MobEntry
@@ -18,12 +21,45 @@ struct MobEntry
 	Mob* ptr;
 };
 
+//refers to a spawned mob without owning it; goes stale once the mob despawns, even if its entity id is reused
+struct MobHandle
+{
+	MobHandle() : entity_id(0), generation(0) { }
+
+	uint16 entity_id; //0 = none
+	uint16 generation;
+};
+
 struct MobPrototypeWLD
 {
 	WLDSkeleton* skeleton;
 	std::vector<WLDSkeleton*> heads;
 };
 
+//where an unconverted model can be found; converted the first time something spawns with it
+struct MobModelSourceWLD
+{
+	std::string wldName; //as cached by the FileLoader
+	std::string modelID; //3 letter race + gender code
+	bool requested;
+};
+
+//skinning work done by animateNearbyMobs, summed between reports
+struct AnimationStats
+{
+	AnimationStats() { reset(); }
+	void reset() { frames = 0; inRange = 0; culled = 0; skipped = 0; animated = 0; skinned = 0; vertices = 0; time = 0.0f; }
+
+	uint32 frames;
+	uint32 inRange;
+	uint32 culled; //outside the camera's view
+	uint32 skipped; //reduced rate, not their turn this frame
+	uint32 animated;
+	uint32 skinned; //poses, plus mobs with their own meshes
+	uint64 vertices;
+	float time;
+};
+
 struct MobPrototypeSetWLD
 {
 	MobPrototypeSetWLD()
@@ -40,27 +76,81 @@ class MobManager
 private:
 	static const int DEFAULT_RACE = 1;
 	static const int DEFAULT_GENDER = 0;
+	static const uint32 ANIMATION_GRAIN = 4; //poses per worker job when skinning in parallel
+	static const uint32 POSE_EVICT_INTERVAL = 60; //frames
+	static const uint32 POSE_LINGER_FRAMES = 600; //unused poses are kept this long in case someone comes back to them
+	static const uint32 NAMEPLATE_RANGE = 250;
+	static const uint32 MAX_ENTITY_ID = 0xFFFF; //spawn ids are 16 bit in every update packet
+	static const uint32 NO_SLOT = 0xFFFFFFFF;
+	static const uint32 ANIMATION_STATS_INTERVAL = 10; //seconds
 
 	std::vector<MobEntry> mMobList;
 	std::vector<MobPosition> mMobPositionList; //kept separate for faster computation on the whole set
+	std::vector<uint32> mSlotByEntity; //entity id -> index into the lists above, direct table
+	std::vector<uint16> mEntityGeneration; //bumped on despawn, to invalidate MobHandles
+	MobGrid mGrid; //over mMobPositionList
+	MobMotion mMotion; //by the same index
+	std::vector<uint32> mQueryScratch;
+	std::vector<Mob*> mNameplatesShown;
 
 	std::unordered_map<int, MobPrototypeSetWLD> mPrototypesWLD;
+	std::unordered_map<int, MobModelSourceWLD> mModelSourcesWLD; //keyed by race_id * 3 + gender
+	bool mModelsConverted; //set by worker threads, mobs waiting on a model are checked when it is
+	std::mutex mPrototypeMutex; //prototypes are converted on worker threads
+
+	SkinningWork mSkinning; //scratch, for the current frame
+	uint32 mAnimationHelpers; //worker threads that join the main thread in skinning mobs
+	float mAnimationFullRateDist; //squared
+	float mAnimationHalfRateDist; //squared
+	float mAnimationRange; //squared
+	uint32 mAnimationFrame;
+	AnimationStats mAnimationStats;
 
 private:
 	MobPrototypeWLD* getModelPrototype(int race_id, int gender);
+	//returns the prototype if it is ready; otherwise starts converting it in the background and returns nullptr
+	MobPrototypeWLD* requestModelPrototype(int race_id, int gender);
+	MobPrototypeWLD* getPlaceholderPrototype();
+	void attachWaitingModels();
 
 	Mob* getMobByEntityID(int entityid, bool& isPlayer);
+	static bool isOutsideFrustum(const scene::SViewFrustum& frustum, core::aabbox3df box);
+	uint32 getCachedPoseCount();
+	void evictUnusedPoses();
+	void updateNameplates(const MobPosition& pos);
 
 public:
+	MobManager();
+	void initialize();
+
 	bool modelPrototypeLoaded(int race_id, int gender);
-	void addModelPrototype(int race_id, int gender, WLDSkeleton* skele, bool head = false);
+	void addModelSource(int race_id, int gender, const std::string& wld_name, const char* model_id);
+	//the body and all its heads at once, so nothing sees the prototype before its heads are in
+	void addModelPrototype(int race_id, int gender, WLDSkeleton* skele, const std::vector<WLDSkeleton*>& heads);
+	//converts a model from global_chr on the calling thread and times skinning it, see WLDSkeleton::benchmarkSkinning;
+	//then times a crowd of it animating with each number of worker threads
+	void benchmarkSkinning(const std::string& model_id, uint32 iterations);
 	Mob* spawnMob(int race_id, int gender, int level = 1, float x = 0.0f, float y = 0.0f, float z = 0.0f);
 	Mob* spawnMob(Spawn_Struct* spawn);
 	void despawnMob(int entity_id);
+	MobHandle getHandle(int entity_id);
+	Mob* getMob(const MobHandle& handle); //null if the mob has despawned
 	MobPosition* getMobPosition(uint32 index) { return &mMobPositionList[index]; }
+	//call after changing a mob's position through getMobPosition
+	void mobMoved(uint32 index) { mGrid.move(index); }
+	//a position update from the server, see MobMotion
+	void correctMotion(uint32 index, const MobPosition& pos, const core::vector3df& vel, float heading, float heading_rate);
+
+	//spatial queries, for targeting, area effects and the like
+	void getMobsInRadius(const MobPosition& center, float radius, std::vector<Mob*>& out);
+	void getMobsInView(const scene::SViewFrustum& frustum, std::vector<Mob*>& out);
+	void getNearestMobs(const MobPosition& center, uint32 k, float max_radius, std::vector<Mob*>& out);
 
 	void correctPrematureSpawns();
+	uint32 getMobCount() const { return mMobList.size(); }
 
+	//moves every mob along from its last position update; before animateNearbyMobs, which culls by position
+	void updateMotion(float delta);
 	void animateNearbyMobs(float delta);
 
 	void handleHPUpdate(HPUpdate_Struct* update);
@@ -0,0 +1,267 @@
+
+#include "mob_motion.h"
+
+#include <cmath>
+#include <cstdio>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define ZEQ_MOTION_SSE
+#endif
+
+const float MobMotion::BLEND_TIME = 0.2f;
+const float MobMotion::SNAP_DISTANCE = 50.0f;
+const float MobMotion::MAX_EXTRAPOLATION = 2.0f;
+const float MobMotion::REST_EPSILON = 0.01f;
+const float MobMotion::MIN_SAMPLE_TIME = 0.1f;
+
+//the time base of the deltas in MobPositionUpdate_Struct isn't documented anywhere we can trust, so it is measured.
+//between two updates of a mob going steadily in a straight line, the server moved it d = |pos1 - pos0| in t seconds
+//while its first update gave the delta v, so one unit of delta is d / (|v| * t) units per second; the heading rate is
+//the same with the change in heading. these defaults, one unit per second, are only used until MIN_SAMPLES are in
+const float MobMotion::DEFAULT_VELOCITY_SCALE = 1.0f;
+const float MobMotion::DEFAULT_HEADING_RATE_SCALE = 1.0f;
+
+MobMotion::MobMotion() :
+	mVelocityScale(DEFAULT_VELOCITY_SCALE),
+	mVelocityLog(0.0f),
+	mVelocitySamples(0),
+	mHeadingRateScale(DEFAULT_HEADING_RATE_SCALE),
+	mHeadingRateLog(0.0f),
+	mHeadingRateSamples(0)
+{
+
+}
+
+void MobMotion::add(const MobPosition& pos, float heading)
+{
+	mPosX.push_back(pos.X);
+	mPosY.push_back(pos.Y);
+	mPosZ.push_back(pos.Z);
+	mVelX.push_back(0.0f);
+	mVelY.push_back(0.0f);
+	mVelZ.push_back(0.0f);
+	mErrX.push_back(0.0f);
+	mErrY.push_back(0.0f);
+	mErrZ.push_back(0.0f);
+	mHeading.push_back(heading);
+	mHeadingRate.push_back(0.0f);
+	mSinceUpdate.push_back(0.0f);
+	mLastX.push_back(pos.X);
+	mLastY.push_back(pos.Y);
+	mLastZ.push_back(pos.Z);
+	mLastHeading.push_back(heading);
+	mFlags.push_back(0);
+}
+
+template<typename T>
+static void swapPop(std::vector<T>& v, uint32 index)
+{
+	v[index] = v.back();
+	v.pop_back();
+}
+
+void MobMotion::remove(uint32 index)
+{
+	swapPop(mPosX, index);
+	swapPop(mPosY, index);
+	swapPop(mPosZ, index);
+	swapPop(mVelX, index);
+	swapPop(mVelY, index);
+	swapPop(mVelZ, index);
+	swapPop(mErrX, index);
+	swapPop(mErrY, index);
+	swapPop(mErrZ, index);
+	swapPop(mHeading, index);
+	swapPop(mHeadingRate, index);
+	swapPop(mSinceUpdate, index);
+	swapPop(mLastX, index);
+	swapPop(mLastY, index);
+	swapPop(mLastZ, index);
+	swapPop(mLastHeading, index);
+	swapPop(mFlags, index);
+}
+
+void MobMotion::addSample(float sample, float& log_avg, uint32& count, float& scale, const char* what)
+{
+	//anything this far out is a mob that stopped, turned or was moved, not a measurement
+	if (!(sample > 1.0f / 64.0f && sample < 64.0f))
+		return;
+
+	if (count < MAX_SAMPLE_WEIGHT)
+		++count;
+	log_avg += (logf(sample) - log_avg) / (float)count;
+
+	if (count >= MIN_SAMPLES)
+	{
+		scale = expf(log_avg);
+		if (count == MIN_SAMPLES)
+			printf("mob motion: one unit of %s measured at %.3f per second\n", what, scale);
+	}
+}
+
+void MobMotion::measure(uint32 index, const MobPosition& pos, const core::vector3df& vel, float heading, float heading_rate)
+{
+	const float t = mSinceUpdate[index];
+	if (t < MIN_SAMPLE_TIME || t > MAX_EXTRAPOLATION)
+		return;
+
+	//only mobs keeping the same velocity from one update to the next tell us anything
+	core::vector3df prevVel(mVelX[index], mVelY[index], mVelZ[index]);
+	float prevSpeed = prevVel.getLength();
+	if (prevSpeed > 0.0f)
+	{
+		if ((vel - prevVel).getLength() > prevSpeed * 0.1f)
+			return;
+
+		core::vector3df moved(pos.X - mLastX[index], pos.Y - mLastY[index], pos.Z - mLastZ[index]);
+		if (moved.getLength() < SNAP_DISTANCE)
+			addSample(moved.getLength() / (prevSpeed * t), mVelocityLog, mVelocitySamples, mVelocityScale, "position delta");
+		return;
+	}
+
+	float prevRate = mHeadingRate[index];
+	if (prevRate == 0.0f || vel.X != 0.0f || vel.Y != 0.0f || vel.Z != 0.0f || fabsf(heading_rate - prevRate) > fabsf(prevRate) * 0.1f)
+		return;
+
+	//the shorter way round; a mob turning more than half a circle between updates can't be told apart from that
+	float turned = heading - mLastHeading[index];
+	if (turned > 180.0f)
+		turned -= 360.0f;
+	else if (turned < -180.0f)
+		turned += 360.0f;
+	addSample(turned / (prevRate * t), mHeadingRateLog, mHeadingRateSamples, mHeadingRateScale, "heading delta");
+}
+
+void MobMotion::correct(uint32 index, const MobPosition& pos, const core::vector3df& vel, float heading, float heading_rate)
+{
+	measure(index, pos, vel, heading, heading_rate);
+	mLastX[index] = pos.X;
+	mLastY[index] = pos.Y;
+	mLastZ[index] = pos.Z;
+	mLastHeading[index] = heading;
+
+	//keep showing the mob where it is, and fade the difference out from there
+	float ex = mPosX[index] + mErrX[index] - pos.X;
+	float ey = mPosY[index] + mErrY[index] - pos.Y;
+	float ez = mPosZ[index] + mErrZ[index] - pos.Z;
+	if (ex * ex + ey * ey + ez * ez > SNAP_DISTANCE * SNAP_DISTANCE)
+	{
+		ex = 0.0f;
+		ey = 0.0f;
+		ez = 0.0f;
+	}
+
+	mPosX[index] = pos.X;
+	mPosY[index] = pos.Y;
+	mPosZ[index] = pos.Z;
+	mVelX[index] = vel.X;
+	mVelY[index] = vel.Y;
+	mVelZ[index] = vel.Z;
+	mErrX[index] = ex;
+	mErrY[index] = ey;
+	mErrZ[index] = ez;
+	mHeading[index] = heading;
+	mHeadingRate[index] = heading_rate;
+	mSinceUpdate[index] = 0.0f;
+	mFlags[index] = MOVING | DIRTY;
+}
+
+void MobMotion::step(float delta)
+{
+	const uint32 n = mPosX.size();
+	const float decay = expf(-delta / BLEND_TIME);
+	//the velocities and heading rates are kept as sent
+	const float moveDelta = delta * mVelocityScale;
+	const float turnDelta = delta * mHeadingRateScale;
+	uint32 i = 0;
+
+#ifdef ZEQ_MOTION_SSE
+	const __m128 dt = _mm_set1_ps(delta);
+	const __m128 moveDt = _mm_set1_ps(moveDelta);
+	const __m128 turnDt = _mm_set1_ps(turnDelta);
+	const __m128 dec = _mm_set1_ps(decay);
+	const __m128 maxTime = _mm_set1_ps(MAX_EXTRAPOLATION);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 since = _mm_add_ps(_mm_loadu_ps(&mSinceUpdate[i]), dt);
+		_mm_storeu_ps(&mSinceUpdate[i], since);
+		//past the extrapolation limit the mob stands still until it hears otherwise
+		__m128 live = _mm_cmple_ps(since, maxTime);
+
+		__m128 vx = _mm_and_ps(_mm_loadu_ps(&mVelX[i]), live);
+		__m128 vy = _mm_and_ps(_mm_loadu_ps(&mVelY[i]), live);
+		__m128 vz = _mm_and_ps(_mm_loadu_ps(&mVelZ[i]), live);
+		_mm_storeu_ps(&mVelX[i], vx);
+		_mm_storeu_ps(&mVelY[i], vy);
+		_mm_storeu_ps(&mVelZ[i], vz);
+
+		_mm_storeu_ps(&mPosX[i], _mm_add_ps(_mm_loadu_ps(&mPosX[i]), _mm_mul_ps(vx, moveDt)));
+		_mm_storeu_ps(&mPosY[i], _mm_add_ps(_mm_loadu_ps(&mPosY[i]), _mm_mul_ps(vy, moveDt)));
+		_mm_storeu_ps(&mPosZ[i], _mm_add_ps(_mm_loadu_ps(&mPosZ[i]), _mm_mul_ps(vz, moveDt)));
+
+		_mm_storeu_ps(&mErrX[i], _mm_mul_ps(_mm_loadu_ps(&mErrX[i]), dec));
+		_mm_storeu_ps(&mErrY[i], _mm_mul_ps(_mm_loadu_ps(&mErrY[i]), dec));
+		_mm_storeu_ps(&mErrZ[i], _mm_mul_ps(_mm_loadu_ps(&mErrZ[i]), dec));
+
+		__m128 rate = _mm_and_ps(_mm_loadu_ps(&mHeadingRate[i]), live);
+		_mm_storeu_ps(&mHeadingRate[i], rate);
+		_mm_storeu_ps(&mHeading[i], _mm_add_ps(_mm_loadu_ps(&mHeading[i]), _mm_mul_ps(rate, turnDt)));
+	}
+#endif
+
+	//leftovers, or everything without SSE
+	for (; i < n; ++i)
+	{
+		mSinceUpdate[i] += delta;
+		if (mSinceUpdate[i] > MAX_EXTRAPOLATION)
+		{
+			mVelX[i] = 0.0f;
+			mVelY[i] = 0.0f;
+			mVelZ[i] = 0.0f;
+			mHeadingRate[i] = 0.0f;
+		}
+
+		mPosX[i] += mVelX[i] * moveDelta;
+		mPosY[i] += mVelY[i] * moveDelta;
+		mPosZ[i] += mVelZ[i] * moveDelta;
+		mErrX[i] *= decay;
+		mErrY[i] *= decay;
+		mErrZ[i] *= decay;
+		mHeading[i] += mHeadingRate[i] * turnDelta;
+	}
+
+	//who needs their scene node moved this frame
+	for (i = 0; i < n; ++i)
+	{
+		bool moving = mVelX[i] != 0.0f || mVelY[i] != 0.0f || mVelZ[i] != 0.0f || mHeadingRate[i] != 0.0f;
+		bool blending = fabsf(mErrX[i]) > REST_EPSILON || fabsf(mErrY[i]) > REST_EPSILON || fabsf(mErrZ[i]) > REST_EPSILON;
+
+		if (moving || blending)
+		{
+			mFlags[i] = MOVING | DIRTY;
+			if (mHeading[i] >= 360.0f)
+				mHeading[i] -= 360.0f;
+			else if (mHeading[i] < 0.0f)
+				mHeading[i] += 360.0f;
+		}
+		else if (mFlags[i] & MOVING)
+		{
+			//came to rest, settle exactly on the server's position one last time
+			mErrX[i] = 0.0f;
+			mErrY[i] = 0.0f;
+			mErrZ[i] = 0.0f;
+			mFlags[i] = DIRTY;
+		}
+		else
+		{
+			mFlags[i] = 0;
+		}
+	}
+}
+
+MobPosition MobMotion::getDisplayPosition(uint32 index)
+{
+	return MobPosition(mPosX[index] + mErrX[index], mPosY[index] + mErrY[index], mPosZ[index] + mErrZ[index]);
+}
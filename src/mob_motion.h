@@ -0,0 +1,80 @@
+
+#ifndef _ZEQ_MOB_MOTION_H
+#define _ZEQ_MOB_MOTION_H
+
+#include <irrlicht.h>
+
+#include <vector>
+
+#include "types.h"
+#include "structs_mob.h"
+
+using namespace irr;
+
+//dead reckoning for mobs between position updates: each mob carries on at the velocity from its last update,
+//and when the next one disagrees the difference is blended out over a short time instead of snapped to
+//kept as structure-of-arrays by mob index (same order as MobManager's lists), so a frame is one pass over each array
+class MobMotion
+{
+private:
+	static const float BLEND_TIME; //seconds for a correction to mostly fade out
+	static const float SNAP_DISTANCE; //corrections larger than this are teleports, not blended
+	static const float MAX_EXTRAPOLATION; //seconds without an update before a mob is assumed to have stopped
+	static const float REST_EPSILON;
+	//see mob_motion.cpp for how these are measured
+	static const float DEFAULT_VELOCITY_SCALE;
+	static const float DEFAULT_HEADING_RATE_SCALE;
+	static const float MIN_SAMPLE_TIME; //seconds between updates, closer ones are mostly rounding
+	static const uint32 MIN_SAMPLES = 8; //before a measured scale replaces the default
+	static const uint32 MAX_SAMPLE_WEIGHT = 64; //the estimate keeps following the last this many samples or so
+
+	enum Flags
+	{
+		MOVING	= 1 << 0,
+		DIRTY	= 1 << 1 //scene node needs updating this frame
+	};
+
+	std::vector<float> mPosX, mPosY, mPosZ; //where the server would have the mob now
+	std::vector<float> mVelX, mVelY, mVelZ; //as sent, mVelocityScale turns them into units per second
+	std::vector<float> mErrX, mErrY, mErrZ; //offset still being blended out, added to the position for display
+	std::vector<float> mHeading, mHeadingRate; //degrees, and as sent (see mHeadingRateScale)
+	std::vector<float> mSinceUpdate;
+	std::vector<float> mLastX, mLastY, mLastZ, mLastHeading; //as of the last update, to measure the scales against
+	std::vector<uint8> mFlags;
+
+	//per second per unit of the deltas; averaged in log space, so that a sample twice too big and one half too small
+	//cancel out
+	float mVelocityScale;
+	float mVelocityLog;
+	uint32 mVelocitySamples;
+	float mHeadingRateScale;
+	float mHeadingRateLog;
+	uint32 mHeadingRateSamples;
+
+private:
+	//compares where the server put a mob with where its last update said it was going
+	void measure(uint32 index, const MobPosition& pos, const core::vector3df& vel, float heading, float heading_rate);
+	static void addSample(float sample, float& log_avg, uint32& count, float& scale, const char* what);
+
+public:
+	MobMotion();
+
+	uint32 size() { return mPosX.size(); }
+
+	//index must be the next one, i.e. size()
+	void add(const MobPosition& pos, float heading);
+	//swap'n'pop, like MobManager's lists
+	void remove(uint32 index);
+
+	//a position update from the server
+	void correct(uint32 index, const MobPosition& pos, const core::vector3df& vel, float heading, float heading_rate);
+	void step(float delta);
+
+	//whether the mob moved or turned in the last step
+	bool isActive(uint32 index) { return (mFlags[index] & DIRTY) != 0; }
+	MobPosition getPosition(uint32 index) { return MobPosition(mPosX[index], mPosY[index], mPosZ[index]); }
+	MobPosition getDisplayPosition(uint32 index);
+	float getHeading(uint32 index) { return mHeading[index]; }
+};
+
+#endif
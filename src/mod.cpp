@@ -40,7 +40,7 @@ void MOD::convertStaticModel(ZoneModel* zoneModel)
 
 	//triangles
 	Triangle* tris = (Triangle*)(data + p);
-	readEQGTriangles(mHeader->material_count, mHeader->triangle_count, tris, vertices, verticesV3);
+	readEQGTriangles(mHeader->material_count, mHeader->triangle_count, tris, mHeader->vertex_count, vertices, verticesV3);
 
 	//create irrlicht meshes
 	scene::SMesh* mesh = new scene::SMesh;
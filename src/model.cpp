@@ -10,7 +10,37 @@ Model::~Model()
 		animTex.deleteArrays();
 
 	for (video::ITexture* tex : mUsedTextures)
-		gRenderer.destroyTexture(tex);
+		gRenderer.releaseTexture(tex);
+}
+
+void Model::addUsedTexture(video::ITexture* texture)
+{
+	//once per model, however many of its materials use it
+	if (texture && mUsedTextures.insert(texture).second)
+		gRenderer.retainTexture(texture);
+}
+
+uint64 Model::getTextureMemoryUsage()
+{
+	uint64 bytes = 0;
+	for (video::ITexture* tex : mUsedTextures)
+	{
+		if (tex)
+			bytes += (uint64)tex->getPitch() * tex->getSize().Height;
+	}
+	return bytes;
+}
+
+uint64 Model::getMeshMemoryUsage(scene::IMesh* mesh)
+{
+	uint64 bytes = 0;
+	for (uint32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+	{
+		scene::IMeshBuffer* buf = mesh->getMeshBuffer(i);
+		bytes += (uint64)buf->getVertexCount() * sizeof(video::S3DVertex);
+		bytes += (uint64)buf->getIndexCount() * ((buf->getIndexType() == video::EIT_32BIT) ? 4 : 2);
+	}
+	return bytes;
 }
 
 AnimatedTexture* Model::addAnimatedTexture(AnimatedTexture& animTex)
@@ -21,9 +21,12 @@ private:
 public:
 	virtual ~Model();
 
-	void addUsedTexture(video::ITexture* texture) { mUsedTextures.insert(texture); }
+	void addUsedTexture(video::ITexture* texture);
 	AnimatedTexture* addAnimatedTexture(AnimatedTexture& animTex);
 	const std::vector<AnimatedTexture>& getAnimatedTextures() { return mAnimatedTextures; }
+
+	uint64 getTextureMemoryUsage();
+	static uint64 getMeshMemoryUsage(scene::IMesh* mesh);
 };
 
 #endif
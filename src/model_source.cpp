@@ -2,8 +2,13 @@
 #include "model_source.h"
 #include "renderer.h"
 
+#include <algorithm>
+#include <cmath>
+
 extern Renderer gRenderer;
 
+const float ModelSource::ZONE_CHUNK_SIZE = 1024.0f;
+
 ModelSource::ModelSource(S3D* s3d, std::string shortname) :
 	mContainingS3D(s3d),
 	mStringBlock(nullptr),
@@ -15,11 +20,15 @@ ModelSource::ModelSource(S3D* s3d, std::string shortname) :
 	mNoCollisionVertexBuffers(nullptr),
 	mNoCollisionIndexBuffers(nullptr)
 {
-
+	//keeps the archive out of FileLoader's eviction for as long as we may read from it
+	if (mContainingS3D)
+		mContainingS3D->pin();
 }
 
 ModelSource::~ModelSource()
 {
+	if (mContainingS3D)
+		mContainingS3D->unpin();
 	if (mMaterials)
 		delete[] mMaterials;
 	if (mMaterialVertexBuffers)
@@ -76,76 +85,253 @@ void ModelSource::initMaterialBuffers()
 }
 
 void ModelSource::createMeshBuffer(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
-		std::vector<uint32>& index_buf, IntermediateMaterial* mat, Model* model)
+		std::vector<uint32>& index_buf, IntermediateMaterial* mat, Model* model, bool static_geometry)
+{
+	const uint32 first = mesh->getMeshBufferCount();
+	splitMeshBuffer(mesh, vert_buf, index_buf, mat, model, static_geometry);
+	addAnimatedTexture(mesh, mat, model, first);
+}
+
+void ModelSource::createChunkedMeshBuffers(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
+		std::vector<uint32>& index_buf, IntermediateMaterial* mat, Model* model,
+		const std::vector<uint32>* tri_groups, std::vector<uint32>* buffer_groups)
 {
-	//irrlicht's default provided mesh buffers can take up to 65536 indices
-	//need to handle case of total > 65535 by splitting into separate buffers
-	uint32 count = index_buf.size();
-	uint32 n = (count / 65535) + 1; //may want to make sure it's not an exact multiple
-	uint32 adj = 0;
-
-	AnimatedTexture* animTex = nullptr;
-	if (mat->num_frames > 1 && model)
+	static const uint32 NONE = 0xFFFFFFFF;
+
+	//sort triangles by the chunk their centroid falls in, keyed on the chunk's x and z, or by their given group
+	std::vector<std::pair<uint64, uint32>> tris;
+	tris.reserve(index_buf.size() / 3);
+	for (uint32 i = 0; i < index_buf.size(); i += 3)
 	{
-		AnimatedTexture anim(mesh, mat, n, mesh->getMeshBufferCount());
-		animTex = model->addAnimatedTexture(anim);
+		if (tri_groups)
+		{
+			tris.push_back(std::make_pair((uint64)(*tri_groups)[i / 3], i));
+			continue;
+		}
+
+		core::vector3df c = vert_buf[index_buf[i]].Pos + vert_buf[index_buf[i + 1]].Pos + vert_buf[index_buf[i + 2]].Pos;
+		uint32 x = (uint32)(int32)floorf(c.X / (3.0f * ZONE_CHUNK_SIZE));
+		uint32 z = (uint32)(int32)floorf(c.Z / (3.0f * ZONE_CHUNK_SIZE));
+		tris.push_back(std::make_pair(((uint64)x << 32) | z, i));
 	}
+	std::sort(tris.begin(), tris.end());
 
-	for (uint32 i = 0; i < n; ++i)
-	{
-		scene::SMeshBuffer* mesh_buffer = new scene::SMeshBuffer;
-		auto& vbuf = mesh_buffer->Vertices;
-		auto& ibuf = mesh_buffer->Indices;
+	const uint32 first = mesh->getMeshBufferCount();
+	std::vector<uint32> owner(vert_buf.size(), NONE);
+	std::vector<uint32> local(vert_buf.size());
+	std::vector<video::S3DVertex> chunk_verts;
+	std::vector<uint32> chunk_indices;
 
-		//65535 is a multiple of 3, use 0 to 65534
-		uint32 max = count < 65535 ? count : 65535;
+	uint32 chunk = 0;
+	for (uint32 begin = 0; begin < tris.size(); ++chunk)
+	{
+		uint32 end = begin;
+		while (end < tris.size() && tris[end].first == tris[begin].first)
+			++end;
 
-		for (uint32 j = 0; j < max; ++j)
+		//vertices shared with a neighbouring chunk are copied into both
+		chunk_verts.clear();
+		chunk_indices.clear();
+		for (uint32 t = begin; t < end; ++t)
 		{
-			vbuf.push_back(vert_buf[j + adj]);
-			ibuf.push_back((uint16)(index_buf[j + adj] - adj));
+			for (uint32 j = 0; j < 3; ++j)
+			{
+				uint32 idx = index_buf[tris[t].second + j];
+				if (owner[idx] != chunk)
+				{
+					owner[idx] = chunk;
+					local[idx] = chunk_verts.size();
+					chunk_verts.push_back(vert_buf[idx]);
+				}
+				chunk_indices.push_back(local[idx]);
+			}
 		}
 
-		//material
-		video::SMaterial& material = mesh_buffer->getMaterial();
-		if (mat)
+		splitMeshBuffer(mesh, chunk_verts, chunk_indices, mat, model, true);
+		if (buffer_groups)
+			buffer_groups->resize(mesh->getMeshBufferCount(), (uint32)tris[begin].first);
+		begin = end;
+	}
+
+	addAnimatedTexture(mesh, mat, model, first);
+}
+
+void ModelSource::addAnimatedTexture(scene::SMesh* mesh, IntermediateMaterial* mat, Model* model, uint32 first)
+{
+	//buffers from first on all belong to this material
+	if (mat && mat->num_frames > 1 && model)
+	{
+		AnimatedTexture anim(mesh, mat, mesh->getMeshBufferCount() - first, first);
+		model->addAnimatedTexture(anim);
+	}
+}
+
+void ModelSource::splitMeshBuffer(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
+		std::vector<uint32>& index_buf, IntermediateMaterial* mat, Model* model, bool static_geometry)
+{
+	const uint32 vert_count = vert_buf.size();
+
+	mMeshStats.triangles += index_buf.size() / 3;
+	mMeshStats.vertices += vert_count;
+	mMeshStats.transformsBefore += MeshOptimizer::simulateTransforms(index_buf, vert_count);
+
+	MeshOptimizer::optimizeVertexCache(index_buf, vert_count);
+	if (static_geometry)
+		MeshOptimizer::optimizeVertexFetch(vert_buf, index_buf);
+
+	mMeshStats.transformsAfter += MeshOptimizer::simulateTransforms(index_buf, vert_buf.size());
+
+	static const uint32 MAX_VERTICES = 65535;
+
+	if (static_geometry && vert_buf.size() > MAX_VERTICES && gRenderer.use32BitIndices())
+	{
+		//one 32-bit buffer means one draw call, and the staging vectors can be copied over wholesale
+		scene::CDynamicMeshBuffer* mesh_buffer = new scene::CDynamicMeshBuffer(video::EVT_STANDARD, video::EIT_32BIT);
+		scene::IVertexBuffer& vbuf = mesh_buffer->getVertexBuffer();
+		scene::IIndexBuffer& ibuf = mesh_buffer->getIndexBuffer();
+
+		vbuf.set_used(vert_buf.size());
+		std::copy(vert_buf.begin(), vert_buf.end(), (video::S3DVertex*)vbuf.pointer());
+		ibuf.set_used(index_buf.size());
+		memcpy(ibuf.pointer(), index_buf.data(), sizeof(uint32) * index_buf.size());
+
+		addMeshBuffer(mesh, mesh_buffer, mat, model, static_geometry);
+		return;
+	}
+
+	//irrlicht's default provided mesh buffers use 16-bit indices, so each can address at most 65536 vertices
+	//need to handle case of total > 65535 by splitting into separate buffers, at triangle boundaries
+	static const uint32 NONE = 0xFFFFFFFF;
+
+	std::vector<uint32> splits; //index position where each buffer starts
+	splits.push_back(0);
+
+	std::vector<uint32> localIndex;
+	std::vector<uint32> localBuffer;
+
+	if (vert_buf.size() > MAX_VERTICES)
+	{
+		localIndex.assign(vert_buf.size(), NONE);
+		localBuffer.assign(vert_buf.size(), NONE);
+
+		uint32 used = 0;
+		uint32 n = 0;
+		for (uint32 i = 0; i < index_buf.size(); i += 3)
 		{
-			if (mat->first.flag & IntermediateMaterialEntry::FULLY_TRANSPARENT)
+			uint32 added = 0;
+			for (int j = 0; j < 3; ++j)
 			{
-				if (!Lua::getConfigBool(CONFIG_VAR_SHOW_ZONE_WALLS, false))
-					material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF; //fully transparent materials should have no texture
-				else
-					material.MaterialType = video::EMT_TRANSPARENT_VERTEX_ALPHA;
+				if (localBuffer[index_buf[i + j]] != n)
+					++added;
 			}
-			else if (mat->first.diffuse_map)
+
+			if (used + added > MAX_VERTICES)
 			{
-				material.setTexture(0, mat->first.diffuse_map);
-				if (model) //should always be a model, but just in case...
-					model->addUsedTexture(mat->first.diffuse_map);
+				splits.push_back(i);
+				++n;
+				used = 0;
+			}
 
-				if (mat->first.flag & IntermediateMaterialEntry::MASKED)
+			for (int j = 0; j < 3; ++j)
+			{
+				uint32 idx = index_buf[i + j];
+				if (localBuffer[idx] != n)
 				{
-					if (gRenderer.isOpenGL())
-						material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL;
-					else
-						material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF; //should be blended
+					localBuffer[idx] = n;
+					++used;
 				}
-				//put semi-transparent handling here (need to figure out how to do it and how to make it play nice with masking...)
-				//probably make a copy of the texture and change the alpha of the bitmap pixels, then use blending EMT_TRANSPARENT_ALPHA_CHANNEL
 			}
 		}
+
+		localBuffer.assign(vert_buf.size(), NONE);
+	}
+
+	const uint32 n = splits.size();
+	splits.push_back(index_buf.size());
+
+	for (uint32 i = 0; i < n; ++i)
+	{
+		scene::SMeshBuffer* mesh_buffer = new scene::SMeshBuffer;
+		auto& vbuf = mesh_buffer->Vertices;
+		auto& ibuf = mesh_buffer->Indices;
+
+		const uint32 begin = splits[i];
+		const uint32 end = splits[i + 1];
+
+		if (n == 1)
+		{
+			//everything fits, vertices can be copied over wholesale and indices only need narrowing
+			vbuf.set_used(vert_buf.size());
+			std::copy(vert_buf.begin(), vert_buf.end(), (video::S3DVertex*)vbuf.pointer());
+
+			ibuf.set_used(index_buf.size());
+			uint16* dst = ibuf.pointer();
+			for (uint32 idx : index_buf)
+				*dst++ = (uint16)idx;
+		}
 		else
 		{
-			material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF;
+			ibuf.reallocate(end - begin);
+
+			for (uint32 j = begin; j < end; ++j)
+			{
+				uint32 idx = index_buf[j];
+				if (localBuffer[idx] != i)
+				{
+					localBuffer[idx] = i;
+					localIndex[idx] = vbuf.size();
+					vbuf.push_back(vert_buf[idx]);
+				}
+				ibuf.push_back((uint16)localIndex[idx]);
+			}
 		}
 
-		mesh_buffer->recalculateBoundingBox();
-		mesh->addMeshBuffer(mesh_buffer);
-		mesh_buffer->drop();
+		addMeshBuffer(mesh, mesh_buffer, mat, model, static_geometry);
+	}
+}
+
+void ModelSource::addMeshBuffer(scene::SMesh* mesh, scene::IMeshBuffer* mesh_buffer, IntermediateMaterial* mat, Model* model, bool static_geometry)
+{
+	//material
+	video::SMaterial& material = mesh_buffer->getMaterial();
+	if (mat)
+	{
+		if (mat->first.flag & IntermediateMaterialEntry::FULLY_TRANSPARENT)
+		{
+			if (!gRenderer.showZoneWalls())
+				material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF; //fully transparent materials should have no texture
+			else
+				material.MaterialType = video::EMT_TRANSPARENT_VERTEX_ALPHA;
+		}
+		else if (mat->first.diffuse_map)
+		{
+			material.setTexture(0, mat->first.diffuse_map);
+			if (model) //should always be a model, but just in case...
+				model->addUsedTexture(mat->first.diffuse_map);
 
-		adj += 65535;
-		count -= 65535;
+			if (mat->first.flag & IntermediateMaterialEntry::MASKED)
+			{
+				if (gRenderer.isOpenGL())
+					material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL;
+				else
+					material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF; //should be blended
+			}
+			//put semi-transparent handling here (need to figure out how to do it and how to make it play nice with masking...)
+			//probably make a copy of the texture and change the alpha of the bitmap pixels, then use blending EMT_TRANSPARENT_ALPHA_CHANNEL
+		}
+	}
+	else
+	{
+		material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF;
 	}
+
+	//static geometry never changes after this, so it only needs to be uploaded to the video card once
+	if (static_geometry)
+		mesh_buffer->setHardwareMappingHint(scene::EHM_STATIC);
+
+	mesh_buffer->recalculateBoundingBox();
+	mesh->addMeshBuffer(mesh_buffer);
+	mesh_buffer->drop();
 }
 
 uint32 ModelSource::readEQGMaterials(uint32 mat_count, byte* data, uint32 p)
@@ -177,80 +363,73 @@ uint32 ModelSource::readEQGMaterials(uint32 mat_count, byte* data, uint32 p)
 	return p;
 }
 
-void ModelSource::readEQGTriangles(uint32 mat_count, uint32 tri_count, Triangle* tris, Vertex* vertices, VertexV3* verticesV3)
+void ModelSource::readEQGTriangles(uint32 mat_count, uint32 tri_count, Triangle* tris, uint32 vert_count, Vertex* vertices, VertexV3* verticesV3)
 {
-	video::S3DVertex irrvert;
 	std::vector<video::S3DVertex>* vert_buf;
 	std::vector<uint32>* index_buf;
+	uint32 buffer_id;
+
+	//eqg vertices carry their own uvs and normals, so the source index identifies a converted vertex within a buffer
+	VertexRemap remap(vert_count);
 
 	for (uint32 i = 0; i < tri_count; ++i)
 	{
 		Triangle& tri = tris[i];
+		uint32 mat = (tri.material < 0) ? mat_count : tri.material; //negative is the null material
+
 		if ((tri.flag & Triangle::PERMEABLE) == 0)
 		{
-			if (tri.material < 0)
-			{
-				//null material
-				vert_buf = &mMaterialVertexBuffers[mat_count];
-				index_buf = &mMaterialIndexBuffers[mat_count];
-			}
-			else
-			{
-				vert_buf = &mMaterialVertexBuffers[tri.material];
-				index_buf = &mMaterialIndexBuffers[tri.material];
-			}
+			vert_buf = &mMaterialVertexBuffers[mat];
+			index_buf = &mMaterialIndexBuffers[mat];
+			buffer_id = mat * 2;
 		}
 		else
 		{
-			if (tri.material < 0)
-			{
-				//null material
-				vert_buf = &mNoCollisionVertexBuffers[mat_count];
-				index_buf = &mNoCollisionIndexBuffers[mat_count];
-			}
-			else
-			{
-				vert_buf = &mNoCollisionVertexBuffers[tri.material];
-				index_buf = &mNoCollisionIndexBuffers[tri.material];
-			}
+			vert_buf = &mNoCollisionVertexBuffers[mat];
+			index_buf = &mNoCollisionIndexBuffers[mat];
+			buffer_id = mat * 2 + 1;
 		}
 
-		if (vertices)
-		{
-			for (int j = 0; j < 3; ++j)
-			{
-				Vertex& vert = vertices[tri.index[j]];
-				irrvert.Pos.X = vert.x;
-				irrvert.Pos.Y = vert.z;
-				irrvert.Pos.Z = vert.y;
-				irrvert.Normal.X = vert.i;
-				irrvert.Normal.Y = vert.k;
-				irrvert.Normal.Z = vert.j;
-				irrvert.TCoords.X = vert.u;
-				irrvert.TCoords.Y = vert.v;
-				vert_buf->push_back(irrvert);
-			}
-		}
-		else
+		//winding order needs to be reversed
+		for (int j = 2; j >= 0; --j)
 		{
-			for (int j = 0; j < 3; ++j)
+			uint32 idx = tri.index[j];
+			uint32 out;
+
+			if (!remap.find(buffer_id, idx, out))
 			{
-				VertexV3& vert = verticesV3[tri.index[j]];
-				irrvert.Pos.X = vert.x;
-				irrvert.Pos.Y = vert.z;
-				irrvert.Pos.Z = vert.y;
-				irrvert.Normal.X = vert.i;
-				irrvert.Normal.Y = vert.k;
-				irrvert.Normal.Z = vert.j;
-				irrvert.TCoords.X = vert.u;
-				irrvert.TCoords.Y = vert.v;
+				out = vert_buf->size();
+				remap.insert(buffer_id, idx, out);
+
+				video::S3DVertex irrvert;
+				if (vertices)
+				{
+					Vertex& vert = vertices[idx];
+					irrvert.Pos.X = vert.x;
+					irrvert.Pos.Y = vert.z;
+					irrvert.Pos.Z = vert.y;
+					irrvert.Normal.X = vert.i;
+					irrvert.Normal.Y = vert.k;
+					irrvert.Normal.Z = vert.j;
+					irrvert.TCoords.X = vert.u;
+					irrvert.TCoords.Y = vert.v;
+				}
+				else
+				{
+					VertexV3& vert = verticesV3[idx];
+					irrvert.Pos.X = vert.x;
+					irrvert.Pos.Y = vert.z;
+					irrvert.Pos.Z = vert.y;
+					irrvert.Normal.X = vert.i;
+					irrvert.Normal.Y = vert.k;
+					irrvert.Normal.Z = vert.j;
+					irrvert.TCoords.X = vert.u;
+					irrvert.TCoords.Y = vert.v;
+				}
 				vert_buf->push_back(irrvert);
 			}
-		}
 
-		//winding order needs to be reversed
-		uint32 s = index_buf->size() + 3;
-		for (int j = 0; j < 3; ++j)
-			index_buf->push_back(--s);
+			index_buf->push_back(out);
+		}
 	}
 }
@@ -13,6 +13,7 @@
 #include "s3d.h"
 #include "structs_eqg.h"
 #include "zeq_lua.h"
+#include "mesh_optimizer.h"
 
 using namespace irr;
 using namespace EQG_Structs;
@@ -20,6 +21,8 @@ using namespace EQG_Structs;
 class ModelSource
 {
 protected:
+	static const float ZONE_CHUNK_SIZE;
+
 	S3D* mContainingS3D;
 	char* mStringBlock;
 	std::string mShortName;
@@ -32,23 +35,38 @@ protected:
 	std::vector<video::S3DVertex>* mNoCollisionVertexBuffers;
 	std::vector<uint32>* mNoCollisionIndexBuffers;
 
+	MeshStats mMeshStats;
+
 protected:
 	ModelSource(S3D* s3d, std::string shortname);
 	virtual ~ModelSource();
 
 	void initMaterials(uint32 num);
 	void initMaterialBuffers();
-	static void createMeshBuffer(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
-		std::vector<uint32>& index_buf, IntermediateMaterial* mat = nullptr, Model* model = nullptr);
+	//static geometry may have its vertices reordered, use 32-bit indices and be kept in video memory;
+	//skinned meshes must pass false, their bone weights refer to vertices by buffer position
+	void createMeshBuffer(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
+		std::vector<uint32>& index_buf, IntermediateMaterial* mat = nullptr, Model* model = nullptr, bool static_geometry = true);
+	//zone geometry: as above, but cut into ZONE_CHUNK_SIZE squares over X and Z first, one or more buffers per chunk,
+	//so that each buffer's bounding box is small enough to cull; a material's buffers stay consecutive.
+	//tri_groups replaces the squares with a given group per triangle, and buffer_groups receives each new buffer's group
+	void createChunkedMeshBuffers(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
+		std::vector<uint32>& index_buf, IntermediateMaterial* mat, Model* model,
+		const std::vector<uint32>* tri_groups = nullptr, std::vector<uint32>* buffer_groups = nullptr);
+	void splitMeshBuffer(scene::SMesh* mesh, std::vector<video::S3DVertex>& vert_buf,
+		std::vector<uint32>& index_buf, IntermediateMaterial* mat, Model* model, bool static_geometry);
+	void addAnimatedTexture(scene::SMesh* mesh, IntermediateMaterial* mat, Model* model, uint32 first);
+	void addMeshBuffer(scene::SMesh* mesh, scene::IMeshBuffer* mesh_buffer, IntermediateMaterial* mat, Model* model, bool static_geometry);
 
 	uint32 readEQGMaterials(uint32 mat_count, byte* data, uint32 p);
-	void readEQGTriangles(uint32 mat_count, uint32 tri_count, Triangle* tris, Vertex* vertices, VertexV3* verticesV3);
+	void readEQGTriangles(uint32 mat_count, uint32 tri_count, Triangle* tris, uint32 vert_count, Vertex* vertices, VertexV3* verticesV3);
 
 
 public:
 	S3D* getContainingS3D() { return mContainingS3D; }
 	char* getStringBlock() { return mStringBlock; }
 	std::string& getShortName() { return mShortName; }
+	const MeshStats& getMeshStats() { return mMeshStats; }
 };
 
 #endif
@@ -0,0 +1,136 @@
+
+#include "object_batcher.h"
+#include "zone_model.h"
+
+#include <cmath>
+
+const float ObjectBatcher::CELL_SIZE = 512.0f;
+
+ObjectBatcher::ObjectBatcher() :
+	mObjects(0)
+{
+
+}
+
+ObjectBatcher::~ObjectBatcher()
+{
+	for (auto& pair : mCells)
+	{
+		for (scene::SMeshBuffer* buf : pair.second.buffers)
+			buf->drop();
+	}
+}
+
+scene::SMeshBuffer* ObjectBatcher::getBuffer(Cell& cell, const video::SMaterial& material, uint32 vertices)
+{
+	//the newest buffer with this material is the only one that can still have room
+	for (int i = (int)cell.buffers.size() - 1; i >= 0; --i)
+	{
+		scene::SMeshBuffer* buf = cell.buffers[i];
+		if (buf->Material == material)
+		{
+			if (buf->Vertices.size() + vertices <= MAX_VERTICES)
+				return buf;
+			break;
+		}
+	}
+
+	scene::SMeshBuffer* buf = new scene::SMeshBuffer;
+	buf->Material = material;
+	cell.buffers.push_back(buf);
+	return buf;
+}
+
+bool ObjectBatcher::add(const ObjectPlacement& obj)
+{
+	scene::IMesh* mesh = obj.mesh->getMesh(0);
+	for (uint32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+	{
+		scene::IMeshBuffer* src = mesh->getMeshBuffer(i);
+		if (src->getVertexType() != video::EVT_STANDARD || src->getVertexCount() > MAX_VERTICES)
+			return false;
+	}
+
+	//the same transform irrlicht would build for a node: translate, rotate, scale
+	core::vector3df scale(obj.scaleX, obj.scaleY, obj.scaleZ);
+	core::matrix4 rotation;
+	rotation.setRotationDegrees(core::vector3df(obj.rotX, obj.rotY, obj.rotZ));
+	core::matrix4 transform(rotation);
+	transform.setTranslation(core::vector3df(obj.x, obj.y, obj.z));
+	core::matrix4 scaleMat;
+	scaleMat.setScale(scale);
+	transform *= scaleMat;
+
+	uint64 key = ((uint64)(uint32)(int32)floorf(obj.x / CELL_SIZE) << 32) | (uint32)(int32)floorf(obj.z / CELL_SIZE);
+	Cell& cell = mCells[key];
+
+	for (uint32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+	{
+		scene::IMeshBuffer* src = mesh->getMeshBuffer(i);
+		const uint32 vertCount = src->getVertexCount();
+		const uint32 indexCount = src->getIndexCount();
+		if (vertCount == 0 || indexCount == 0)
+			continue;
+
+		scene::SMeshBuffer* buf = getBuffer(cell, src->getMaterial(), vertCount);
+		const uint32 base = buf->Vertices.size();
+
+		const video::S3DVertex* verts = (const video::S3DVertex*)src->getVertices();
+		for (uint32 v = 0; v < vertCount; ++v)
+		{
+			video::S3DVertex vert = verts[v];
+			transform.transformVect(vert.Pos);
+			//normals take the inverse scale, then the rotation
+			vert.Normal.set(vert.Normal.X / scale.X, vert.Normal.Y / scale.Y, vert.Normal.Z / scale.Z);
+			rotation.rotateVect(vert.Normal);
+			vert.Normal.normalize();
+			buf->Vertices.push_back(vert);
+		}
+
+		if (src->getIndexType() == video::EIT_32BIT)
+		{
+			const uint32* indices = (const uint32*)src->getIndices();
+			for (uint32 j = 0; j < indexCount; ++j)
+				buf->Indices.push_back((uint16)(base + indices[j]));
+		}
+		else
+		{
+			const uint16* indices = src->getIndices();
+			for (uint32 j = 0; j < indexCount; ++j)
+				buf->Indices.push_back((uint16)(base + indices[j]));
+		}
+	}
+
+	++mObjects;
+	return true;
+}
+
+uint32 ObjectBatcher::createNodes(scene::ISceneManager* sceneMgr, scene::ISceneNode* parent, std::vector<scene::ISceneNode*>& out)
+{
+	uint32 drawCalls = 0;
+
+	for (auto& pair : mCells)
+	{
+		Cell& cell = pair.second;
+		if (cell.buffers.empty())
+			continue;
+
+		scene::SMesh* mesh = new scene::SMesh;
+		for (scene::SMeshBuffer* buf : cell.buffers)
+		{
+			buf->recalculateBoundingBox();
+			buf->setHardwareMappingHint(scene::EHM_STATIC);
+			mesh->addMeshBuffer(buf);
+			buf->drop();
+		}
+		drawCalls += cell.buffers.size();
+		cell.buffers.clear();
+
+		mesh->recalculateBoundingBox();
+		out.push_back(sceneMgr->addMeshSceneNode(mesh, parent));
+		mesh->drop();
+	}
+
+	mCells.clear();
+	return drawCalls;
+}
@@ -0,0 +1,47 @@
+
+#ifndef _ZEQ_OBJECT_BATCHER_H
+#define _ZEQ_OBJECT_BATCHER_H
+
+#include <irrlicht.h>
+
+#include <vector>
+#include <unordered_map>
+
+#include "types.h"
+
+using namespace irr;
+
+struct ObjectPlacement;
+
+//bakes static placed objects into a few big buffers per spatial cell, one per material (split at 16-bit limits),
+//so a forest is a handful of scene nodes and draw calls instead of one node and a few draw calls per tree
+class ObjectBatcher
+{
+private:
+	static const float CELL_SIZE;
+	static const uint32 MAX_VERTICES = 65535;
+
+	struct Cell
+	{
+		std::vector<scene::SMeshBuffer*> buffers;
+	};
+
+	std::unordered_map<uint64, Cell> mCells;
+	uint32 mObjects;
+
+private:
+	scene::SMeshBuffer* getBuffer(Cell& cell, const video::SMaterial& material, uint32 vertices);
+
+public:
+	ObjectBatcher();
+	~ObjectBatcher();
+
+	//false if the object's mesh can't be merged (not plain S3DVertex), in which case it needs its own node
+	bool add(const ObjectPlacement& obj);
+	//one static mesh node per cell, children of parent; returns the number of draw calls they make
+	uint32 createNodes(scene::ISceneManager* sceneMgr, scene::ISceneNode* parent, std::vector<scene::ISceneNode*>& out);
+
+	uint32 getObjectCount() { return mObjects; }
+};
+
+#endif
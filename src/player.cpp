@@ -1,14 +1,32 @@
 
 #include "player.h"
+#include "micro_timer.h"
+#include "random.h"
+
+#include <algorithm>
 
 extern Input gInput;
 extern Renderer gRenderer;
+extern ZonePrefetcher gZonePrefetcher;
+extern MobManager gMobMgr;
+extern Random gRNG;
+
+const float Player::EYE_HEIGHT = 5.0f;
+const float Player::COLLISION_RADIUS = 1.5f;
+const float Player::FOOT_CLEARANCE = 0.1f;
+const float Player::STEP_HEIGHT = 2.0f;
+const float Player::HEADLESS_REPORT_INTERVAL = 60.0f;
 
 Player::Player() :
 	mCamera(nullptr),
 	mMovespeed(100.0f),
 	mFallspeed((float)FALLING_SPEED_DEFAULT),
 	mIsFalling(true),
+	mRegionTypes(0),
+	mWanderTime(0.0f),
+	mSessionTime(0.0f),
+	mReportTime(0.0f),
+	mRecordingPath(false),
 	mZoneViewer(nullptr)
 {
 
@@ -18,17 +36,29 @@ void Player::mainLoop()
 {
 	gRenderer.resetInternalTimer();
 
-	for (;;)
+	const bool headless = gRenderer.isHeadless();
+	std::function<void(float)> simulate = [this, headless](float step)
 	{
-		float delta = gRenderer.loopStep();
-
-		mZoneConnection->poll();
+		if (headless)
+			wander(step);
 
 		if (gInput.isMoving())
-			applyMovement(delta);
+			applyMovement(step);
 
+		checkRegion();
 		if (mIsFalling)
-			applyGravity(delta);
+			applyGravity(step);
+	};
+
+	for (;;)
+	{
+		float delta = gRenderer.loopStep(simulate);
+
+		mZoneConnection->poll();
+		gZonePrefetcher.update(delta, getCoords());
+
+		if (headless)
+			reportSession(delta);
 	}
 }
 
@@ -36,21 +66,30 @@ void Player::zoneViewerLoop()
 {
 	gRenderer.resetInternalTimer();
 
-	for (;;)
+	bool moved = false;
+	std::function<void(float)> simulate = [this, &moved](float step)
 	{
-		float delta = gRenderer.loopStep();
-
 		if (gInput.isMoving())
 		{
-			applyMovement(delta);
-			updateViewerDisplay();
+			applyMovement(step);
+			moved = true;
 		}
 
+		checkRegion();
 		if (mZoneViewer->applyGravity && mIsFalling)
 		{
-			applyGravity(delta);
-			updateViewerDisplay();
+			applyGravity(step);
+			moved = true;
 		}
+	};
+
+	for (;;)
+	{
+		moved = false;
+		gRenderer.loopStep(simulate);
+
+		if (moved)
+			updateViewerDisplay();
 	}
 }
 
@@ -129,12 +168,19 @@ void Player::applyMovement(float delta)
 		dest -= strafevect * delta * mMovespeed * turnDir;
 	}
 
+	if (mRecordingPath)
+	{
+		mRecordedPath.push_back(pos);
+		mRecordedPath.push_back(dest);
+	}
+
 	//check collision between pos and dest
 	if (!mZoneViewer || mZoneViewer->applyCollision)
 		checkCollision(pos, dest);
 
-	//write translation
+	//write translation; there may be more simulation steps before drawAll updates the absolute position
 	cam->setPosition(dest);
+	cam->updateAbsolutePosition();
 	mPosition = dest;
 
 	//write right target
@@ -148,20 +194,16 @@ void Player::applyMovement(float delta)
 
 void Player::applyGravity(float delta)
 {
-	scene::ISceneCollisionManager* mgr = gRenderer.getCollisionManager();
+	FloorMap* floor = gRenderer.getFloorMap();
 	scene::ICameraSceneNode* cam = mCamera->getSceneNode();
 	core::vector3df pos = cam->getPosition();
 
-	core::line3df ray;
-	ray.start = pos + core::vector3df(0, 5, 0);
-	ray.end = pos + core::vector3df(0, -5000, 0);
-	core::vector3df collisionPoint;
-	core::triangle3df unused;
+	float floorY;
 
-	if (mgr->getSceneNodeAndCollisionPointFromRay(ray, collisionPoint, unused))
+	if (floor && floor->getFloorHeight(pos.X, pos.Y + 5.0f, pos.Z, floorY))
 	{
-		//a collision was found along the ray
-		float min = collisionPoint.Y + 5.0f;
+		//a floor was found beneath us
+		float min = floorY + EYE_HEIGHT;
 		float yDiff = pos.Y - min;
 		if (yDiff > 0.0f)
 		{
@@ -186,6 +228,7 @@ void Player::applyGravity(float delta)
 
 		mPosition = pos;
 		cam->setPosition(pos);
+		cam->updateAbsolutePosition();
 		cam->setTarget(cam->getTarget() - core::vector3df(0, yDiff, 0));
 	}
 	else
@@ -197,50 +240,175 @@ void Player::applyGravity(float delta)
 
 void Player::checkCollision(core::vector3df& from, core::vector3df& dest)
 {
-	//just like gravity in another direction, really
-	//just need to get a vector from a -> b by vector subtraction
-	//normalize it to unit length and multiply it to the desired length
-	//then shoot your ray and do the same stuff with the collision point, if any
+	CollisionWorld* world = gRenderer.getCollisionWorld();
+	if (world == nullptr || world->empty())
+		return;
+
+	//an upright capsule from just above the feet up to the eye; gravity takes care of the vertical
+	core::vector3df base(0.0f, EYE_HEIGHT - COLLISION_RADIUS - FOOT_CLEARANCE, 0.0f);
+	float height = EYE_HEIGHT - COLLISION_RADIUS - FOOT_CLEARANCE;
+
+	dest = world->moveCapsule(from - base, dest - base, COLLISION_RADIUS, height, STEP_HEIGHT) + base;
+}
+
+void Player::toggleMovementRecording()
+{
+	mRecordingPath = !mRecordingPath;
+	if (mRecordingPath)
+	{
+		mRecordedPath.clear();
+		printf("recording movement\n");
+		return;
+	}
 
-	/*core::vector3df temp = dest;
-	temp.Y = from.Y;
+	std::string name = (mZoneViewer ? mZoneViewer->shortname : std::string("zone")) + "_path.txt";
+	FILE* fp = fopen(name.c_str(), "w");
+	if (fp == nullptr)
+	{
+		printf("could not write %s\n", name.c_str());
+		return;
+	}
 
-	scene::ISceneCollisionManager* mgr = gRenderer.getCollisionManager();
+	for (uint32 i = 0; i + 1 < mRecordedPath.size(); i += 2)
+	{
+		const core::vector3df& a = mRecordedPath[i];
+		const core::vector3df& b = mRecordedPath[i + 1];
+		fprintf(fp, "%g %g %g %g %g %g\n", a.X, a.Y, a.Z, b.X, b.Y, b.Z);
+	}
+	fclose(fp);
 
-	core::line3df ray;
-	ray.start = from + core::vector3df(0, 5, 0);
-	ray.end = temp + core::vector3df(0, 5, 0);
-	core::vector3df collisionPoint;
-	core::triangle3df unused;
+	printf("recorded %u movement steps to %s\n", (uint32)(mRecordedPath.size() / 2), name.c_str());
+	mRecordedPath.clear();
+}
 
-	if (mgr->getSceneNodeAndCollisionPointFromRay(ray, collisionPoint, unused))
+void Player::benchmarkMovement(const std::string& shortname)
+{
+	static const uint32 WALKERS = 20;
+	static const uint32 WALK_STEPS = 600;
+	static const float STEP_DELTA = 1.0f / 60.0f;
+
+	CollisionWorld* world = gRenderer.getCollisionWorld();
+	if (world == nullptr || world->empty())
+		return;
+
+	std::vector<core::vector3df> path;
+	std::string name = shortname + "_path.txt";
+	FILE* fp = fopen(name.c_str(), "r");
+	if (fp)
+	{
+		core::vector3df a, b;
+		while (fscanf(fp, "%f %f %f %f %f %f", &a.X, &a.Y, &a.Z, &b.X, &b.Y, &b.Z) == 6)
+		{
+			path.push_back(a);
+			path.push_back(b);
+		}
+		fclose(fp);
+		printf("replaying %u movement steps from %s\n", (uint32)(path.size() / 2), name.c_str());
+	}
+	else
 	{
-		printf("collision: %g, %g, %g to %g, %g, %g\n", from.X, from.Y, from.Z, dest.X, dest.Y, dest.Z);
-		temp = collisionPoint - from;
-		temp.invert();
-		temp.normalize();
-		temp *= 10;
-		dest = from + temp;
-		printf("col point: %g, %g, %g\nmoving to: %g, %g, %g\n", collisionPoint.X, collisionPoint.Y, collisionPoint.Z,
-			dest.X, dest.Y, dest.Z);
-	}*/
-
-	/*scene::ISceneCollisionManager* mgr = gRenderer.getCollisionManager();
-
-	core::line3df ray;
-	ray.start = from + core::vector3df(0, 5, 0);
-	ray.end = dest + core::vector3df(0, 5, 0);
-	core::vector3df collisionPoint;
-	core::triangle3df unused;
-
-	if (mgr->getSceneNodeAndCollisionPointFromRay(ray, collisionPoint, unused))
+		//no recording: wander about from random spots on the floor at run speed, the way a player would
+		printf("no %s, wandering instead\n", name.c_str());
+		core::aabbox3df bounds = world->getBoundingBox();
+		Random rng;
+		std::uniform_real_distribution<float> rx(bounds.MinEdge.X, bounds.MaxEdge.X);
+		std::uniform_real_distribution<float> rz(bounds.MinEdge.Z, bounds.MaxEdge.Z);
+		std::uniform_real_distribution<float> turn(-3.0f, 3.0f);
+
+		for (uint32 w = 0; w < WALKERS; ++w)
+		{
+			CollisionHit hit;
+			core::vector3df pos(rx(rng), bounds.MaxEdge.Y, rz(rng));
+			if (!world->raycast(pos, core::vector3df(0.0f, -1.0f, 0.0f), bounds.getExtent().Y, hit))
+				continue;
+
+			pos.Y = hit.point.Y + EYE_HEIGHT;
+			float heading = turn(rng) * 60.0f;
+			for (uint32 i = 0; i < WALK_STEPS; ++i)
+			{
+				heading += turn(rng);
+				core::vector3df dest = pos + core::vector3df(sinf(heading * core::DEGTORAD), 0.0f,
+					cosf(heading * core::DEGTORAD)) * (mMovespeed * STEP_DELTA);
+				path.push_back(pos);
+				path.push_back(dest);
+
+				checkCollision(pos, dest);
+				if (world->raycast(dest + core::vector3df(0.0f, EYE_HEIGHT, 0.0f), core::vector3df(0.0f, -1.0f, 0.0f),
+					EYE_HEIGHT * 4.0f, hit))
+					dest.Y = hit.point.Y + EYE_HEIGHT;
+				pos = dest;
+			}
+		}
+	}
+
+	const uint32 steps = path.size() / 2;
+	if (steps == 0)
+		return;
+
+	std::vector<uint32> times(steps);
+	uint32 blocked = 0;
+	for (uint32 i = 0; i < steps; ++i)
 	{
-		printf("collision: %g, %g, %g to %g, %g, %g\n", from.X, from.Y, from.Z, dest.X, dest.Y, dest.Z);
-		core::vector3df diff = from - collisionPoint;
-		diff.normalize();
-		dest = collisionPoint - core::vector3df(0, 5, 0) - diff;
-		printf("corrected to %g, %g, %g\n", dest.X, dest.Y, dest.Z);
-	}*/
+		core::vector3df from = path[i * 2];
+		core::vector3df dest = path[i * 2 + 1];
+		MicroTimer timer;
+		checkCollision(from, dest);
+		times[i] = timer.getElapsed();
+		if (dest.getDistanceFromSQ(path[i * 2 + 1]) > 0.0001f)
+			++blocked;
+	}
+
+	uint64 total = 0;
+	for (uint32 t : times)
+		total += t;
+	std::sort(times.begin(), times.end());
+
+	printf("movement collision, %u steps (%u blocked or slid): %.2f us/step average, %u us median, %u us 99th percentile, %u us max\n",
+		steps, blocked, (double)total / steps, times[steps / 2], times[std::min(steps - 1, steps * 99 / 100)], times[steps - 1]);
+}
+
+void Player::checkRegion()
+{
+	RegionMap* regions = gRenderer.getRegionMap();
+	if (regions == nullptr || regions->empty())
+		return;
+
+	uint32 types = regions->getTypes(mCamera->getSceneNode()->getAbsolutePosition());
+	if (types == mRegionTypes)
+		return;
+	mRegionTypes = types;
+
+	//sink slowly in any liquid
+	mFallspeed = (float)((types & RegionMap::LIQUID) ? FALLING_SPEED_SWIMMING : FALLING_SPEED_DEFAULT);
+}
+
+void Player::wander(float delta)
+{
+	mWanderTime -= delta;
+	if (mWanderTime > 0.0f)
+		return;
+
+	//walk for a few seconds, turning a little or not at all
+	std::uniform_real_distribution<float> time(1.0f, 5.0f);
+	std::uniform_int_distribution<int> turn(Input::TURN_LEFT, Input::TURN_RIGHT);
+	mWanderTime = time(gRNG);
+	gInput.setMoveDirection(Input::MOVE_FORWARD);
+	gInput.setTurnDirection((int8)turn(gRNG));
+}
+
+void Player::reportSession(float delta)
+{
+	mSessionTime += delta;
+	mReportTime += delta;
+	if (mReportTime < HEADLESS_REPORT_INTERVAL)
+		return;
+	mReportTime = 0.0f;
+
+	ZoneModel* zone = gRenderer.getActiveZoneModel();
+	const MobPosition& pos = getCoords();
+	printf("session at %.0f s: %u mobs, zone %.1f MB, at %g, %g, %g\n", mSessionTime, gMobMgr.getMobCount(),
+		zone ? zone->getMemoryUsage() / (1024.0 * 1024.0) : 0.0, pos.X, pos.Y, pos.Z);
+	gRenderer.printFrameStats();
 }
 
 void Player::applyFallingDamage()
@@ -251,17 +419,15 @@ void Player::applyFallingDamage()
 
 void Player::setPosition(float x, float y, float z)
 {
-	core::vector3df pos(x, y, z);
+	mPosition.set(x, y, z);
 	scene::ICameraSceneNode* cam = mCamera->getSceneNode();
-	cam->setPosition(pos);
+	cam->setPosition(mPosition);
 }
 
 const MobPosition& Player::getCoords() const
 {
-	scene::ICameraSceneNode* cam = mCamera->getSceneNode();
-	core::vector3df& p = cam->getAbsolutePosition();
-
-	return p;
+	//kept in step with the camera by whatever moves it
+	return mPosition;
 }
 
 void Player::handleSpawn(Spawn_Struct* spawn)
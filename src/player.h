@@ -25,6 +25,15 @@ private:
 	float mFallspeed;
 	bool mIsFalling;
 	float mFallStartingY;
+	uint32 mRegionTypes; //RegionMap types at the camera, as of the last checkRegion
+
+	//headless runs
+	float mWanderTime; //until the next change of direction
+	float mSessionTime;
+	float mReportTime;
+
+	bool mRecordingPath;
+	std::vector<core::vector3df> mRecordedPath; //from, intended dest, for each movement step
 
 	Mob* mMob;
 	int mEntityID;
@@ -36,11 +45,20 @@ private:
 	//constants
 	static const uint32 FALLING_SPEED_DEFAULT = 125;
 	static const uint32 FALLING_SPEED_SWIMMING = 25;
+	static const float EYE_HEIGHT; //camera above the floor, as kept by applyGravity
+	static const float COLLISION_RADIUS;
+	static const float FOOT_CLEARANCE; //bottom of the capsule above the floor, so level ground isn't a wall
+	static const float STEP_HEIGHT;
+	static const float HEADLESS_REPORT_INTERVAL; //seconds
 
 private:
 	void applyMovement(float delta);
 	void applyGravity(float delta);
 	void applyFallingDamage();
+	void checkRegion();
+	//stands in for the keyboard in headless runs, so movement, collision and gravity get exercised
+	void wander(float delta);
+	void reportSession(float delta);
 	void checkCollision(core::vector3df& from, core::vector3df& dest);
 
 	void setEntityID(int id) { mEntityID = id; }
@@ -54,9 +72,14 @@ public:
 	ZoneViewerData* getZoneViewer() const { return mZoneViewer; }
 	void setZoneViewer(ZoneViewerData* data) { mZoneViewer = data; }
 	void updateViewerDisplay();
+	//records movement steps until toggled again, then writes them to <zone>_path.txt
+	void toggleMovementRecording();
+	//replays a recorded path (or wanders about, without one) through the active zone, timing each step's collision
+	void benchmarkMovement(const std::string& shortname);
 
 	void setZoneConnection(ZoneConnection* zc) { mZoneConnection = zc; }
 	void setCamera(Camera* cam);
+	Camera* getCamera() { return mCamera; }
 	int getEntityID() const { return mEntityID; }
 
 	void setPosition(float x, float y, float z);
@@ -0,0 +1,222 @@
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+std::atomic<bool> Profiler::sEnabled(false);
+std::mutex Profiler::sThreadMutex;
+std::vector<Profiler::ThreadBuffer*> Profiler::sThreads;
+ZEQ_THREAD_LOCAL Profiler::ThreadBuffer* Profiler::sThreadBuffer = nullptr;
+Profiler::ThreadBuffer* Profiler::sMainThread = nullptr;
+uint64 Profiler::sFrameStart = 0;
+uint64 Profiler::sPrevFrameStart = 0;
+
+//raw counter, and its rate per second
+static uint64 readCounter()
+{
+#ifdef _WIN32
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (uint64)count.QuadPart;
+#else
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+static uint64 readFrequency()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return (uint64)freq.QuadPart;
+#else
+	return 1000000000;
+#endif
+}
+
+//set before main, so no thread can see them half done
+static const uint64 sCounterFrequency = readFrequency();
+static const uint64 sCounterBase = readCounter();
+
+uint64 Profiler::now()
+{
+	//unlike MicroTimer, no pinning to a core: that costs more than most of the scopes being timed
+	uint64 ticks = readCounter() - sCounterBase;
+	return (ticks / sCounterFrequency) * 1000000 + (ticks % sCounterFrequency) * 1000000 / sCounterFrequency;
+}
+
+Profiler::ThreadBuffer* Profiler::getThreadBuffer()
+{
+	if (sThreadBuffer)
+		return sThreadBuffer;
+
+	ThreadBuffer* buf = new ThreadBuffer;
+	buf->events.resize(RING_EVENTS);
+	buf->written = 0;
+	buf->depth = 0;
+
+	std::lock_guard<std::mutex> lock(sThreadMutex);
+	buf->id = sThreads.size() + 1;
+	char name[32];
+	snprintf(name, sizeof(name), "thread %u", buf->id);
+	buf->name = name;
+	sThreads.push_back(buf);
+
+	sThreadBuffer = buf;
+	return buf;
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	ThreadBuffer* buf = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(sThreadMutex);
+	buf->name = name;
+}
+
+uint64 Profiler::enter()
+{
+	++getThreadBuffer()->depth;
+	return now();
+}
+
+void Profiler::leave(const char* name, uint64 start)
+{
+	uint64 end = now();
+	ThreadBuffer* buf = sThreadBuffer;
+	--buf->depth;
+
+	uint32 written = buf->written.load(std::memory_order_relaxed);
+	Event& ev = buf->events[written % RING_EVENTS];
+	ev.name = name;
+	ev.start = start;
+	ev.duration = (uint32)(end - start);
+	ev.depth = buf->depth;
+	buf->written.store(written + 1, std::memory_order_release);
+}
+
+void Profiler::beginFrame()
+{
+	sPrevFrameStart = sFrameStart;
+	sFrameStart = now();
+
+	if (isEnabled() && sMainThread == nullptr)
+	{
+		sMainThread = getThreadBuffer();
+		setThreadName("main");
+	}
+}
+
+void Profiler::copyEvents(ThreadBuffer* buf, std::vector<Event>& out)
+{
+	out.clear();
+	uint32 written = buf->written.load(std::memory_order_acquire);
+	uint32 count = (written < RING_EVENTS) ? written : RING_EVENTS;
+	out.reserve(count);
+	for (uint32 i = written - count; i != written; ++i)
+		out.push_back(buf->events[i % RING_EVENTS]);
+}
+
+void Profiler::getLastFrame(std::vector<Summary>& out)
+{
+	out.clear();
+	if (sMainThread == nullptr || sPrevFrameStart == 0)
+		return;
+
+	//events are in the order they ended, so walking back, nothing before one that ended before the frame is in it
+	std::vector<uint64> firstStart;
+	const ThreadBuffer* buf = sMainThread;
+	uint32 written = buf->written.load(std::memory_order_acquire);
+	uint32 count = (written < RING_EVENTS) ? written : RING_EVENTS;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const Event& ev = buf->events[(written - 1 - i) % RING_EVENTS];
+		if (ev.start + ev.duration < sPrevFrameStart)
+			break;
+		if (ev.start < sPrevFrameStart || ev.start >= sFrameStart)
+			continue;
+
+		uint32 j = 0;
+		while (j < out.size() && !(out[j].name == ev.name && out[j].depth == ev.depth))
+			++j;
+		if (j == out.size())
+		{
+			Summary s;
+			s.name = ev.name;
+			s.depth = ev.depth;
+			s.time = 0;
+			s.count = 0;
+			out.push_back(s);
+			firstStart.push_back(ev.start);
+		}
+		out[j].time += ev.duration;
+		++out[j].count;
+		firstStart[j] = std::min(firstStart[j], ev.start);
+	}
+
+	std::vector<uint32> order(out.size());
+	for (uint32 i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](uint32 a, uint32 b)
+	{
+		return (firstStart[a] != firstStart[b]) ? firstStart[a] < firstStart[b] : out[a].depth < out[b].depth;
+	});
+
+	std::vector<Summary> sorted;
+	sorted.reserve(out.size());
+	for (uint32 i : order)
+		sorted.push_back(out[i]);
+	out.swap(sorted);
+}
+
+bool Profiler::exportTrace(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == nullptr)
+	{
+		printf("could not write %s\n", path);
+		return false;
+	}
+
+	std::vector<ThreadBuffer*> threads;
+	{
+		std::lock_guard<std::mutex> lock(sThreadMutex);
+		threads = sThreads;
+	}
+
+	//complete ("X") events, which chrome nests by their times; thread names go in metadata events
+	fprintf(fp, "{\"traceEvents\":[\n");
+	bool first = true;
+	uint32 total = 0;
+	std::vector<Event> events;
+	for (ThreadBuffer* buf : threads)
+	{
+		{
+			std::lock_guard<std::mutex> lock(sThreadMutex);
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", buf->id, buf->name.c_str());
+		}
+		first = false;
+
+		copyEvents(buf, events);
+		for (const Event& ev : events)
+		{
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%u}", ev.name, buf->id,
+				(unsigned long long)ev.start, ev.duration);
+		}
+		total += events.size();
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(fp);
+
+	printf("wrote %u profiler events from %u threads to %s\n", total, (uint32)threads.size(), path);
+	return true;
+}
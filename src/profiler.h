@@ -0,0 +1,114 @@
+
+#ifndef _ZEQ_PROFILER_H
+#define _ZEQ_PROFILER_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+#include "types.h"
+
+#ifdef _WIN32
+#define ZEQ_THREAD_LOCAL __declspec(thread)
+#else
+#define ZEQ_THREAD_LOCAL __thread
+#endif
+
+//times a block: PROFILE_SCOPE("Renderer::drawAll"); the name must be a string literal, only the pointer is kept
+#define PROFILE_SCOPE(name) ProfileScope _profileScope(name)
+
+//timed scopes, recorded into a ring per thread when they close; with recording off, a scope costs a check of a flag.
+//scopes nest, and their depth is kept so the trace and the overlay can show the hierarchy
+class Profiler
+{
+public:
+	struct Event
+	{
+		const char* name;
+		uint64 start; //microseconds, see now()
+		uint32 duration;
+		uint32 depth;
+	};
+
+	//one scope's share of the last frame, for the overlay
+	struct Summary
+	{
+		const char* name;
+		uint32 depth;
+		uint32 time; //microseconds
+		uint32 count;
+	};
+
+private:
+	static const uint32 RING_EVENTS = 1 << 16; //per thread
+
+	struct ThreadBuffer
+	{
+		uint32 id;
+		std::string name;
+		std::vector<Event> events;
+		std::atomic<uint32> written; //ever; the newest is at (written - 1) % RING_EVENTS
+		uint32 depth;
+	};
+
+	static std::atomic<bool> sEnabled; //read by every scope on every thread
+	static std::mutex sThreadMutex;
+	static std::vector<ThreadBuffer*> sThreads;
+	static ZEQ_THREAD_LOCAL ThreadBuffer* sThreadBuffer;
+	static ThreadBuffer* sMainThread;
+	static uint64 sFrameStart;
+	static uint64 sPrevFrameStart;
+
+private:
+	static ThreadBuffer* getThreadBuffer();
+	//the events of one thread, oldest first; ones being overwritten while this runs may come out garbled
+	static void copyEvents(ThreadBuffer* buf, std::vector<Event>& out);
+
+public:
+	//microseconds since startup, off the high-resolution counter
+	static uint64 now();
+
+	static void setEnabled(bool enabled) { sEnabled.store(enabled, std::memory_order_relaxed); }
+	static bool isEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+	//for the trace; the calling thread is named "main" by beginFrame, others get a number if they don't say
+	static void setThreadName(const char* name);
+
+	//used by ProfileScope
+	static uint64 enter();
+	static void leave(const char* name, uint64 start);
+
+	//main thread, once per frame
+	static void beginFrame();
+	//what the main thread's scopes took in the last whole frame, by when each first started, so scopes come before
+	//the ones nested in them
+	static void getLastFrame(std::vector<Summary>& out);
+	//everything still in the rings, as chrome://tracing json
+	static bool exportTrace(const char* path);
+};
+
+class ProfileScope
+{
+private:
+	const char* mName;
+	uint64 mStart;
+	bool mActive;
+
+public:
+	ProfileScope(const char* name) :
+		mName(name),
+		mStart(0),
+		mActive(Profiler::isEnabled())
+	{
+		if (mActive)
+			mStart = Profiler::enter();
+	}
+
+	~ProfileScope()
+	{
+		if (mActive)
+			Profiler::leave(mName, mStart);
+	}
+};
+
+#endif
@@ -0,0 +1,274 @@
+
+#include "region_map.h"
+#include "micro_timer.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+const uint32 RegionMap::NO_ZONE_LINE;
+
+RegionMap::RegionMap() :
+	mTree(nullptr)
+{
+
+}
+
+void RegionMap::clear()
+{
+	mTree = nullptr;
+	mRegionTypes.clear();
+	mRegionZoneLines.clear();
+	mBoxes.clear();
+	mNodes.clear();
+	mZoneLinePositions.clear();
+	mOffset.set(0.0f, 0.0f, 0.0f);
+}
+
+//value of the count digits at str, false if any of them isn't a digit
+static bool readDigits(const char* str, uint32 count, uint32& out)
+{
+	out = 0;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (!isdigit((byte)str[i]))
+			return false;
+		out = out * 10 + (str[i] - '0');
+	}
+	return true;
+}
+
+uint32 RegionMap::parseName(const char* name, uint32& zone_line)
+{
+	zone_line = NO_ZONE_LINE;
+	if (name == nullptr)
+		return 0;
+
+	//s3d names are upper case and eqg ones have been lowered by the ZON
+	char str[64];
+	uint32 len = 0;
+	while (name[len] && len < sizeof(str) - 1)
+	{
+		str[len] = (char)tolower((byte)name[len]);
+		++len;
+	}
+	str[len] = 0;
+
+	//eqg: a three letter code after an 'a'
+	if (strncmp(str, "awt", 3) == 0)
+		return WATER;
+	if (strncmp(str, "alv", 3) == 0)
+		return LAVA;
+	if (strncmp(str, "avw", 3) == 0)
+		return FREEZING_WATER;
+	if (strncmp(str, "apk", 3) == 0)
+		return PVP;
+	if (strncmp(str, "asl", 3) == 0)
+		return SLIPPERY;
+	if (strncmp(str, "atp", 3) == 0)
+		return ZONE_LINE;
+
+	//s3d
+	if (strncmp(str, "wt_", 3) == 0 || strncmp(str, "wtn_", 4) == 0)
+		return WATER;
+	if (strncmp(str, "la_", 3) == 0 || strncmp(str, "lan_", 4) == 0)
+		return LAVA;
+	if (strncmp(str, "sl_", 3) == 0 || strncmp(str, "sln_", 4) == 0)
+		return SLIME;
+	if (strncmp(str, "vwn_", 4) == 0)
+		return FREEZING_WATER;
+	if (strncmp(str, "drp_", 4) == 0)
+		return PVP;
+	if (strncmp(str, "drn_", 4) == 0)
+		return strstr(str, "_s_") ? SLIPPERY : 0;
+	if (strncmp(str, "drntp", 5) == 0)
+	{
+		//drntp, a 5 digit zone id, then either a target position or, for zone 255, a 6 digit zone point number
+		uint32 zone;
+		uint32 number;
+		if (readDigits(str + 5, 5, zone) && zone == 255 && readDigits(str + 10, 6, number))
+			zone_line = number;
+		return ZONE_LINE;
+	}
+
+	return 0;
+}
+
+void RegionMap::setTree(const ZoneRegions* tree)
+{
+	mTree = tree;
+	mRegionTypes.assign(tree->getRegionCount(), 0);
+	mRegionZoneLines.assign(tree->getRegionCount(), NO_ZONE_LINE);
+}
+
+void RegionMap::addRegionTypes(uint32 region, uint32 types, uint32 zone_line)
+{
+	if (region >= mRegionTypes.size())
+		return;
+
+	mRegionTypes[region] |= types;
+	if (zone_line != NO_ZONE_LINE)
+		mRegionZoneLines[region] = zone_line;
+}
+
+void RegionMap::addBox(const core::aabbox3df& box, uint32 types, uint32 zone_line)
+{
+	Box b;
+	b.box = box;
+	b.types = types;
+	b.zoneLine = zone_line;
+	mBoxes.push_back(b);
+}
+
+void RegionMap::addZoneLinePosition(uint32 zone_line, const core::vector3df& pos)
+{
+	mZoneLinePositions.push_back(std::make_pair(zone_line, pos));
+}
+
+void RegionMap::getZoneLinePositions(std::vector<std::pair<uint32, core::vector3df>>& out) const
+{
+	out.clear();
+	for (auto& line : mZoneLinePositions)
+		out.push_back(std::make_pair(line.first, line.second + mOffset));
+}
+
+void RegionMap::build()
+{
+	mNodes.clear();
+	if (mBoxes.empty())
+		return;
+
+	mNodes.reserve(mBoxes.size() * 2);
+	mNodes.push_back(Node());
+	buildNode(0, 0, mBoxes.size());
+}
+
+void RegionMap::buildNode(uint32 index, uint32 begin, uint32 end)
+{
+	core::aabbox3df bounds = mBoxes[begin].box;
+	for (uint32 i = begin + 1; i < end; ++i)
+		bounds.addInternalBox(mBoxes[i].box);
+	mNodes[index].box = bounds;
+
+	if (end - begin <= MAX_LEAF_BOXES)
+	{
+		mNodes[index].first = begin;
+		mNodes[index].count = end - begin;
+		return;
+	}
+
+	//median split on the longest axis; there are few boxes, nothing cleverer is needed
+	core::vector3df extent = bounds.getExtent();
+	int axis = (extent.X >= extent.Y && extent.X >= extent.Z) ? 0 : (extent.Y >= extent.Z ? 1 : 2);
+	uint32 mid = (begin + end) / 2;
+	std::nth_element(mBoxes.begin() + begin, mBoxes.begin() + mid, mBoxes.begin() + end, [axis](const Box& a, const Box& b)
+	{
+		core::vector3df ca = a.box.getCenter();
+		core::vector3df cb = b.box.getCenter();
+		return (axis == 0) ? ca.X < cb.X : ((axis == 1) ? ca.Y < cb.Y : ca.Z < cb.Z);
+	});
+
+	const uint32 left = mNodes.size();
+	mNodes.push_back(Node());
+	mNodes.push_back(Node());
+	mNodes[index].first = left;
+	mNodes[index].count = 0;
+
+	buildNode(left, begin, mid);
+	buildNode(left + 1, mid, end);
+}
+
+uint32 RegionMap::getTypes(const core::vector3df& world_pos, uint32* zone_line) const
+{
+	if (zone_line)
+		*zone_line = NO_ZONE_LINE;
+
+	//both the bsp tree and the boxes are in the zone mesh's own space
+	const core::vector3df pos = world_pos - mOffset;
+
+	if (mTree)
+	{
+		int32 region = mTree->findRegion(pos);
+		if (region < 0)
+			return 0;
+		if (zone_line)
+			*zone_line = mRegionZoneLines[region];
+		return mRegionTypes[region];
+	}
+
+	if (mNodes.empty())
+		return 0;
+
+	uint32 types = 0;
+	uint32 stack[64];
+	uint32 top = 0;
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		if (!node.box.isPointInside(pos))
+			continue;
+
+		if (node.count == 0)
+		{
+			if (top + 2 <= 64)
+			{
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+			}
+			continue;
+		}
+
+		for (uint32 i = node.first; i < node.first + node.count; ++i)
+		{
+			const Box& box = mBoxes[i];
+			if (!box.box.isPointInside(pos))
+				continue;
+			types |= box.types;
+			if (zone_line && *zone_line == NO_ZONE_LINE)
+				*zone_line = box.zoneLine;
+		}
+	}
+
+	return types;
+}
+
+uint64 RegionMap::getMemoryUsage() const
+{
+	return (uint64)(mRegionTypes.size() + mRegionZoneLines.size()) * sizeof(uint32) + (uint64)mBoxes.size() * sizeof(Box) +
+		(uint64)mNodes.size() * sizeof(Node);
+}
+
+void RegionMap::benchmark(uint32 lookups, const core::aabbox3df& bounds) const
+{
+	if (empty())
+		return;
+
+	Random rng;
+	std::uniform_real_distribution<float> rx(bounds.MinEdge.X, bounds.MaxEdge.X);
+	std::uniform_real_distribution<float> ry(bounds.MinEdge.Y, bounds.MaxEdge.Y);
+	std::uniform_real_distribution<float> rz(bounds.MinEdge.Z, bounds.MaxEdge.Z);
+
+	std::vector<core::vector3df> points(lookups);
+	for (core::vector3df& p : points)
+		p.set(rx(rng), ry(rng), rz(rng));
+
+	uint32 inside = 0;
+	uint32 liquid = 0;
+	MicroTimer timer;
+	for (const core::vector3df& p : points)
+	{
+		uint32 types = getTypes(p);
+		if (types)
+			++inside;
+		if (types & LIQUID)
+			++liquid;
+	}
+	uint32 time = timer.getElapsed();
+
+	printf("region map, %u lookups (%s): %.1f ns each, %.1f%% in a special region, %.1f%% in liquid\n", lookups,
+		mTree ? "bsp" : "boxes", lookups ? (double)time * 1000.0 / lookups : 0.0, 100.0 * inside / lookups,
+		100.0 * liquid / lookups);
+}
@@ -0,0 +1,96 @@
+
+#ifndef _ZEQ_REGION_MAP_H
+#define _ZEQ_REGION_MAP_H
+
+#include <irrlicht.h>
+
+#include <vector>
+#include <utility>
+
+#include "types.h"
+#include "zone_regions.h"
+
+using namespace irr;
+
+//answers which special areas (water, lava, zone lines...) contain a point: by descending the bsp tree in s3d zones,
+//where every region has its types, or through a small aabb tree over the region boxes of eqg zones
+class RegionMap
+{
+public:
+	enum Type
+	{
+		WATER = 1 << 0,
+		LAVA = 1 << 1,
+		SLIME = 1 << 2,
+		FREEZING_WATER = 1 << 3,
+		PVP = 1 << 4,
+		SLIPPERY = 1 << 5,
+		ZONE_LINE = 1 << 6
+	};
+
+	static const uint32 LIQUID = WATER | LAVA | SLIME | FREEZING_WATER;
+	static const uint32 NO_ZONE_LINE = 0xFFFFFFFF; //zone lines that lead straight to a zone rather than a zone point
+
+private:
+	static const uint32 MAX_LEAF_BOXES = 4;
+
+	struct Box
+	{
+		core::aabbox3df box;
+		uint32 types;
+		uint32 zoneLine;
+	};
+
+	//children of an interior node are adjacent, as in CollisionWorld
+	struct Node
+	{
+		core::aabbox3df box;
+		uint32 first; //leaf: first box, interior: left child
+		uint32 count; //boxes, 0 for interior nodes
+	};
+
+	//s3d: types of each bsp region, the tree itself belongs to the ZoneModel
+	const ZoneRegions* mTree;
+	std::vector<uint32> mRegionTypes;
+	std::vector<uint32> mRegionZoneLines;
+
+	//eqg
+	std::vector<Box> mBoxes;
+	std::vector<Node> mNodes;
+
+	std::vector<std::pair<uint32, core::vector3df>> mZoneLinePositions; //as read from the zone, without mOffset
+
+	core::vector3df mOffset; //where the zone mesh is placed in the world; the regions are read relative to it
+
+private:
+	void buildNode(uint32 index, uint32 begin, uint32 end);
+
+public:
+	RegionMap();
+
+	void clear();
+
+	//the type and zone point number named by a region; 0 for anything that isn't special
+	static uint32 parseName(const char* name, uint32& zone_line);
+
+	void setTree(const ZoneRegions* tree);
+	void setOffset(const core::vector3df& offset) { mOffset = offset; }
+	void addRegionTypes(uint32 region, uint32 types, uint32 zone_line);
+	void addBox(const core::aabbox3df& box, uint32 types, uint32 zone_line);
+	//once all boxes are in
+	void build();
+	//where the zone file puts a zone line, for whoever wants to know before the player gets there
+	void addZoneLinePosition(uint32 zone_line, const core::vector3df& pos);
+	//in world space
+	void getZoneLinePositions(std::vector<std::pair<uint32, core::vector3df>>& out) const;
+
+	//all the types of the regions containing pos, in world space; zone_line gets the first zone line's number
+	uint32 getTypes(const core::vector3df& world_pos, uint32* zone_line = nullptr) const;
+
+	bool empty() const { return mRegionTypes.empty() && mBoxes.empty(); }
+	uint64 getMemoryUsage() const;
+	//times lookups at random points in bounds
+	void benchmark(uint32 lookups, const core::aabbox3df& bounds) const;
+};
+
+#endif
@@ -1,20 +1,38 @@
 
 #include "renderer.h"
+#include "micro_timer.h"
+#include "random.h"
+#include "object_batcher.h"
+
+#include <cstring>
 
 extern Input gInput;
 extern MobManager gMobMgr;
 
 using namespace irr;
 
+const video::SColor Renderer::CLEAR_COLOR(255, 128, 128, 128);
+
 Renderer::Renderer() :
 	mDevice(nullptr),
 	mDriver(nullptr),
 	mSceneMgr(nullptr),
 	mCollisionMgr(nullptr),
 	mGUIDocument(nullptr),
-	mSleepMilliseconds(SLEEP_TIME_DEFAULT),
-	mPrevTime(0),
+	mTargetFPS(TARGET_FPS_DEFAULT),
+	mPrevFrameTime(0),
+	mSimulationTime(0),
+	mAnimatedTextureTime(0),
+	mProfile(false),
+	mHeadless(false),
+	mShowProfilerOverlay(false),
+	mUse32BitIndices(false),
+	mShowZoneWalls(false),
+	mMergeObjects(true),
+	mDrawDistance(0.0f),
+	mUseRegionVisibility(true),
 	mCollisionNode(nullptr),
+	mNonCollisionNode(nullptr),
 	mActiveZoneModel(nullptr)
 {
 
@@ -32,7 +50,29 @@ void Renderer::initialize()
 
 	p.EventReceiver = &gInput;
 
-	mDevice = createDevice(p, Lua::getConfigString(CONFIG_VAR_RENDERER, ""));
+	mMainThreadID = std::this_thread::get_id();
+	mShowZoneWalls = Lua::getConfigBool(CONFIG_VAR_SHOW_ZONE_WALLS, false);
+	mMergeObjects = Lua::getConfigBool(CONFIG_VAR_MERGE_ZONE_OBJECTS, true);
+	mDrawDistance = (float)core::max_(Lua::getConfigInt(CONFIG_VAR_DRAW_DISTANCE, 0), 0);
+	mUseRegionVisibility = Lua::getConfigBool(CONFIG_VAR_USE_REGION_VISIBILITY, true);
+	mTargetFPS = (uint32)core::max_(Lua::getConfigInt(CONFIG_VAR_TARGET_FPS, TARGET_FPS_DEFAULT), 0);
+	mProfile = Lua::getConfigBool(CONFIG_VAR_PROFILER, false);
+	Profiler::setEnabled(mProfile);
+
+	if (mHeadless)
+	{
+		//the console device doesn't open a window, and the null driver takes geometry and textures without drawing them
+		p.DeviceType = EIDT_CONSOLE;
+		p.DriverType = video::EDT_NULL;
+		p.Vsync = false;
+		mDevice = createDeviceEx(p);
+		if (mDevice == nullptr)
+			throw ZEQException("Renderer::initialize: could not create headless device");
+	}
+	else
+	{
+		mDevice = createDevice(p, Lua::getConfigString(CONFIG_VAR_RENDERER, ""));
+	}
 
 	if (mDevice)
 	{
@@ -42,6 +82,21 @@ void Renderer::initialize()
 		mSceneMgr = mDevice->getSceneManager();
 		mCollisionMgr = mSceneMgr->getSceneCollisionManager();
 
+		//MaxIndices is really the highest index value the card accepts; the null driver reports -1 for unlimited
+		uint32 maxIndices = (uint32)mDriver->getDriverAttributes().getAttributeAsInt("MaxIndices");
+		mUse32BitIndices = Lua::getConfigBool(CONFIG_VAR_USE_32BIT_INDICES, true) && maxIndices > 65535;
+
+		//geometry fades into the background colour over the last quarter of the draw distance, then is clipped;
+		//the override turns fog on for everything drawn in the scene passes, mobs included
+		if (mDrawDistance > 0.0f)
+		{
+			mDriver->setFog(CLEAR_COLOR, video::EFT_FOG_LINEAR, mDrawDistance * 0.75f, mDrawDistance);
+			video::SOverrideMaterial& fog = mDriver->getOverrideMaterial();
+			fog.Material.FogEnable = true;
+			fog.EnableFlags |= video::EMF_FOG_ENABLE;
+			fog.EnablePasses |= scene::ESNRP_SOLID | scene::ESNRP_TRANSPARENT;
+		}
+
 		//rocket
 		mGUIRenderer->setIsDirectX(isDirectX());
 		mGUIContext = Lua::initGUI(
@@ -68,6 +123,8 @@ void Renderer::initializeGUI()
 
 void Renderer::close()
 {
+	mFrameLimiter.printStats();
+
 	if (mDevice)
 	{
 		mDevice->drop();
@@ -121,11 +178,21 @@ IrrlichtDevice* Renderer::createDevice(SIrrlichtCreationParameters& params, std:
 	throw ZEQException("Renderer::createDevice: could not create render device");
 }
 
+//decoding happens on the calling thread, only the upload to the driver is passed to the main thread
 video::ITexture* Renderer::createTexture(MemoryStream* file, std::string name, bool& isDDS)
 {
 	byte* data = file->getData();
 	unsigned long len = file->length();
 
+	//nothing is going to be drawn, so don't decode anything; materials still get a texture of the right name
+	if (mHeadless)
+	{
+		isDDS = len >= 4 && memcmp(data, "DDS ", 4) == 0;
+		video::ITexture* tex = nullptr;
+		runOnMainThread([&]() { tex = mDriver->addTexture(core::dimension2du(1, 1), name.c_str()); });
+		return tex;
+	}
+
 	FIMEMORY* fi_mem = FreeImage_OpenMemory(data, len);
 	FREE_IMAGE_FORMAT fmt = FreeImage_GetFileTypeFromMemory(fi_mem);
 
@@ -140,7 +207,7 @@ video::ITexture* Renderer::createTexture(MemoryStream* file, std::string name, b
 			FreeImage_GetBits(bitmap), false, true);
 		FreeImage_Unload(bitmap);
 
-		tex = mDriver->addTexture(name.c_str(), img);
+		runOnMainThread([&]() { tex = mDriver->addTexture(name.c_str(), img); });
 	}
 	else if (fmt == FIF_BMP)
 	{
@@ -172,12 +239,13 @@ video::ITexture* Renderer::createTexture(MemoryStream* file, std::string name, b
 		}
 
 		FreeImage_Unload(bitmap);
-		tex = mDriver->addTexture(name.c_str(), img);
+		runOnMainThread([&]() { tex = mDriver->addTexture(name.c_str(), img); });
 	}
 	else
 	{
+		//irrlicht decodes these itself, as part of creating the texture
 		IrrTextureFile* file = new IrrTextureFile(name.c_str(), data, len);
-		tex = mDriver->getTexture(file);
+		runOnMainThread([&]() { tex = mDriver->getTexture(file); });
 		file->drop();
 	}
 
@@ -199,56 +267,218 @@ void Renderer::destroyTexture(video::ITexture* tex)
 	mDriver->removeTexture(tex);
 }
 
+void Renderer::retainTexture(video::ITexture* tex)
+{
+	std::lock_guard<std::mutex> lock(mTextureRefMutex);
+	++mTextureRefs[tex];
+}
+
+void Renderer::releaseTexture(video::ITexture* tex)
+{
+	{
+		std::lock_guard<std::mutex> lock(mTextureRefMutex);
+		auto it = mTextureRefs.find(tex);
+		if (it == mTextureRefs.end() || --it->second > 0)
+			return;
+		mTextureRefs.erase(it);
+	}
+
+	destroyTexture(tex);
+}
+
 Camera* Renderer::createCamera(bool bind)
 {
 	scene::ICameraSceneNode* node = mSceneMgr->addCameraSceneNode();
 	node->bindTargetAndRotation(bind);
+	if (mDrawDistance > 0.0f)
+		node->setFarValue(mDrawDistance);
 	return new Camera(node);
 }
 
-float Renderer::loopStep()
+float Renderer::loopStep(const std::function<void(float)>& simulate)
 {
-	if (mDevice->run() && mDevice->isWindowActive() && mDevice->isWindowFocused())
-	{
-		mDriver->beginScene(true, true, video::SColor(255, 128, 128, 128));
-		mSceneMgr->drawAll();
-
-		mGUIContext->Update();
-		mGUIContext->Render();
+	Profiler::beginFrame();
 
-		mDriver->endScene();
+	{
+		PROFILE_SCOPE("Renderer::processMainThreadCalls");
+		processMainThreadCalls();
+	}
 
-		mDevice->sleep(mSleepMilliseconds);
+	//simulating before drawing shows input on the frame it was read
+	mSimulationTime += mPrevFrameTime;
+	uint32 steps = mSimulationTime / SIMULATION_STEP;
+	if (steps > MAX_SIMULATION_STEPS)
+	{
+		steps = MAX_SIMULATION_STEPS;
+		mSimulationTime = 0;
 	}
 	else
 	{
-		mDevice->sleep(100);
+		mSimulationTime -= steps * SIMULATION_STEP;
 	}
 
-	uint32 time = mDevice->getTimer()->getTime();
-	uint32 delta = time - mPrevTime;
-	mPrevTime = time;
+	const float step = (float)SIMULATION_STEP * 0.000001f;
+	for (uint32 i = 0; i < steps; ++i)
+	{
+		PROFILE_SCOPE("simulation step");
+		//mob movement between position updates
+		gMobMgr.updateMotion(step);
+		if (simulate)
+			simulate(step);
+	}
 
-	//animated textures
+	//animation clocks go by the real frame time, whole steps would make them judder whenever a frame isn't one step long;
+	//after a long stall they skip ahead no further than the simulation does
+	uint32 animated = core::min_(mPrevFrameTime, MAX_SIMULATION_STEPS * SIMULATION_STEP);
 	if (!mAnimatedTextures.empty())
-		checkAnimatedTextures(delta);
+	{
+		PROFILE_SCOPE("Renderer::checkAnimatedTextures");
+		mAnimatedTextureTime += animated;
+		checkAnimatedTextures(mAnimatedTextureTime / 1000);
+		mAnimatedTextureTime %= 1000;
+	}
+	//wld skeleton animation
+	{
+		PROFILE_SCOPE("MobManager::animateNearbyMobs");
+		gMobMgr.animateNearbyMobs((float)animated * 0.000001f);
+	}
 
-	float delta_f = (float)delta * 0.001f;
+	bool running = mDevice->run();
+	if (mHeadless)
+	{
+		//interrupted, from the console
+		if (!running)
+			throw ExitException();
+
+		//drawAll would update the nodes' absolute positions, which the camera and mob queries go by
+		PROFILE_SCOPE("ISceneNode::OnAnimate");
+		mSceneMgr->getRootSceneNode()->OnAnimate(mDevice->getTimer()->getTime());
+		mPrevFrameTime = mFrameLimiter.endFrame(mTargetFPS);
+		return (float)mPrevFrameTime * 0.000001f;
+	}
 
-	//wld skeleton animation
-	gMobMgr.animateNearbyMobs(delta_f);
+	bool active = running && mDevice->isWindowActive() && mDevice->isWindowFocused();
+	if (active)
+	{
+		PROFILE_SCOPE("Renderer::draw");
+		mDriver->beginScene(true, true, CLEAR_COLOR);
+		{
+			PROFILE_SCOPE("ISceneManager::drawAll");
+			mSceneMgr->drawAll();
+		}
+
+		{
+			PROFILE_SCOPE("Rocket::Context::Update");
+			mGUIContext->Update();
+		}
+		{
+			PROFILE_SCOPE("Rocket::Context::Render");
+			mGUIContext->Render();
+		}
+
+		if (mShowProfilerOverlay)
+			drawProfilerOverlay();
+
+		{
+			PROFILE_SCOPE("IVideoDriver::endScene");
+			mDriver->endScene();
+		}
+	}
+
+	//nothing is drawn while the window is in the background, but the network and loading still need servicing
+	PROFILE_SCOPE("FrameLimiter::endFrame");
+	mPrevFrameTime = mFrameLimiter.endFrame(active ? mTargetFPS : UNFOCUSED_FPS);
+	return (float)mPrevFrameTime * 0.000001f;
+}
+
+void Renderer::toggleProfilerOverlay()
+{
+	mShowProfilerOverlay = !mShowProfilerOverlay;
+	Profiler::setEnabled(mProfile || mShowProfilerOverlay);
+}
+
+void Renderer::drawProfilerOverlay()
+{
+	gui::IGUIFont* font = mDevice->getGUIEnvironment()->getBuiltInFont();
+	if (font == nullptr)
+		return;
+
+	Profiler::getLastFrame(mProfilerFrame);
+
+	static const int32 LINE_HEIGHT = 12;
+	static const int32 WIDTH = 360;
+	const int32 height = (mProfilerFrame.size() + 1) * LINE_HEIGHT + 8;
+	mDriver->draw2DRectangle(video::SColor(160, 0, 0, 0), core::recti(4, 4, 4 + WIDTH, 4 + height));
+
+	char line[256];
+	snprintf(line, sizeof(line), "last frame: %.2f ms", (float)mPrevFrameTime * 0.001f);
+	int32 y = 8;
+	font->draw(core::stringw(line), core::recti(8, y, WIDTH, y + LINE_HEIGHT), video::SColor(255, 255, 255, 255));
+
+	for (const Profiler::Summary& s : mProfilerFrame)
+	{
+		y += LINE_HEIGHT;
+		if (s.count > 1)
+			snprintf(line, sizeof(line), "%*s%s  %.2f ms (%u)", s.depth * 2, "", s.name, (float)s.time * 0.001f, s.count);
+		else
+			snprintf(line, sizeof(line), "%*s%s  %.2f ms", s.depth * 2, "", s.name, (float)s.time * 0.001f);
+		font->draw(core::stringw(line), core::recti(8, y, WIDTH, y + LINE_HEIGHT), video::SColor(255, 255, 255, 255));
+	}
+}
+
+void Renderer::runOnMainThread(const std::function<void()>& func)
+{
+	if (std::this_thread::get_id() == mMainThreadID)
+	{
+		func();
+		return;
+	}
+
+	bool done = false;
+	MainThreadCall call;
+	call.func = &func;
+	call.done = &done;
+
+	std::unique_lock<std::mutex> lock(mMainThreadCallMutex);
+	mMainThreadCalls.push_back(call);
+	while (!done)
+		mMainThreadCallsDone.wait(lock);
+}
+
+void Renderer::processMainThreadCalls()
+{
+	std::vector<MainThreadCall> calls;
+	{
+		std::lock_guard<std::mutex> lock(mMainThreadCallMutex);
+		if (mMainThreadCalls.empty())
+			return;
+		calls.swap(mMainThreadCalls);
+	}
+
+	for (MainThreadCall& call : calls)
+		(*call.func)();
 
-	return delta_f;
+	{
+		std::lock_guard<std::mutex> lock(mMainThreadCallMutex);
+		for (MainThreadCall& call : calls)
+			*call.done = true;
+	}
+	mMainThreadCallsDone.notify_all();
 }
 
 void Renderer::resetInternalTimer()
 {
-	mDevice->getTimer()->setTime(0);
+	mFrameLimiter.reset();
+	mPrevFrameTime = 0;
+	mSimulationTime = 0;
+	mAnimatedTextureTime = 0;
 }
 
 void Renderer::useZoneModel(ZoneModel* zoneModel)
 {
+	PROFILE_SCOPE("Renderer::useZoneModel");
 	mSceneMgr->clear();
+	mAnimatedTextures.clear();
 	if (isOpenGL())
 		mSceneMgr->getParameters()->setAttribute(scene::ALLOW_ZWRITE_ON_TRANSPARENT, true); 
 
@@ -259,62 +489,359 @@ void Renderer::useZoneModel(ZoneModel* zoneModel)
 		animTexturesTemp.push_back(animTex);
 	}
 
-	//main zone geometry
+	//main zone geometry, in chunks that are culled against the view and draw distance buffer by buffer
+	//collision goes through the zone model's CollisionWorld rather than triangle selectors
 	core::vector3df pos(zoneModel->getX(), zoneModel->getY(), zoneModel->getZ());
-	mCollisionNode = mSceneMgr->addOctreeSceneNode(zoneModel->getMesh());
-	mCollisionNode->setPosition(pos);
-	scene::ITriangleSelector* sel = mSceneMgr->createOctreeTriangleSelector(zoneModel->getMesh(), mCollisionNode);
-	mCollisionNode->setTriangleSelector(sel);
-	mCollisionSelector = sel;
-	sel->drop();
-
-	scene::IMeshSceneNode* noncollision_node = mSceneMgr->addOctreeSceneNode(zoneModel->getNonCollisionMesh());
-	noncollision_node->setPosition(pos);
+	mCollisionNode = new ZoneSceneNode(zoneModel->getMesh()->getMesh(0), mSceneMgr->getRootSceneNode(), mSceneMgr);
+	mNonCollisionNode = new ZoneSceneNode(zoneModel->getNonCollisionMesh()->getMesh(0), mSceneMgr->getRootSceneNode(), mSceneMgr);
+	ZoneSceneNode* zoneNodes[2] = { mCollisionNode, mNonCollisionNode };
+	for (ZoneSceneNode* node : zoneNodes)
+	{
+		node->setDrawDistance(mDrawDistance);
+		node->setUseRegions(mUseRegionVisibility);
+		node->setPosition(pos);
+		node->drop(); //the scene manager holds them
+	}
+	mCollisionNode->setRegions(&zoneModel->getRegions(), zoneModel->getBufferGroups());
+	mNonCollisionNode->setRegions(&zoneModel->getRegions(), zoneModel->getNonCollisionBufferGroups());
 
 	mSceneMgr->setAmbientLight(video::SColorf(1, 1, 1, 1));
-	mCollisionNode->setPosition(core::vector3df(zoneModel->getX(), zoneModel->getY(), zoneModel->getZ()));
 
 	//update animated texture with target scene node, if applicable
 	scene::IMesh* mesh = zoneModel->getMesh()->getMesh(0);
 	scene::IMesh* noncollision_mesh = zoneModel->getNonCollisionMesh()->getMesh(0);
 	for (AnimatedTexture& animTex : animTexturesTemp)
 	{
-		if (animTex.replaceMeshWithSceneNode(mesh, mCollisionNode) ||
-			animTex.replaceMeshWithSceneNode(noncollision_mesh, noncollision_node))
+		if (animTex.replaceMeshWithSceneNode(mesh, (scene::ISceneNode*)mCollisionNode) ||
+			animTex.replaceMeshWithSceneNode(noncollision_mesh, (scene::ISceneNode*)mNonCollisionNode))
 			mAnimatedTextures.push_back(animTex);
 	}
 
-	//placed objects
+	printf("zone geometry: %u buffers in chunks, draw distance %g%s\n",
+		mCollisionNode->getBufferCount() + mNonCollisionNode->getBufferCount(), mDrawDistance,
+		(mUseRegionVisibility && !zoneModel->getRegions().empty()) ? ", culled by region" : "");
+
+	//placed objects: static ones are merged into per-cell batches, those with animated textures keep their own node
+	//so that the texture can be swapped on it
+	ObjectBatcher batcher;
+	uint32 objectNodes = 0;
+	uint32 objectDrawCalls = 0;
+	uint32 unbatchedDrawCalls = 0;
 	for (const ObjectPlacement& obj : zoneModel->getObjectPlacements())
 	{
+		scene::IMesh* mesh = obj.mesh->getMesh(0);
+		unbatchedDrawCalls += mesh->getMeshBufferCount();
+
+		bool animated = false;
+		for (AnimatedTexture& animTex : animTexturesTemp)
+		{
+			if (animTex.checkMesh(mesh))
+			{
+				animated = true;
+				break;
+			}
+		}
+
+		if (mMergeObjects && !animated && batcher.add(obj))
+			continue;
+
 		scene::IAnimatedMeshSceneNode* objNode = mSceneMgr->addAnimatedMeshSceneNode(obj.mesh, mCollisionNode, -1,
 			core::vector3df(obj.x, obj.y, obj.z),
 			core::vector3df(obj.rotX, obj.rotY, obj.rotZ),
 			core::vector3df(obj.scaleX, obj.scaleY, obj.scaleZ));
-
-		if (obj.collidable)
-		{
-			sel = mSceneMgr->createTriangleSelector(objNode);
-			objNode->setTriangleSelector(sel);
-			sel->drop();
-		}
+		++objectNodes;
+		objectDrawCalls += mesh->getMeshBufferCount();
 
 		//update animated texture with target scene node, if applicable
-		scene::IMesh* mesh = obj.mesh->getMesh(0);
 		for (AnimatedTexture& animTex : animTexturesTemp)
 		{
 			if (animTex.checkMesh(mesh))
 			{
 				AnimatedTexture copy = animTex;
-				copy.setMeshPtr(objNode);
+				copy.setMeshPtr((scene::ISceneNode*)objNode);
 				mAnimatedTextures.push_back(copy);
 			}
 		}
 	}
 
+	uint32 batched = batcher.getObjectCount();
+	std::vector<scene::ISceneNode*> batchNodes;
+	objectDrawCalls += batcher.createNodes(mSceneMgr, mCollisionNode, batchNodes);
+	objectNodes += batchNodes.size();
+
+	printf("zone objects: %u placed, %u merged into %u cell nodes; %u nodes and %u draw calls, %u nodes and %u draw calls unmerged\n",
+		(uint32)zoneModel->getObjectPlacements().size(), batched, (uint32)batchNodes.size(), objectNodes, objectDrawCalls,
+		(uint32)zoneModel->getObjectPlacements().size(), unbatchedDrawCalls);
+
 	mActiveZoneModel = zoneModel;
 }
 
+void Renderer::benchmarkObjectBatching(uint32 frames)
+{
+	if (mActiveZoneModel == nullptr)
+		return;
+
+	//a fixed view from the middle of the zone at standing height, drawn as fast as possible
+	core::aabbox3df bounds = mActiveZoneModel->getCollision().getBoundingBox();
+	core::vector3df eye = bounds.getCenter();
+	float floorY;
+	if (mActiveZoneModel->getFloorMap().getFloorHeight(eye.X, bounds.MaxEdge.Y, eye.Z, floorY))
+		eye.Y = floorY + 5.0f;
+
+	bool merge = mMergeObjects;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		mMergeObjects = (pass == 1);
+		useZoneModel(mActiveZoneModel);
+
+		scene::ICameraSceneNode* cam = mSceneMgr->addCameraSceneNode(nullptr, eye, eye + core::vector3df(0.0f, 0.0f, 100.0f));
+		cam->setFarValue(core::max_(bounds.getExtent().X, bounds.getExtent().Z));
+
+		uint32 nodes = 0;
+		std::vector<scene::ISceneNode*> stack(1, mSceneMgr->getRootSceneNode());
+		while (!stack.empty())
+		{
+			scene::ISceneNode* node = stack.back();
+			stack.pop_back();
+			++nodes;
+			for (scene::ISceneNode* child : node->getChildren())
+				stack.push_back(child);
+		}
+
+		//a few frames to settle buffer uploads first
+		for (uint32 i = 0; i < 10; ++i)
+		{
+			mDriver->beginScene(true, true, CLEAR_COLOR);
+			mSceneMgr->drawAll();
+			mDriver->endScene();
+		}
+
+		MicroTimer timer;
+		for (uint32 i = 0; i < frames; ++i)
+		{
+			mDevice->run();
+			mDriver->beginScene(true, true, CLEAR_COLOR);
+			mSceneMgr->drawAll();
+			mDriver->endScene();
+		}
+		uint32 time = timer.getElapsed();
+
+		printf("%s objects: %u scene nodes, %.3f ms/frame over %u frames\n", mMergeObjects ? "merged" : "unmerged",
+			nodes, (double)time / 1000.0 / frames, frames);
+	}
+
+	mMergeObjects = merge;
+	useZoneModel(mActiveZoneModel);
+}
+
+void Renderer::benchmarkRegionVisibility(uint32 samples)
+{
+	if (mActiveZoneModel == nullptr || mActiveZoneModel->getRegions().empty())
+		return;
+
+	const ZoneRegions& regions = mActiveZoneModel->getRegions();
+	core::aabbox3df bounds = mActiveZoneModel->getCollision().getBoundingBox();
+	core::vector3df zonePos(mActiveZoneModel->getX(), mActiveZoneModel->getY(), mActiveZoneModel->getZ());
+	Random rng;
+	std::uniform_real_distribution<float> rx(bounds.MinEdge.X, bounds.MaxEdge.X);
+	std::uniform_real_distribution<float> rz(bounds.MinEdge.Z, bounds.MaxEdge.Z);
+	std::uniform_real_distribution<float> yaw(0.0f, core::PI * 2.0f);
+
+	//standing height above a floor somewhere in the zone, in some region, looking any way
+	std::vector<core::vector3df> eyes;
+	std::vector<core::vector3df> targets;
+	for (uint32 tries = 0; eyes.size() < samples && tries < samples * 20; ++tries)
+	{
+		float x = rx(rng);
+		float z = rz(rng);
+		float floorY;
+		if (!mActiveZoneModel->getFloorMap().getFloorHeight(x, bounds.MaxEdge.Y, z, floorY))
+			continue;
+		core::vector3df eye(x, floorY + 5.0f, z);
+		if (regions.findRegion(eye - zonePos) < 0)
+			continue;
+		float a = yaw(rng);
+		eyes.push_back(eye);
+		targets.push_back(eye + core::vector3df(sinf(a), 0.0f, cosf(a)) * 100.0f);
+	}
+
+	if (eyes.empty())
+		return;
+
+	scene::ICameraSceneNode* prevCam = mSceneMgr->getActiveCamera();
+	scene::ICameraSceneNode* cam = mSceneMgr->addCameraSceneNode(nullptr, eyes[0], targets[0]);
+	if (mDrawDistance > 0.0f)
+		cam->setFarValue(mDrawDistance);
+	else
+		cam->setFarValue(core::max_(bounds.getExtent().X, bounds.getExtent().Z));
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const bool useRegions = (pass == 1);
+		mCollisionNode->setUseRegions(useRegions);
+		mNonCollisionNode->setUseRegions(useRegions);
+
+		uint64 triangles = 0;
+		uint32 time = 0;
+		for (uint32 i = 0; i < eyes.size(); ++i)
+		{
+			cam->setPosition(eyes[i]);
+			cam->setTarget(targets[i]);
+			cam->updateAbsolutePosition();
+
+			MicroTimer timer;
+			mDriver->beginScene(true, true, CLEAR_COLOR);
+			mSceneMgr->drawAll();
+			mDriver->endScene();
+			time += timer.getElapsed();
+
+			triangles += mCollisionNode->getVisibleTriangleCount() + mNonCollisionNode->getVisibleTriangleCount();
+		}
+
+		printf("%s region visibility: %.0f zone triangles drawn on average, %.3f ms/frame over %u views\n",
+			useRegions ? "with" : "without", (double)triangles / eyes.size(), (double)time / 1000.0 / eyes.size(),
+			(uint32)eyes.size());
+	}
+
+	mCollisionNode->setUseRegions(mUseRegionVisibility);
+	mNonCollisionNode->setUseRegions(mUseRegionVisibility);
+	cam->remove();
+	mSceneMgr->setActiveCamera(prevCam);
+}
+
+CollisionWorld* Renderer::getCollisionWorld()
+{
+	if (mActiveZoneModel == nullptr)
+		return nullptr;
+	return &mActiveZoneModel->getCollision();
+}
+
+FloorMap* Renderer::getFloorMap()
+{
+	if (mActiveZoneModel == nullptr)
+		return nullptr;
+	return &mActiveZoneModel->getFloorMap();
+}
+
+RegionMap* Renderer::getRegionMap()
+{
+	if (mActiveZoneModel == nullptr)
+		return nullptr;
+	return &mActiveZoneModel->getRegionMap();
+}
+
+void Renderer::benchmarkCollision(uint32 rays)
+{
+	static const float DROP_LENGTH = 5000.0f; //as used by Player::applyGravity
+	static const float WALK_LENGTH = 200.0f;
+
+	if (mActiveZoneModel == nullptr)
+		return;
+
+	const CollisionWorld& world = mActiveZoneModel->getCollision();
+	core::aabbox3df bounds = world.getBoundingBox();
+
+	//the scene collision path as it used to be set up: an octree selector on the zone node
+	//and a plain selector on a node for each collidable placed object
+	scene::ITriangleSelector* sel;
+	if (!hasLargeIndexBuffers(mActiveZoneModel->getMesh()->getMesh(0)))
+	{
+		sel = mSceneMgr->createOctreeTriangleSelector(mActiveZoneModel->getMesh()->getMesh(0), mCollisionNode);
+	}
+	else
+	{
+		scene::SMesh* collision_mesh = createCollisionMesh(mActiveZoneModel->getMesh()->getMesh(0));
+		sel = mSceneMgr->createOctreeTriangleSelector(collision_mesh, mCollisionNode);
+		collision_mesh->drop();
+	}
+	mCollisionNode->setTriangleSelector(sel);
+	sel->drop();
+
+	std::vector<scene::ISceneNode*> objNodes;
+	for (const ObjectPlacement& obj : mActiveZoneModel->getObjectPlacements())
+	{
+		if (!obj.collidable)
+			continue;
+
+		scene::IAnimatedMeshSceneNode* objNode = mSceneMgr->addAnimatedMeshSceneNode(obj.mesh, mCollisionNode, -1,
+			core::vector3df(obj.x, obj.y, obj.z),
+			core::vector3df(obj.rotX, obj.rotY, obj.rotZ),
+			core::vector3df(obj.scaleX, obj.scaleY, obj.scaleZ));
+		sel = mSceneMgr->createTriangleSelector(objNode);
+		objNode->setTriangleSelector(sel);
+		sel->drop();
+		objNodes.push_back(objNode);
+	}
+
+	mCollisionNode->updateAbsolutePosition();
+	for (scene::ISceneNode* node : objNodes)
+		node->updateAbsolutePosition();
+
+	//half straight down like gravity, half short and level like walking
+	Random rng;
+	std::uniform_real_distribution<float> rx(bounds.MinEdge.X, bounds.MaxEdge.X);
+	std::uniform_real_distribution<float> ry(bounds.MinEdge.Y, bounds.MaxEdge.Y);
+	std::uniform_real_distribution<float> rz(bounds.MinEdge.Z, bounds.MaxEdge.Z);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * core::PI);
+
+	std::vector<core::line3df> lines;
+	for (uint32 i = 0; i < rays; ++i)
+	{
+		core::vector3df start(rx(rng), ry(rng), rz(rng));
+		core::vector3df end = start;
+		if (i & 1)
+		{
+			float a = angle(rng);
+			end += core::vector3df(cosf(a), 0.0f, sinf(a)) * WALK_LENGTH;
+		}
+		else
+		{
+			end.Y -= DROP_LENGTH;
+		}
+		lines.push_back(core::line3df(start, end));
+	}
+
+	std::vector<float> irrHits(rays, -1.0f);
+	MicroTimer irrTimer;
+	for (uint32 i = 0; i < rays; ++i)
+	{
+		core::vector3df point;
+		core::triangle3df tri;
+		if (mCollisionMgr->getSceneNodeAndCollisionPointFromRay(lines[i], point, tri))
+			irrHits[i] = point.getDistanceFrom(lines[i].start);
+	}
+	uint32 irrTime = irrTimer.getElapsed();
+
+	std::vector<float> bvhHits(rays, -1.0f);
+	MicroTimer bvhTimer;
+	for (uint32 i = 0; i < rays; ++i)
+	{
+		CollisionHit hit;
+		if (world.segment(lines[i].start, lines[i].end, hit))
+			bvhHits[i] = hit.distance;
+	}
+	uint32 bvhTime = bvhTimer.getElapsed();
+
+	uint32 agree = 0;
+	uint32 hits = 0;
+	for (uint32 i = 0; i < rays; ++i)
+	{
+		if (bvhHits[i] >= 0.0f)
+			++hits;
+		if ((irrHits[i] < 0.0f) == (bvhHits[i] < 0.0f) && fabsf(irrHits[i] - bvhHits[i]) < 0.1f)
+			++agree;
+	}
+
+	mCollisionNode->setTriangleSelector(nullptr);
+	for (scene::ISceneNode* node : objNodes)
+		node->remove();
+
+	printf("collision, %u rays (%u hit):\n", rays, hits);
+	printf("  scene collision manager %.2f us/ray\n", (double)irrTime / rays);
+	printf("  collision world %.2f us/ray (%.1fx), %u/%u results agree\n", (double)bvhTime / rays,
+		bvhTime ? (double)irrTime / bvhTime : 0.0, agree, rays);
+}
+
 void Renderer::checkAnimatedTextures(uint32 delta)
 {
 	for (AnimatedTexture& animTex : mAnimatedTextures)
@@ -356,6 +883,62 @@ scene::SMesh* Renderer::copyMesh(scene::SMesh* mesh)
 	return copy;
 }
 
+bool Renderer::hasLargeIndexBuffers(scene::IMesh* mesh)
+{
+	for (uint32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+	{
+		if (mesh->getMeshBuffer(i)->getIndexType() == video::EIT_32BIT)
+			return true;
+	}
+	return false;
+}
+
+scene::SMesh* Renderer::createCollisionMesh(scene::IMesh* mesh)
+{
+	//only positions matter for collision, so triangles are simply unrolled into 16-bit buffers
+	static const uint32 MAX_INDICES = 65535; //multiple of 3
+	scene::SMesh* copy = new scene::SMesh;
+
+	for (uint32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+	{
+		scene::IMeshBuffer* buf = mesh->getMeshBuffer(i);
+		const uint32 count = buf->getIndexCount();
+
+		if (buf->getIndexType() == video::EIT_16BIT)
+		{
+			//selectors can read this one as it is
+			copy->addMeshBuffer(buf);
+			continue;
+		}
+
+		const uint32* indices = (uint32*)buf->getIndices();
+
+		for (uint32 start = 0; start < count; start += MAX_INDICES)
+		{
+			uint32 n = count - start;
+			if (n > MAX_INDICES)
+				n = MAX_INDICES;
+
+			scene::SMeshBuffer* copyBuf = new scene::SMeshBuffer;
+			copyBuf->Vertices.set_used(n);
+			copyBuf->Indices.set_used(n);
+
+			for (uint32 j = 0; j < n; ++j)
+			{
+				copyBuf->Vertices[j].Pos = buf->getPosition(indices[start + j]);
+				copyBuf->Indices[j] = (uint16)j;
+			}
+
+			copyBuf->recalculateBoundingBox();
+			copy->addMeshBuffer(copyBuf);
+			copyBuf->drop();
+		}
+	}
+	copy->recalculateBoundingBox();
+
+	return copy;
+}
+
 void Renderer::loadGUI(GUIType guiType)
 {
 	if (mGUIDocument)
@@ -10,23 +10,36 @@
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 #include "memory_stream.h"
 #include "input.h"
 #include "exception.h"
 #include "zone_model.h"
+#include "zone_scene_node.h"
 #include "camera.h"
 #include "animated_texture.h"
 #include "mob_manager.h"
 #include "wld_skeleton.h"
 #include "zeq_lua.h"
+#include "frame_limiter.h"
+#include "profiler.h"
 
 using namespace irr;
 
 class Renderer
 {
 private:
-	static const uint32 SLEEP_TIME_DEFAULT = 20; //milliseconds
+	static const uint32 TARGET_FPS_DEFAULT = 60;
+	static const uint32 UNFOCUSED_FPS = 10;
+	//movement, gravity and mob motion advance in steps of this many microseconds, whatever the frame rate
+	static const uint32 SIMULATION_STEP = 16667;
+	static const uint32 MAX_SIMULATION_STEPS = 8; //per frame; past that, time is dropped rather than caught up on
+	static const video::SColor CLEAR_COLOR; //also the fog colour
 
 private:
 	IrrlichtDevice* mDevice;
@@ -38,21 +51,55 @@ private:
 	Rocket::Core::Context* mGUIContext;
 	Rocket::Core::ElementDocument* mGUIDocument;
 
-	uint32 mSleepMilliseconds;
-	uint32 mPrevTime;
-
-	scene::IMeshSceneNode* mCollisionNode;
-	scene::ITriangleSelector* mCollisionSelector;
+	FrameLimiter mFrameLimiter;
+	uint32 mTargetFPS; //0 for no limit
+	uint32 mPrevFrameTime; //microseconds
+	uint32 mSimulationTime; //not yet simulated, less than a step
+	uint32 mAnimatedTextureTime; //microseconds left over from whole milliseconds
+	bool mProfile; //record profiler scopes even without the overlay
+	bool mHeadless; //null driver and no window; the scene is kept up to date but never drawn
+	bool mShowProfilerOverlay;
+	std::vector<Profiler::Summary> mProfilerFrame;
+	bool mUse32BitIndices;
+	bool mShowZoneWalls;
+	bool mMergeObjects; //bake static placed objects into per-cell batches, see ObjectBatcher
+	float mDrawDistance; //far clip and end of the fog, 0 for neither
+	bool mUseRegionVisibility; //skip what the camera's bsp region can't see, see ZoneRegions
+
+
+	ZoneSceneNode* mCollisionNode; //also the parent of the placed objects
+	ZoneSceneNode* mNonCollisionNode;
 	ZoneModel* mActiveZoneModel;
 
 	std::vector<AnimatedTexture> mAnimatedTextures;
 
+	//calls made from worker threads that need the driver, serviced once per loopStep
+	struct MainThreadCall
+	{
+		const std::function<void()>* func;
+		bool* done;
+	};
+
+	std::thread::id mMainThreadID;
+	std::mutex mMainThreadCallMutex;
+	std::condition_variable mMainThreadCallsDone;
+	std::vector<MainThreadCall> mMainThreadCalls;
+
+	//how many Models use each texture; irrlicht hands out the same texture for the same name, and a prefetched zone
+	//can go away while others still draw with it
+	std::mutex mTextureRefMutex;
+	std::unordered_map<video::ITexture*, uint32> mTextureRefs;
+
 private:
 	static IrrlichtDevice* createDevice(SIrrlichtCreationParameters& params, std::string selectedRenderer);
+	void drawProfilerOverlay();
 
 public:
 	Renderer();
 	
+	//before initialize
+	void setHeadless(bool headless) { mHeadless = headless; }
+	bool isHeadless() { return mHeadless; }
 	void initialize();
 	void initializeGUI();
 	void close();
@@ -61,26 +108,53 @@ public:
 
 	bool isOpenGL() { return mDriver->getDriverType() == video::EDT_OPENGL; }
 	bool isDirectX() { return mDriver->getDriverType() == video::EDT_DIRECT3D9; }
+	bool use32BitIndices() { return mUse32BitIndices; }
+	//cached so that worker threads don't need to go through lua
+	bool showZoneWalls() { return mShowZoneWalls; }
+	float getDrawDistance() { return mDrawDistance; }
+
+	//runs func on the main thread and blocks until it's done; runs it immediately when called from the main thread
+	void runOnMainThread(const std::function<void()>& func);
+	void processMainThreadCalls();
 
 	video::ITexture* createTexture(MemoryStream* file, std::string name, bool& isDDS);
 	video::ITexture* createTexture(std::string name, void* pixels, uint32 width, uint32 height, bool own_pixels = true);
 	void destroyTexture(video::ITexture* tex);
+	//for textures shared between Models; the last release destroys it
+	void retainTexture(video::ITexture* tex);
+	void releaseTexture(video::ITexture* tex);
 	Camera* createCamera(bool bind = true);
 	scene::ISceneCollisionManager* getCollisionManager() { return mCollisionMgr; }
-	scene::IMeshSceneNode* getCollisionNode() { return mCollisionNode; }
-	scene::ITriangleSelector* getCollisionSelector() { return mCollisionSelector; }
+	scene::ISceneNode* getCollisionNode() { return mCollisionNode; }
+	//null until a zone is in use
+	ZoneModel* getActiveZoneModel() { return mActiveZoneModel; }
+	CollisionWorld* getCollisionWorld();
+	FloorMap* getFloorMap();
+	RegionMap* getRegionMap();
 
 	scene::ISceneManager* getSceneManager() { return mSceneMgr; }
 	video::IVideoDriver* getVideoDriver() { return mDriver; }
 	Rocket::Core::Context* getGUIContext() { return mGUIContext; }
 	Rocket::Core::ElementDocument* getGUIDocument() { return mGUIDocument; }
 
-	float loopStep();
+	//simulates the time the last frame took in fixed steps, calling simulate for each with the step in seconds,
+	//then draws and waits for the next frame; returns the last frame's real length in seconds
+	float loopStep(const std::function<void(float)>& simulate = nullptr);
 	void resetInternalTimer();
 	void useZoneModel(ZoneModel* zoneModel);
 	void checkAnimatedTextures(uint32 delta);
+	void toggleProfilerOverlay();
+	void printFrameStats() const { mFrameLimiter.printStats(); }
+	//times rays through the active zone's CollisionWorld against irrlicht's scene collision manager
+	void benchmarkCollision(uint32 rays);
+	//re-creates the active zone's scene without and with merged objects and times drawing each
+	void benchmarkObjectBatching(uint32 frames);
+	//draws the active zone from random standing spots with and without region visibility, counting triangles
+	void benchmarkRegionVisibility(uint32 samples);
 
 	static scene::SMesh* copyMesh(scene::SMesh* mesh);
+	static bool hasLargeIndexBuffers(scene::IMesh* mesh);
+	static scene::SMesh* createCollisionMesh(scene::IMesh* mesh);
 
 	enum GUIType
 	{
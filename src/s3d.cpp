@@ -1,15 +1,24 @@
 
 #include "s3d.h"
+#include "file_loader.h"
 
 using namespace S3D_Structs;
 
-S3D::S3D(const char* path) : mRawData(nullptr)
+extern FileLoader gFileLoader;
+
+S3D::S3D(const char* path) :
+	mRawData(nullptr),
+	mDecompressedBytes(0),
+	mPins(0)
 {
 	FileStream* fs = new FileStream(path);
 	open(fs);
 }
 
-S3D::S3D(MemoryStream* ms) : mRawData(nullptr)
+S3D::S3D(MemoryStream* ms) :
+	mRawData(nullptr),
+	mDecompressedBytes(0),
+	mPins(0)
 {
 	open(ms);
 }
@@ -64,6 +73,7 @@ void S3D::open(MemoryStream* mem_stream)
 
 		ent.deflatedLen = dpos - ent.offset;
 		ent.decompressedFile = nullptr;
+		ent.refs = 0;
 		mFileArray.push_back(ent);
 	}
 
@@ -108,25 +118,30 @@ void S3D::open(MemoryStream* mem_stream)
 
 MemoryStream* S3D::decompressFile(InternalFile& file)
 {
+	//the inflated length is known up front, so blocks go straight into the final allocation
+	//(Compression's shared static buffer isn't safe to use from worker threads)
 	uint32 pos = 0;
-	Buffer buf;
+	uint32 out = 0;
 	byte* data = mRawData->getData() + file.offset;
+	byte* inflated = new byte[file.inflatedLen];
 
-	while (pos < file.deflatedLen)
+	while (pos < file.deflatedLen && out < file.inflatedLen)
 	{
 		BlockHeader* bh = (BlockHeader*)&data[pos];
 		pos += sizeof(BlockHeader);
 
-		byte* decompressed = &data[pos];
-		uint32 len = bh->deflatedLen;
-		Compression::decompressBlock(decompressed, len);
+		uLongf len = file.inflatedLen - out;
+		if (uncompress(inflated + out, &len, &data[pos], bh->deflatedLen) != Z_OK)
+		{
+			delete[] inflated;
+			throw ZEQException("S3D::decompressFile: Bad compressed block in '%s'", file.name.c_str());
+		}
 
 		pos += bh->deflatedLen;
-
-		buf.add(decompressed, bh->inflatedLen);
+		out += (uint32)len;
 	}
 
-	return new MemoryStream(&buf);
+	return new MemoryStream(inflated, out);
 }
 
 MemoryStream* S3D::getFile(uint32 pos)
@@ -134,12 +149,77 @@ MemoryStream* S3D::getFile(uint32 pos)
 	if (pos >= mFileArray.size())
 		throw ZEQException("S3D:getFile: Out of range vector access");
 
-	InternalFile& file = mFileArray[pos];
-	if (file.decompressedFile)
-		return file.decompressedFile;
+	MemoryStream* ret;
+	bool grew = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		InternalFile& file = mFileArray[pos];
+		if (file.decompressedFile == nullptr)
+		{
+			file.decompressedFile = decompressFile(file);
+			mDecompressedBytes += file.decompressedFile->length();
+			grew = true;
+		}
+
+		//whoever holds a file keeps the archive from being evicted under it
+		++file.refs;
+		++mPins;
+		ret = file.decompressedFile;
+	}
 
-	file.decompressedFile = decompressFile(file);
-	return file.decompressedFile;
+	//the cache's budget covers what archives decompress, not just what they are on disk; not under our own lock,
+	//the cache locks every archive to size them up
+	if (grew)
+		gFileLoader.checkCacheBudget();
+
+	return ret;
+}
+
+void S3D::releaseFile(const char* name)
+{
+	if (mFilePositionsByName.count(name) == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	InternalFile& file = mFileArray[mFilePositionsByName[name]];
+	if (file.decompressedFile == nullptr)
+		return;
+
+	--mPins;
+	if (--file.refs == 0)
+	{
+		mDecompressedBytes -= file.decompressedFile->length();
+		delete file.decompressedFile;
+		file.decompressedFile = nullptr;
+	}
+}
+
+void S3D::releaseFile(MemoryStream* file)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (InternalFile& ent : mFileArray)
+	{
+		if (ent.decompressedFile == file)
+		{
+			--mPins;
+			if (--ent.refs == 0)
+			{
+				mDecompressedBytes -= file->length();
+				delete file;
+				ent.decompressedFile = nullptr;
+			}
+			return;
+		}
+	}
+}
+
+uint64 S3D::getMemoryUsage()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (uint64)mRawData->length() + mDecompressedBytes;
 }
 
 MemoryStream* S3D::getFile(const char* name)
@@ -151,6 +231,15 @@ MemoryStream* S3D::getFile(const char* name)
 	return getFile(pos);
 }
 
+MemoryStream* S3D::copyFile(const char* name)
+{
+	if (mFilePositionsByName.count(name) == 0)
+		return nullptr;
+
+	//decompressing only reads the raw archive, which never changes
+	return decompressFile(mFileArray[mFilePositionsByName[name]]);
+}
+
 bool S3D::extensionFileCheck(const char* ext, uint32 pos) const
 {
 	if (mFilePositionsByExt.count(ext) == 0)
@@ -9,6 +9,9 @@
 #include <cstring>
 #include <regex>
 #include <cctype>
+#include <mutex>
+#include <atomic>
+#include <zlib.h>
 
 #include "types.h"
 #include "memory_stream.h"
@@ -26,6 +29,7 @@ private:
 		uint32 inflatedLen;
 		uint32 deflatedLen;
 		MemoryStream* decompressedFile;
+		uint32 refs; //getFile calls not yet matched by releaseFile
 	};
 
 	MemoryStream* mRawData;
@@ -33,6 +37,12 @@ private:
 	std::unordered_map<std::string, uint32> mFilePositionsByName;
 	std::unordered_map<std::string, std::vector<uint32>> mFilePositionsByExt;
 
+	//decompressed files may be requested from more than one thread once archives are shared between loads
+	std::mutex mMutex;
+	uint64 mDecompressedBytes;
+	//number of model sources currently reading from this archive; the file cache won't evict it while non-zero
+	std::atomic<int> mPins;
+
 private:
 	void open(MemoryStream* data);
 	MemoryStream* decompressFile(InternalFile& file);
@@ -44,12 +54,27 @@ public:
 	S3D(MemoryStream* data);
 	~S3D();
 
+	//decompressed files are shared between callers, and each call must be matched by a releaseFile once done with it
 	MemoryStream* getFile(uint32 pos);
 	MemoryStream* getFile(const char* name);
 	MemoryStream* getFileByExtension(const char* ext, uint32 pos = 0);
+	//a decompressed copy for the caller alone to modify and delete, e.g. a WLD, which decodes its strings in place
+	MemoryStream* copyFile(const char* name);
 	const char* getFileNameByExtension(const char* ext, uint32 pos = 0);
 
 	uint32 getNumFilesWithExtension(const char* ext) const;
+
+	//drops the caller's hold on a decompressed file (e.g. a texture that has been uploaded); once nobody holds it,
+	//it is freed and the next getFile() for it decompresses it again
+	void releaseFile(const char* name);
+	void releaseFile(MemoryStream* file);
+
+	void pin() { ++mPins; }
+	void unpin() { --mPins; }
+	bool isPinned() { return mPins > 0; }
+
+	//raw archive plus whatever is currently decompressed
+	uint64 getMemoryUsage();
 };
 
 namespace S3D_Structs
@@ -41,5 +41,6 @@ namespace EQG_Structs
 		bool isDDS = false;
 
 		mat_ent.diffuse_map = gRenderer.createTexture(file, name, isDDS);
+		s3d->releaseFile(name);
 	}
 }
@@ -79,6 +79,61 @@ namespace WLD_Structs
 		float x, y, z;
 	};
 
+	struct Frag21Node
+	{
+		float normal[3];
+		float split_distance; //points with dot(normal, p) + split_distance > 0 are in front
+		uint32 region; //1-based, leaves only
+		uint32 front; //1-based node indices, 0 for none
+		uint32 back;
+	};
+
+	struct Frag21 : public FragHeader //bsp tree fragment
+	{
+		uint32 count;
+		Frag21Node node[1];
+	};
+
+	struct Frag22 : public FragHeader //bsp region fragment
+	{
+		enum Flags
+		{
+			HAS_SPHERE = 0x01,
+			HAS_REVERB_VOLUME = 0x02,
+			HAS_REVERB_OFFSET = 0x04,
+			BYTE_VIS_LISTS = 0x80, //run-length encoded, otherwise plain lists of 16-bit region ids
+			HAS_MESH = 0x100
+		};
+		uint32 flag;
+		int ambient_ref;
+		uint32 region_vertex_count; //12 bytes each
+		uint32 proximal_count; //8 bytes each
+		uint32 render_vertex_count; //12 bytes each
+		uint32 wall_count; //variable size
+		uint32 obstacle_count; //variable size
+		uint32 cutting_obstacle_count;
+		uint32 vis_node_count; //28 bytes each
+		uint32 vis_list_count; //16-bit size followed by that many entries each
+
+		byte* getData()
+		{
+			return (byte*)this + sizeof(Frag22);
+		}
+	};
+
+	struct Frag29 : public FragHeader //region type fragment
+	{
+		uint32 flag;
+		uint32 region_count;
+
+		//0-based region indices, followed by a 32-bit length and an encoded string that names the type
+		//when the fragment's own name doesn't
+		uint32* getRegionList()
+		{
+			return (uint32*)((byte*)this + sizeof(Frag29));
+		}
+	};
+
 	struct Frag15 : public FragHeader //object location fragment
 	{
 		int ref1;
@@ -2,7 +2,8 @@
 #include "ter.h"
 
 TER::TER(MemoryStream* mem, S3D* s3d, std::string shortname) :
-	ModelSource(s3d, shortname)
+	ModelSource(s3d, shortname),
+	mRawData(mem)
 {
 	byte* data = mem->getData();
 
@@ -19,6 +20,11 @@ TER::TER(MemoryStream* mem, S3D* s3d, std::string shortname) :
 	mStringBlock = (char*)(data + p);
 }
 
+TER::~TER()
+{
+	mContainingS3D->releaseFile(mRawData);
+}
+
 ZoneModel* TER::convertZoneModel()
 {
 	byte* data = (byte*)mHeader;
@@ -43,7 +49,7 @@ ZoneModel* TER::convertZoneModel()
 
 	//triangles
 	Triangle* tris = (Triangle*)(data + p);
-	readEQGTriangles(mHeader->material_count, mHeader->triangle_count, tris, vertices, verticesV3);
+	readEQGTriangles(mHeader->material_count, mHeader->triangle_count, tris, mHeader->vertex_count, vertices, verticesV3);
 
 	//create the irrlicht mesh, transferring buffers and creating final materials
 	scene::SMesh* mesh = new scene::SMesh;
@@ -53,9 +59,9 @@ ZoneModel* TER::convertZoneModel()
 	for (uint32 i = 0; i < mNumMaterials; ++i)
 	{
 		if (!mMaterialVertexBuffers[i].empty())
-			createMeshBuffer(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], &mMaterials[i], zone);
+			createChunkedMeshBuffers(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], &mMaterials[i], zone);
 		if (!mNoCollisionVertexBuffers[i].empty())
-			createMeshBuffer(nocollide_mesh, mNoCollisionVertexBuffers[i], mNoCollisionIndexBuffers[i], &mMaterials[i], zone);
+			createChunkedMeshBuffers(nocollide_mesh, mNoCollisionVertexBuffers[i], mNoCollisionIndexBuffers[i], &mMaterials[i], zone);
 	}
 
 	mesh->recalculateBoundingBox();
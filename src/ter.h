@@ -30,10 +30,12 @@ public:
 	};
 
 private:
+	MemoryStream* mRawData; //held from the archive until the TER is done with
 	Header* mHeader;
 
 public:
 	TER(MemoryStream* mem, S3D* s3d, std::string shortname);
+	~TER();
 
 	ZoneModel* convertZoneModel();
 };
@@ -2,23 +2,34 @@
 #include "translate.h"
 
 #define TRANSLATE_RACE_FILE "ids/races.lua"
-#define TRANSLATE_RACE_TABLE "race_ids"
 #define TRANSLATE_ANIM_FILE "ids/animations.lua"
-#define TRANSLATE_ANIM_TABLE "anim_ids"
+#define TRANSLATE_ZONE_FILE "ids/zones.lua"
+
+//copied out of lua up front so that lookups are safe from worker threads
+static std::unordered_map<std::string, int, std::hash<std::string>> RaceIDs;
+static std::unordered_map<std::string, int, std::hash<std::string>> AnimationIDs;
+static std::unordered_map<int, std::string> ZoneShortNames;
 
 namespace Translate
 {
 	void initialize()
 	{
 		//3 letter race names to race ids
-		Lua::fileToTable(TRANSLATE_RACE_FILE, TRANSLATE_RACE_TABLE, false);
+		Lua::fileToHashTable(TRANSLATE_RACE_FILE, RaceIDs);
 		//3 letter identifiers for animations in WLD files
-		Lua::fileToTable(TRANSLATE_ANIM_FILE, TRANSLATE_ANIM_TABLE, false);
+		Lua::fileToHashTable(TRANSLATE_ANIM_FILE, AnimationIDs);
+
+		//zone shortnames to zone ids, we want the reverse
+		std::unordered_map<std::string, int, std::hash<std::string>> zoneIDs;
+		Lua::fileToHashTable(TRANSLATE_ZONE_FILE, zoneIDs);
+		for (auto& pair : zoneIDs)
+			ZoneShortNames[pair.second] = pair.first;
 	}
 
 	int raceID(std::string id)
 	{
-		return Lua::getInt(id.c_str(), TRANSLATE_RACE_TABLE);
+		auto it = RaceIDs.find(id);
+		return (it != RaceIDs.end()) ? it->second : 0;
 	}
 
 	int gender(std::string race3letter)
@@ -37,7 +48,8 @@ namespace Translate
 
 	int animationID(std::string id)
 	{
-		return Lua::getInt(id.c_str(), TRANSLATE_ANIM_TABLE);
+		auto it = AnimationIDs.find(id);
+		return (it != AnimationIDs.end()) ? it->second : 0;
 	}
 
 	uint32 invertHeadingRace(int race)
@@ -61,4 +73,10 @@ namespace Translate
 			return 0;
 		}
 	}
+
+	std::string zoneShortName(int zone_id)
+	{
+		auto it = ZoneShortNames.find(zone_id);
+		return (it != ZoneShortNames.end()) ? it->second : std::string();
+	}
 }
@@ -17,6 +17,7 @@ namespace Translate
 	int gender(std::string race3letter);
 	int animationID(std::string anim3letter);
 	uint32 invertHeadingRace(int race);
+	std::string zoneShortName(int zone_id); //empty if unknown
 }
 
 #endif
@@ -98,6 +98,15 @@ namespace Util
 		return EQ19toFloat(eq19heading) / 256.0f * 360.0f;
 	}
 
+	float unpackDeltaHeading(int eq10delta)
+	{
+		//sign extend ourselves rather than trust how the bitfield was read
+		eq10delta &= 0x3FF;
+		if (eq10delta & 0x200)
+			eq10delta -= 0x400;
+		return float(eq10delta) / float(1 << 3) / 256.0f * 360.0f;
+	}
+
 	std::string getDisplayName(std::string name)
 	{
 		//are numeric symbols legal if not at the end?
@@ -33,6 +33,8 @@ namespace Util
 	int floatToEQ13Precise(float val);
 
 	float unpackHeading(int eq19heading);
+	//signed 10 bit change in heading, in the same degrees as unpackHeading
+	float unpackDeltaHeading(int eq10delta);
 
 	std::string getDisplayName(std::string name);
 }
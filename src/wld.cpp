@@ -5,7 +5,9 @@ extern Renderer gRenderer;
 extern MobManager gMobMgr;
 
 WLD::WLD(MemoryStream* mem, S3D* s3d, std::string shortname) :
-	ModelSource(s3d, shortname)
+	ModelSource(s3d, shortname),
+	mFile(mem),
+	mMaterialsProcessed(false)
 {
 	byte* data = mem->getData();
 
@@ -27,20 +29,73 @@ WLD::WLD(MemoryStream* mem, S3D* s3d, std::string shortname) :
 	p += mHeader->strings_len;
 
 	//zeroth fragment is null - saves us from doing a lot of 'ref - 1' later on
+	const uint32 count = mHeader->frag_count;
+	mFragsByIndex.reserve(count + 1);
 	mFragsByIndex.push_back(nullptr);
+	mFragIndexByNameRef.assign(mHeader->strings_len, 0);
+	mFragIndexByName.reserve(count);
 
-	const uint32 count = mHeader->frag_count;
-	for (uint32 i = 0; i < count; ++i)
+	uint32 typeCounts[MAX_FRAG_TYPE];
+	memset(typeCounts, 0, sizeof(typeCounts));
+
+	for (uint32 i = 1; i <= count; ++i)
 	{
 		FragHeader* fh = (FragHeader*)&data[p];
-
 		mFragsByIndex.push_back(fh);
-		mFragsByType[fh->type].push_back(fh);
-		if (fh->nameref < 0)
-			mFragsByNameRef[-fh->nameref] = fh;
+
+		if (fh->type < MAX_FRAG_TYPE)
+			++typeCounts[fh->type];
+
+		const char* name = getFragName(fh->nameref);
+		if (name)
+		{
+			mFragIndexByNameRef[-fh->nameref] = i;
+			mFragIndexByName[name] = i;
+		}
 
 		p += FragHeader::SIZE + fh->len;
 	}
+
+	//counting sort by type, keeping file order within each type
+	uint32 start = 0;
+	for (uint32 t = 0; t < MAX_FRAG_TYPE; ++t)
+	{
+		mFragTypeStart[t] = start;
+		start += typeCounts[t];
+	}
+	mFragTypeStart[MAX_FRAG_TYPE] = start;
+
+	mFragsByType.resize(start);
+	uint32 fill[MAX_FRAG_TYPE];
+	memcpy(fill, mFragTypeStart, sizeof(fill));
+	for (uint32 i = 1; i <= count; ++i)
+	{
+		FragHeader* fh = mFragsByIndex[i];
+		if (fh->type < MAX_FRAG_TYPE)
+			mFragsByType[fill[fh->type]++] = fh;
+	}
+
+	//animation tracks, sorted by name minus the animation id so that each bone's tracks are contiguous
+	for (FragHeader* frag : getFragsByType(0x13))
+	{
+		const char* name = getFragName(frag);
+		if (name && strlen(name) > 3)
+			mTracksBySuffix.push_back((Frag13*)frag);
+	}
+
+	std::sort(mTracksBySuffix.begin(), mTracksBySuffix.end(), [this](Frag13* a, Frag13* b)
+	{
+		return strcmp(getFragName(a) + 3, getFragName(b) + 3) < 0;
+	});
+
+	for (uint32 i = 0; i < mTracksBySuffix.size(); ++i)
+	{
+		const char* suffix = getFragName(mTracksBySuffix[i]) + 3;
+		IndexRange& range = mTrackRangesBySuffix[suffix];
+		if (range.count == 0)
+			range.start = i;
+		++range.count;
+	}
 }
 
 void WLD::decodeString(void* str, size_t len)
@@ -53,21 +108,52 @@ void WLD::decodeString(void* str, size_t len)
 	}
 }
 
+WLD::FragList WLD::getFragsByType(uint32 type)
+{
+	if (type >= MAX_FRAG_TYPE || mFragsByType.empty())
+		return FragList(nullptr, nullptr);
+
+	FragHeader* const* base = mFragsByType.data();
+	return FragList(base + mFragTypeStart[type], base + mFragTypeStart[type + 1]);
+}
+
 FragHeader* WLD::getFragByRef(int ref)
 {
 	if (ref > 0)
 	{
+		if ((uint32)ref >= mFragsByIndex.size())
+			return nullptr;
 		return mFragsByIndex[ref];
 	}
-	else
+
+	//negative refs are string block offsets of the target frag's name
+	if (ref == 0)
+		ref = -1;
+	uint32 r = -ref;
+	if (r >= mFragIndexByNameRef.size() || mFragIndexByNameRef[r] == 0)
+		return nullptr;
+	return mFragsByIndex[mFragIndexByNameRef[r]];
+}
+
+FragHeader* WLD::getFragByName(const char* name)
+{
+	auto it = mFragIndexByName.find(name);
+	if (it == mFragIndexByName.end())
+		return nullptr;
+	return mFragsByIndex[it->second];
+}
+
+Frag13** WLD::getAnimationTracks(const char* base_name, uint32& count)
+{
+	auto it = mTrackRangesBySuffix.find(base_name);
+	if (it == mTrackRangesBySuffix.end())
 	{
-		if (ref == 0)
-			ref = -1;
-		if (mFragsByNameRef.count(ref))
-			return mFragsByNameRef[ref];
+		count = 0;
+		return nullptr;
 	}
 
-	return nullptr;
+	count = it->second.count;
+	return &mTracksBySuffix[it->second.start];
 }
 
 const char* WLD::getFragName(FragHeader* frag)
@@ -83,13 +169,20 @@ const char* WLD::getFragName(int ref)
 	return mStringBlock - ref;
 }
 
+WLD::~WLD()
+{
+	//strings are decoded in place, so each WLD has a copy of the file to itself, see S3D::copyFile
+	delete mFile;
+}
+
 void WLD::processMaterials()
 {
-	if (mMaterials || mFragsByType.count(0x03) == 0)
+	if (mMaterialsProcessed || getFragsByType(0x03).empty())
 		return;
+	mMaterialsProcessed = true;
 
 	//pre-process 0x03 frags so their strings are only decoded once each
-	for (FragHeader* frag : mFragsByType[0x03])
+	for (FragHeader* frag : getFragsByType(0x03))
 	{
 		Frag03* f03 = (Frag03*)frag;
 		if (f03->string_len == 0)
@@ -101,51 +194,62 @@ void WLD::processMaterials()
 	}
 
 	//process 0x30 frags to find all materials in the wld
-	if (mFragsByType.count(0x30) == 0)
+	if (getFragsByType(0x30).empty())
 		return;
 
-	initMaterials(mFragsByType[0x30].size());
+	initMaterials(getFragsByType(0x30).size());
 
+	//textures are only created once a mesh using the material is converted, see getMaterial()
 	int i = -1;
-	for (FragHeader* frag : mFragsByType[0x30])
+	for (FragHeader* frag : getFragsByType(0x30))
 	{
 		Frag30* f30 = (Frag30*)frag;
-		Frag03* f03;
-
-		IntermediateMaterial* mat = &mMaterials[++i];
+		mMaterialIndicesByFrag30[f30] = ++i;
+		mMaterialFrag30s.push_back(f30);
+	}
+	mMaterialsLoaded.assign(mMaterialFrag30s.size(), 0);
+}
 
-		mMaterialIndicesByFrag30[f30] = i;
-		
-		//f30 -> f05 -> f04 -> f03
-		//OR
-		//f30 -> f03 (may have null texture)
-		if (f30->ref > 0)
+IntermediateMaterial* WLD::getMaterial(uint32 index)
+{
+	IntermediateMaterial* mat = &mMaterials[index];
+	if (mMaterialsLoaded[index])
+		return mat;
+	mMaterialsLoaded[index] = 1;
+
+	Frag30* f30 = mMaterialFrag30s[index];
+	Frag03* f03;
+
+	//f30 -> f05 -> f04 -> f03
+	//OR
+	//f30 -> f03 (may have null texture)
+	if (f30->ref > 0)
+	{
+		Frag05* f05 = (Frag05*)getFragByRef(f30->ref);
+		if (f05 == nullptr)
+			return mat;
+		Frag04* f04 = (Frag04*)getFragByRef(f05->ref);
+		if (f04 == nullptr)
+			return mat;
+		//we have our f04, check if it's animated
+		if (!f04->isAnimated())
 		{
-			Frag05* f05 = (Frag05*)getFragByRef(f30->ref);
-			if (f05 == nullptr)
-				continue;
-			Frag04* f04 = (Frag04*)getFragByRef(f05->ref);
-			if (f04 == nullptr)
-				continue;
-			//we have our f04, check if it's animated
-			if (!f04->isAnimated())
-			{
-				f03 = (Frag03*)getFragByRef(f04->ref);
-			}
-			else
-			{
-				handleAnimatedMaterial(f04, f30, mat);
-				continue;
-			}
+			f03 = (Frag03*)getFragByRef(f04->ref);
 		}
 		else
 		{
-			f03 = (Frag03*)getFragByRef(f30->ref);
+			handleAnimatedMaterial(f04, f30, mat);
+			return mat;
 		}
-
-		//we have our f03 frag, time to make our material
-		Frag03ToMaterialEntry(f03, f30, &mat->first);
 	}
+	else
+	{
+		f03 = (Frag03*)getFragByRef(f30->ref);
+	}
+
+	//we have our f03 frag, time to make our material
+	Frag03ToMaterialEntry(f03, f30, &mat->first);
+	return mat;
 }
 
 void WLD::Frag03ToMaterialEntry(Frag03* f03, Frag30* f30, IntermediateMaterialEntry* mat_ent)
@@ -165,6 +269,7 @@ void WLD::Frag03ToMaterialEntry(Frag03* f03, Frag30* f30, IntermediateMaterialEn
 		bool isDDS = false;
 
 		mat_ent->diffuse_map = gRenderer.createTexture(file, name, isDDS);
+		mContainingS3D->releaseFile((char*)f03->string);
 
 		mat_ent->flag = translateVisibilityFlag(f30, isDDS);
 	}
@@ -285,70 +390,67 @@ void WLD::processMesh(Frag36* f36, WLDSkeleton* skeleton)
 		mat_index_list[i] = mMaterialIndicesByFrag30[f30];
 	}
 
-	auto processTriangle = [=, &vertToBoneAssignment](RawTriangle& tri, std::vector<video::S3DVertex>& vert_buf,
-		std::vector<uint32>& index_buf, int mat_index)
-	{
-		uint32 base = vert_buf.size();
-
-		//handle uv conversions
-		video::S3DVertex vertex;
-		if (uv16)
-		{
-			for (int i = 0; i < 3; ++i)
-			{
-				static const float uv_scale = 1.0f / 256.0f;
-				RawUV16& uv = uv16[tri.index[i]];
-				vertex.TCoords.X = (float)uv.u * uv_scale;
-				vertex.TCoords.Y = -((float)uv.v * uv_scale);
-				vert_buf.push_back(vertex);
-			}
-		}
-		else if (uv32)
-		{
-			for (int i = 0; i < 3; ++i)
-			{
-				RawUV32& uv = uv32[tri.index[i]];
-				vertex.TCoords.X = uv.u;
-				vertex.TCoords.Y = -uv.v;
-				vert_buf.push_back(vertex);
-			}
-		}
-		else
-		{
-			vertex.TCoords.X = 0;
-			vertex.TCoords.Y = 0;
-			for (int i = 0; i < 3; ++i)
-				vert_buf.push_back(vertex);
-		}
+	//uvs and normals are stored in parallel with the positions, so a source vertex index fully identifies
+	//a converted vertex within a buffer; triangles sharing the index can share the converted vertex too
+	VertexRemap remap(f36->vert_count);
 
-		//handle vertex and normal conversions
-		uint32 buf_pos = base;
+	auto processTriangle = [=, &vertToBoneAssignment, &remap](RawTriangle& tri, std::vector<video::S3DVertex>& vert_buf,
+		std::vector<uint32>& index_buf, int mat_index, uint32 buffer_id)
+	{
 		for (int i = 0; i < 3; ++i)
 		{
-			video::S3DVertex& vertex = vert_buf[buf_pos];
 			uint16 idx = tri.index[i];
-			RawVertex& vert = wld_verts[idx];
-			vertex.Pos.X = f36->x + (float)vert.x * scale;
-			vertex.Pos.Z = f36->y + (float)vert.y * scale; //irrlicht uses Y for the "up" axis, need to switch
-			vertex.Pos.Y = f36->z + (float)vert.z * scale;
-			RawNormal& norm = wld_norm[idx];
-			static const float normal_scale = 1.0f / 127.0f;
-			vertex.Normal.X = (float)norm.i * normal_scale;
-			vertex.Normal.Z = (float)norm.j * normal_scale;
-			vertex.Normal.Y = (float)norm.k * normal_scale;
-
-			if (skeleton)
+			uint32 out;
+
+			if (!remap.find(buffer_id, idx, out))
 			{
-				skeleton->addWeight(vertToBoneAssignment[idx], mat_index, buf_pos);
+				out = vert_buf.size();
+				remap.insert(buffer_id, idx, out);
+
+				video::S3DVertex vertex;
+
+				//handle uv conversions
+				if (uv16)
+				{
+					static const float uv_scale = 1.0f / 256.0f;
+					RawUV16& uv = uv16[idx];
+					vertex.TCoords.X = (float)uv.u * uv_scale;
+					vertex.TCoords.Y = -((float)uv.v * uv_scale);
+				}
+				else if (uv32)
+				{
+					RawUV32& uv = uv32[idx];
+					vertex.TCoords.X = uv.u;
+					vertex.TCoords.Y = -uv.v;
+				}
+				else
+				{
+					vertex.TCoords.X = 0;
+					vertex.TCoords.Y = 0;
+				}
+
+				//handle vertex and normal conversions
+				RawVertex& vert = wld_verts[idx];
+				vertex.Pos.X = f36->x + (float)vert.x * scale;
+				vertex.Pos.Z = f36->y + (float)vert.y * scale; //irrlicht uses Y for the "up" axis, need to switch
+				vertex.Pos.Y = f36->z + (float)vert.z * scale;
+				RawNormal& norm = wld_norm[idx];
+				static const float normal_scale = 1.0f / 127.0f;
+				vertex.Normal.X = (float)norm.i * normal_scale;
+				vertex.Normal.Z = (float)norm.j * normal_scale;
+				vertex.Normal.Y = (float)norm.k * normal_scale;
+
+				//only new vertices get weights, shared ones already have theirs
+				if (skeleton)
+				{
+					skeleton->addWeight(vertToBoneAssignment[idx], mat_index, out);
+				}
+
+				vert_buf.push_back(vertex);
 			}
 
-			++buf_pos;
+			index_buf.push_back(out);
 		}
-
-		//write indices (purely in order for now, no reused vertices)
-		//would be faster to do them all per material in one step, in that case... but we should look at reusing vertices instead
-		for (int i = 0; i < 3; ++i)
-			index_buf.push_back(base++);
 	};
 
 	//construct vertices and triangles based on their materials
@@ -369,9 +471,9 @@ void WLD::processMesh(Frag36* f36, WLDSkeleton* skeleton)
 		{
 			RawTriangle& tri = wld_tris[i];
 			if ((tri.flag & RawTriangle::PERMEABLE) == 0 || skeleton)
-				processTriangle(tri, vert_buf, index_buf, mat_index);
+				processTriangle(tri, vert_buf, index_buf, mat_index, mat_index * 2);
 			else
-				processTriangle(tri, nocollide_vert_buf, nocollide_index_buf, mat_index);
+				processTriangle(tri, nocollide_vert_buf, nocollide_index_buf, mat_index, mat_index * 2 + 1);
 		}
 
 		//advance triangles ptr for the next block
@@ -381,29 +483,85 @@ void WLD::processMesh(Frag36* f36, WLDSkeleton* skeleton)
 
 ZoneModel* WLD::convertZoneModel()
 {
-	if (mFragsByType.count(0x36) == 0)
+	if (getFragsByType(0x36).empty())
 		return nullptr;
 
 	processMaterials();
 	initMaterialBuffers();
 
+	ZoneModel* zone = new ZoneModel;
+
+	//with a bsp tree, every mesh is the geometry of one region, and its triangles are grouped by the region's group
+	//so that the renderer can skip groups the camera's region can't see
+	std::vector<Frag36*> regionMeshes;
+	std::vector<core::vector3df> regionCenters;
+	std::vector<uint8> regionHasCenter;
+	std::unordered_map<Frag36*, uint32> groupByMesh;
+	ZoneRegions& regions = zone->getRegions();
+	bool useRegions = readRegions(regions, regionMeshes, regionCenters, regionHasCenter);
+	if (useRegions)
+	{
+		zone->getRegionMap().setTree(&regions);
+		readRegionTypes(zone->getRegionMap(), regionCenters, regionHasCenter);
+
+		std::vector<core::vector3df> centers(regionMeshes.size());
+		std::vector<uint32> triangles(regionMeshes.size(), 0);
+		for (uint32 i = 0; i < regionMeshes.size(); ++i)
+		{
+			Frag36* f36 = regionMeshes[i];
+			if (f36 == nullptr)
+				continue;
+			centers[i].set(f36->x, f36->z, f36->y);
+			triangles[i] = f36->poly_count;
+		}
+		regions.buildGroups(centers, triangles);
+
+		for (uint32 i = 0; i < regionMeshes.size(); ++i)
+		{
+			if (regionMeshes[i])
+				groupByMesh[regionMeshes[i]] = regions.getGroup(i);
+		}
+	}
+
+	//group of each triangle in the material buffers, in parallel with them
+	std::vector<std::vector<uint32>> triGroups(mNumMaterials);
+	std::vector<std::vector<uint32>> noCollisionTriGroups(mNumMaterials);
+
 	//process mesh fragments
-	for (FragHeader* frag : mFragsByType[0x36])
+	for (FragHeader* frag : getFragsByType(0x36))
 	{
 		processMesh((Frag36*)frag);
+
+		if (useRegions)
+		{
+			auto it = groupByMesh.find((Frag36*)frag);
+			uint32 group = (it != groupByMesh.end()) ? it->second : ZoneRegions::NO_GROUP;
+			for (uint32 i = 0; i < mNumMaterials; ++i)
+			{
+				triGroups[i].resize(mMaterialIndexBuffers[i].size() / 3, group);
+				noCollisionTriGroups[i].resize(mNoCollisionIndexBuffers[i].size() / 3, group);
+			}
+		}
 	}
 
 	//create the irrlicht mesh, transferring buffers and creating final materials
 	scene::SMesh* mesh = new scene::SMesh;
 	scene::SMesh* nocollide_mesh = new scene::SMesh;
-	ZoneModel* zone = new ZoneModel;
 
 	for (uint32 i = 0; i < mNumMaterials; ++i)
 	{
 		if (!mMaterialVertexBuffers[i].empty())
-			createMeshBuffer(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], &mMaterials[i], zone);
+			createChunkedMeshBuffers(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], getMaterial(i), zone,
+				useRegions ? &triGroups[i] : nullptr, useRegions ? &zone->getBufferGroups() : nullptr);
 		if (!mNoCollisionVertexBuffers[i].empty())
-			createMeshBuffer(nocollide_mesh, mNoCollisionVertexBuffers[i], mNoCollisionIndexBuffers[i], &mMaterials[i], zone);
+			createChunkedMeshBuffers(nocollide_mesh, mNoCollisionVertexBuffers[i], mNoCollisionIndexBuffers[i], getMaterial(i), zone,
+				useRegions ? &noCollisionTriGroups[i] : nullptr, useRegions ? &zone->getNonCollisionBufferGroups() : nullptr);
+	}
+
+	if (useRegions)
+	{
+		printf("zone regions: %u regions in %u groups, %u bsp nodes\n", regions.getRegionCount(), regions.getGroupCount(),
+			((Frag21*)*getFragsByType(0x21).begin())->count);
 	}
 
 	mesh->recalculateBoundingBox();
@@ -413,9 +571,245 @@ ZoneModel* WLD::convertZoneModel()
 	return zone;
 }
 
+bool WLD::readRegions(ZoneRegions& regions, std::vector<Frag36*>& region_meshes, std::vector<core::vector3df>& region_centers,
+	std::vector<uint8>& region_has_center)
+{
+	FragList trees = getFragsByType(0x21);
+	FragList regionFrags = getFragsByType(0x22);
+	if (trees.empty() || regionFrags.empty())
+		return false;
+
+	regions.clear();
+	region_meshes.clear();
+	region_centers.clear();
+	region_has_center.clear();
+
+	//the tree's planes are in wld axes, which have Z up
+	Frag21* f21 = (Frag21*)*trees.begin();
+	for (uint32 i = 0; i < f21->count; ++i)
+	{
+		Frag21Node& node = f21->node[i];
+		regions.addNode(core::vector3df(node.normal[0], node.normal[2], node.normal[1]), node.split_distance,
+			node.region, node.front, node.back);
+	}
+
+	const uint32 count = regionFrags.size();
+	std::vector<uint32> visible;
+	uint32 index = 0;
+
+	for (FragHeader* frag : regionFrags)
+	{
+		Frag22* f22 = (Frag22*)frag;
+		byte* data = f22->getData();
+		byte* end = (byte*)frag + FragHeader::SIZE + frag->len;
+		bool known = false;
+		bool reachedEnd = false;
+		visible.clear();
+
+		//walls and obstacles are variable length records that zones don't use; past them, nothing can be found
+		if (f22->wall_count == 0 && f22->obstacle_count == 0)
+		{
+			data += f22->region_vertex_count * 12 + f22->proximal_count * 8 + f22->render_vertex_count * 12 +
+				f22->vis_node_count * 28;
+
+			const bool rle = (f22->flag & Frag22::BYTE_VIS_LISTS) != 0;
+			reachedEnd = true;
+			for (uint32 i = 0; i < f22->vis_list_count; ++i)
+			{
+				if (data + sizeof(uint16) > end)
+				{
+					reachedEnd = false;
+					break;
+				}
+				uint16 n = *(uint16*)data;
+				data += sizeof(uint16);
+				uint32 size = rle ? n : n * sizeof(uint16);
+				if (data + size > end)
+				{
+					reachedEnd = false;
+					break;
+				}
+
+				//the first list is the one for the whole region
+				if (i == 0)
+					known = decodeVisibleList(data, n, rle, count, visible);
+				data += size;
+			}
+		}
+
+		regions.addRegion(visible, known);
+
+		//the bounding sphere, if there is one, puts regions without geometry somewhere
+		core::vector3df center;
+		bool hasCenter = false;
+		if (reachedEnd && (f22->flag & Frag22::HAS_SPHERE) && data + sizeof(float) * 4 <= end)
+		{
+			float* sphere = (float*)data;
+			center.set(sphere[0], sphere[2], sphere[1]);
+			hasCenter = true;
+		}
+
+		Frag36* mesh = nullptr;
+		if (reachedEnd && (f22->flag & Frag22::HAS_MESH))
+		{
+			if (f22->flag & Frag22::HAS_SPHERE)
+				data += sizeof(float) * 4;
+			if (f22->flag & Frag22::HAS_REVERB_VOLUME)
+				data += sizeof(float);
+			if (f22->flag & Frag22::HAS_REVERB_OFFSET)
+				data += sizeof(uint32);
+			if (data + sizeof(uint32) <= end)
+				data += sizeof(uint32) + *(uint32*)data; //user data
+			if (data + sizeof(int) <= end)
+				mesh = (Frag36*)getFragByRef(*(int*)data);
+		}
+
+		//region meshes are also named after their region
+		if (mesh == nullptr || mesh->type != 0x36)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "R%u_DMSPRITEDEF", index + 1);
+			mesh = (Frag36*)getFragByName(name);
+			if (mesh && mesh->type != 0x36)
+				mesh = nullptr;
+		}
+
+		if (!hasCenter && mesh)
+		{
+			center.set(mesh->x, mesh->z, mesh->y);
+			hasCenter = true;
+		}
+
+		region_meshes.push_back(mesh);
+		region_centers.push_back(center);
+		region_has_center.push_back(hasCenter ? 1 : 0);
+		++index;
+	}
+
+	return true;
+}
+
+void WLD::readRegionTypes(RegionMap& map, const std::vector<core::vector3df>& region_centers,
+	const std::vector<uint8>& region_has_center)
+{
+	for (FragHeader* frag : getFragsByType(0x29))
+	{
+		Frag29* f29 = (Frag29*)frag;
+		byte* end = (byte*)frag + FragHeader::SIZE + frag->len;
+		uint32* list = f29->getRegionList();
+		if ((byte*)(list + f29->region_count) > end)
+			continue;
+
+		uint32 zoneLine;
+		uint32 types = RegionMap::parseName(getFragName(frag), zoneLine);
+		if (types == 0)
+		{
+			//newer zones give every region type fragment the same name and put the type in the string
+			byte* str = (byte*)(list + f29->region_count);
+			if (str + sizeof(uint32) <= end)
+			{
+				uint32 len = *(uint32*)str;
+				str += sizeof(uint32);
+				if (len > 0 && len < 64 && str + len <= end)
+				{
+					char name[64];
+					memcpy(name, str, len);
+					decodeString(name, len);
+					name[len] = 0;
+					types = RegionMap::parseName(name, zoneLine);
+				}
+			}
+		}
+
+		if (types == 0)
+			continue;
+
+		core::vector3df sum;
+		uint32 centers = 0;
+		for (uint32 i = 0; i < f29->region_count; ++i)
+		{
+			uint32 region = list[i];
+			map.addRegionTypes(region, types, zoneLine);
+			if (region < region_has_center.size() && region_has_center[region])
+			{
+				sum += region_centers[region];
+				++centers;
+			}
+		}
+
+		if ((types & RegionMap::ZONE_LINE) && zoneLine != RegionMap::NO_ZONE_LINE && centers > 0)
+			map.addZoneLinePosition(zoneLine, sum / (float)centers);
+	}
+}
+
+bool WLD::decodeVisibleList(byte* data, uint32 count, bool rle, uint32 region_count, std::vector<uint32>& out)
+{
+	if (!rle)
+	{
+		//plain 1-based region ids
+		uint16* ids = (uint16*)data;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			if (ids[i] > 0 && ids[i] <= region_count)
+				out.push_back(ids[i] - 1);
+		}
+		return true;
+	}
+
+	//runs over the region ids in order, each byte skipping some, taking some, or both
+	uint32 region = 0;
+	auto take = [&](uint32 n)
+	{
+		for (uint32 j = 0; j < n; ++j, ++region)
+		{
+			if (region < region_count)
+				out.push_back(region);
+		}
+	};
+
+	for (uint32 i = 0; i < count; ++i)
+	{
+		byte b = data[i];
+		if (b < 0x3F)
+		{
+			region += b;
+		}
+		else if (b == 0x3F)
+		{
+			if (i + 2 >= count)
+				return false;
+			region += *(uint16*)&data[i + 1];
+			i += 2;
+		}
+		else if (b < 0x80)
+		{
+			region += (b >> 3) & 7;
+			take(b & 7);
+		}
+		else if (b < 0xC0)
+		{
+			take((b >> 3) & 7);
+			region += b & 7;
+		}
+		else if (b < 0xFF)
+		{
+			take(b - 0xC0);
+		}
+		else
+		{
+			if (i + 2 >= count)
+				return false;
+			take(*(uint16*)&data[i + 1]);
+			i += 2;
+		}
+	}
+
+	return true;
+}
+
 void WLD::convertZoneObjectDefinitions(ZoneModel* zone)
 {
-	if (mFragsByType.count(0x14) == 0)
+	if (getFragsByType(0x14).empty())
 		return;
 
 	processMaterials();
@@ -425,7 +819,7 @@ void WLD::convertZoneObjectDefinitions(ZoneModel* zone)
 
 	//process mesh fragments one by one
 	//0x14 -> 0x2D -> 0x36, 0x14 contains the name
-	for (FragHeader* frag : mFragsByType[0x14])
+	for (FragHeader* frag : getFragsByType(0x14))
 	{
 		Frag14* f14 = (Frag14*)frag;
 		const char* model_name = getFragName(frag);
@@ -447,13 +841,13 @@ void WLD::convertZoneObjectDefinitions(ZoneModel* zone)
 		{
 			if (!mMaterialVertexBuffers[i].empty())
 			{
-				createMeshBuffer(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], &mMaterials[i], zone);
+				createMeshBuffer(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], getMaterial(i), zone);
 				mMaterialVertexBuffers[i].clear();
 				mMaterialIndexBuffers[i].clear();
 			}
 			if (!mNoCollisionVertexBuffers[i].empty())
 			{
-				createMeshBuffer(noncollision_mesh, mNoCollisionVertexBuffers[i], mNoCollisionIndexBuffers[i], &mMaterials[i], zone);
+				createMeshBuffer(noncollision_mesh, mNoCollisionVertexBuffers[i], mNoCollisionIndexBuffers[i], getMaterial(i), zone);
 				mNoCollisionVertexBuffers[i].clear();
 				mNoCollisionIndexBuffers[i].clear();
 			}
@@ -475,10 +869,10 @@ void WLD::convertZoneObjectDefinitions(ZoneModel* zone)
 
 void WLD::convertZoneObjectPlacements(ZoneModel* zone)
 {
-	if (mFragsByType.count(0x15) == 0)
+	if (getFragsByType(0x15).empty())
 		return;
 
-	for (FragHeader* frag : mFragsByType[0x15])
+	for (FragHeader* frag : getFragsByType(0x15))
 	{
 		Frag15* f15 = (Frag15*)frag;
 		const char* name = getFragName(f15->ref1);
@@ -504,17 +898,27 @@ void WLD::convertZoneObjectPlacements(ZoneModel* zone)
 
 void WLD::convertMobModel(const char* id_name)
 {
-	if (mFragsByType.count(0x14) == 0)
+	if (getFragsByType(0x14).empty())
 		return;
 
 	processMaterials();
 
+	//model definitions are almost always named <id>_ACTORDEF
+	std::string actordef = id_name;
+	actordef += "_ACTORDEF";
+	FragHeader* def = getFragByName(actordef.c_str());
+	if (def && def->type == 0x14)
+	{
+		convertMobModel((Frag14*)def, id_name);
+		return;
+	}
+
 	size_t len = strlen(id_name);
 
-	for (FragHeader* frag : mFragsByType[0x14])
+	for (FragHeader* frag : getFragsByType(0x14))
 	{
 		const char* name = getFragName(frag);
-		if (strncmp(id_name, name, len) == 0)
+		if (name && strncmp(id_name, name, len) == 0)
 		{
 			convertMobModel((Frag14*)frag, id_name);
 			return;
@@ -524,21 +928,44 @@ void WLD::convertMobModel(const char* id_name)
 
 void WLD::convertAllMobModels()
 {
-	if (mFragsByType.count(0x14) == 0)
+	if (getFragsByType(0x14).empty())
 		return;
 
 	processMaterials();
 
-	int n = mFragsByType[0x14].size();
+	int n = getFragsByType(0x14).size();
 	int i = 0;
-	for (FragHeader* frag : mFragsByType[0x14])
+	for (FragHeader* frag : getFragsByType(0x14))
 	{
 		printf("%i of %i: %s\n", i++, n, getFragName(frag));
 		convertMobModel((Frag14*)frag, std::string(getFragName(frag), 3));
 	}
+
+	mMeshStats.print(mShortName.c_str());
 }
 
-//#define ZEQ_LOAD_WLD_ANIMATIONS 1
+void WLD::indexMobModels()
+{
+	if (getFragsByType(0x14).empty())
+		return;
+
+	//done up front so that conversions never have to decode strings concurrently
+	processMaterials();
+
+	uint32 n = 0;
+	for (FragHeader* frag : getFragsByType(0x14))
+	{
+		Frag14* f14 = (Frag14*)frag;
+		if (f14->size[1] < 1)
+			continue;
+
+		std::string model_id(getFragName(frag), 3);
+		gMobMgr.addModelSource(Translate::raceID(model_id), Translate::gender(model_id), mShortName, model_id.c_str());
+		++n;
+	}
+
+	printf("%s: indexed %u mob models\n", mShortName.c_str(), n);
+}
 
 void WLD::convertMobModel(Frag14* f14, std::string model_id)
 {
@@ -550,9 +977,9 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 	if (gMobMgr.modelPrototypeLoaded(race, gender))
 		return;
 
-	//should handle this separately from zones in a lot of ways
-	//should not load all material textures off the bat in case we are only using 1 out of 10 models in a WLD, for one
-	
+	//models are converted on demand, possibly from several threads; the material buffers are shared scratch space
+	std::lock_guard<std::mutex> lock(mConvertMutex);
+	processMaterials();
 	initMaterialBuffers();
 
 	//0x14 -> 0x11 -> 0x10 -> 0x13 -> 0x12
@@ -578,24 +1005,21 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 	}
 
 	WLDSkeleton* skele = new WLDSkeleton(f10->num_bones, mesh);
-	//change to animation id numbers later
-#ifdef ZEQ_LOAD_WLD_ANIMATIONS
-	std::unordered_map<int, std::unordered_map<std::string, Frag13*, std::hash<std::string>>> animFragsByBone;
+	//each bone's animation tracks, by animation id
+	std::vector<std::unordered_map<int, Frag13*>> animFragsByBone(f10->num_bones);
 
 	auto findAnimations = [&, this](const char* baseName, int bonePos)
 	{
-		for (FragHeader* frag : mFragsByType[0x13])
+		uint32 count;
+		Frag13** tracks = getAnimationTracks(baseName, count);
+		for (uint32 i = 0; i < count; ++i)
 		{
-			const char* name = getFragName(frag);
-			if (strcmp(name + 3, baseName) != 0)
-				continue;
-
-			Frag13* f13 = (Frag13*)frag;
-			auto& anims = animFragsByBone[bonePos];
-			anims[std::string(name, 3)] = f13;
+			Frag13* f13 = tracks[i];
+			int animID = Translate::animationID(std::string(getFragName(f13), 3));
+			if (animID > 0)
+				animFragsByBone[bonePos][animID] = f13;
 		}
 	};
-#endif
 
 	//handle root bone
 	int* ptr;
@@ -603,9 +1027,7 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 	const char* f13name = getFragName(f13);
 	Frag12* f12 = (Frag12*)getFragByRef(f13->ref);
 	skele->setBasePosition(0, f12->entry[0]);
-#ifdef ZEQ_LOAD_WLD_ANIMATIONS
 	findAnimations(f13name, 0);
-#endif
 
 	bone = rootBone;
 	for (int i = 0; i < f10->num_bones; ++i)
@@ -641,13 +1063,11 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 						break;
 					}
 				}
-#ifdef ZEQ_LOAD_WLD_ANIMATIONS
 				else
 				{
 					//attachment points never have animation frames
 					findAnimations(f13name, *ptr);
 				}
-#endif
 
 				skele->setBasePosition(*ptr++, f12->entry[0], i, point);
 			}
@@ -655,10 +1075,9 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 		bone = bone->getNext();
 	}
 
-#ifdef ZEQ_LOAD_WLD_ANIMATIONS
 	//create animations
 	//the root bone's frag13 has the timing information,
-	//while its children's frag12s have the number of frames
+	//while its children's frag12s have the number of frames (the most of any child, some only have 1)
 	for (auto& pair : animFragsByBone[0])
 	{
 		ptr = rootBone->getIndexList();
@@ -666,12 +1085,10 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 
 		for (int i = 0; i < rootBone->size; ++i)
 		{
-			if (animFragsByBone.count(*ptr) && animFragsByBone[*ptr].count(pair.first))
+			auto it = animFragsByBone[*ptr].find(pair.first);
+			if (it != animFragsByBone[*ptr].end())
 			{
-				//we're taking it on faith that the first one we find has more than 1 frame
-				//^ not reliable, as it turns out
-				f13 = animFragsByBone[*ptr][pair.first];
-				f12 = (Frag12*)getFragByRef(f13->ref);
+				f12 = (Frag12*)getFragByRef(it->second->ref);
 				skele->addAnimation(pair.first, f12->count, timing);
 			}
 			++ptr;
@@ -687,7 +1104,7 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 	}
 
 	//now for all child bones
-	for (auto& pair : animFragsByBone[0]) //for each animation name
+	for (auto& pair : animFragsByBone[0]) //for each animation
 	{
 		bone = rootBone;
 		for (int i = 0; i < f10->num_bones; ++i)
@@ -698,8 +1115,9 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 				for (int j = 0; j < bone->size; ++j)
 				{
 					f12 = nullptr;
-					if (animFragsByBone.count(*ptr) && animFragsByBone[*ptr].count(pair.first))
-						f12 = (Frag12*)getFragByRef(animFragsByBone[*ptr][pair.first]->ref);
+					auto it = animFragsByBone[*ptr].find(pair.first);
+					if (it != animFragsByBone[*ptr].end())
+						f12 = (Frag12*)getFragByRef(it->second->ref);
 
 					skele->addAnimationFrames(pair.first, f12, *ptr++, i);
 				}
@@ -707,17 +1125,35 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 			bone = bone->getNext();
 		}
 	}
-#endif
+
+	//pack the frames before any copies of the skeleton are made for additional meshes, they share the store
+	skele->finishAnimations();
+	uint32 packed, unpacked;
+	skele->getAnimationMemory(packed, unpacked);
+	printf("%s: %u animations, %.1f KB (%.1f KB unpacked)\n", model_id.c_str(), (uint32)animFragsByBone[0].size(),
+		(double)packed / 1024.0, (double)unpacked / 1024.0);
 
 	//find meshes
 	//some models (really simple ones?) don't have the reference section
 	//refs to the model mesh frags are probably in the frag10bone parts instead
 	if (f10->hasRefList())
 	{
+		//the prototype is only handed to the MobManager once all its heads are done
+		WLDSkeleton* body = nullptr;
+		std::vector<WLDSkeleton*> heads;
+
 		int numMeshes;
 		ref_ptr = f10->getRefList(numMeshes);
 		for (int n = 0; n < numMeshes; ++n)
 		{
+			Frag2D* f2d = (Frag2D*)getFragByRef(*ref_ptr++);
+
+			FragHeader* frag = getFragByRef(f2d->ref);
+			const char* modelFragName = getFragName(frag);
+			printf("%s 0x%0.2X\n", modelFragName, frag->type);
+			if (frag->type == 0x2C)
+				break; //handle this
+
 			if (n > 0)
 			{
 				//make a copy of the skeleton
@@ -727,15 +1163,8 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 				skele = copy;
 			}
 
-			Frag2D* f2d = (Frag2D*)getFragByRef(*ref_ptr++);
-
-			FragHeader* frag = getFragByRef(f2d->ref);
-			const char* modelFragName = getFragName(frag);
-			printf("%s 0x%0.2X\n", modelFragName, frag->type);
 			if (frag->type == 0x36)
 				processMesh((Frag36*)frag, skele);
-			else if (frag->type == 0x2C)
-				return; //handle this
 
 			//find any vertex + index buffers with data in them and use them to fill this mesh
 			uint32 usedBuffers = 0;
@@ -743,7 +1172,7 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 			{
 				if (!mMaterialVertexBuffers[i].empty())
 				{
-					createMeshBuffer(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], &mMaterials[i], skele);
+					createMeshBuffer(mesh, mMaterialVertexBuffers[i], mMaterialIndexBuffers[i], getMaterial(i), skele, false);
 					mMaterialVertexBuffers[i].clear();
 					mMaterialIndexBuffers[i].clear();
 
@@ -764,9 +1193,16 @@ void WLD::convertMobModel(Frag14* f14, std::string model_id)
 
 			//check if this is a head mesh
 			bool head = (strncmp(modelFragName + 3, "HE", 2) == 0);
-			gMobMgr.addModelPrototype(race, gender, skele, head);
+			skele->buildSkinStreams();
+			if (head)
+				heads.push_back(skele);
+			else if (body == nullptr)
+				body = skele;
 			//need to look up any alternate heads by name...
 			//alternate texture sets, too
 		}
+
+		if (body)
+			gMobMgr.addModelPrototype(race, gender, body, heads);
 	}
 }
@@ -8,6 +8,7 @@
 #include <vector>
 #include <unordered_map>
 #include <cstring>
+#include <mutex>
 
 #include "types.h"
 #include "util.h"
@@ -41,35 +42,99 @@ private:
 		static const uint32 VERSION2 = 0x1000C800;
 	};
 
+	MemoryStream* mFile;
 	Header* mHeader;
 	int mVersion;
 
-	std::vector<FragHeader*> mFragsByIndex;
-	std::unordered_map<uint32, std::vector<FragHeader*>> mFragsByType;
-	std::unordered_map<uint32, FragHeader*> mFragsByNameRef;
+	//names are hashed in place in the string block rather than copied into std::strings
+	struct NameHash
+	{
+		size_t operator()(const char* str) const
+		{
+			//FNV-1a
+			size_t hash = 2166136261U;
+			while (*str)
+				hash = (hash ^ (byte)*str++) * 16777619U;
+			return hash;
+		}
+	};
+
+	struct NameEqual
+	{
+		bool operator()(const char* a, const char* b) const { return strcmp(a, b) == 0; }
+	};
+
+	struct IndexRange
+	{
+		uint32 start;
+		uint32 count;
+	};
 
+	static const uint32 MAX_FRAG_TYPE = 0x40;
+
+	std::vector<FragHeader*> mFragsByIndex;
+	//all frags grouped by type in one array: type t occupies [mFragTypeStart[t], mFragTypeStart[t + 1])
+	std::vector<FragHeader*> mFragsByType;
+	uint32 mFragTypeStart[MAX_FRAG_TYPE + 1];
+	//frag index for each string block offset that names a frag, 0 if none
+	std::vector<uint32> mFragIndexByNameRef;
+	std::unordered_map<const char*, uint32, NameHash, NameEqual> mFragIndexByName;
+	//animation tracks are named <3 letter animation id><bone track name>; indexed by the part after the animation id
+	std::vector<Frag13*> mTracksBySuffix;
+	std::unordered_map<const char*, IndexRange, NameHash, NameEqual> mTrackRangesBySuffix;
+
+	bool mMaterialsProcessed;
 	std::unordered_map<Frag30*, int> mMaterialIndicesByFrag30;
+	std::vector<Frag30*> mMaterialFrag30s;
+	std::vector<byte> mMaterialsLoaded;
+	std::mutex mConvertMutex;
 	std::unordered_map<Frag03*, const char*> mTexturesByFrag03;
 
 	std::unordered_map<scene::CSkinnedMesh::SJoint*, std::unordered_map<std::string, Frag13*, std::hash<std::string>>> mAnimFragsByJoint;
 
 private:
 	void processMaterials();
+	IntermediateMaterial* getMaterial(uint32 index); //creates the material's textures on first use
 	void Frag03ToMaterialEntry(Frag03* f03, Frag30* f30, IntermediateMaterialEntry* mat_ent);
 	void handleAnimatedMaterial(Frag04* f04, Frag30* f30, IntermediateMaterial* mat);
 	static uint32 translateVisibilityFlag(Frag30* f30, bool isDDS);
 	void processMesh(Frag36* f36, WLDSkeleton* skele = nullptr);
 	void processTriangle(RawTriangle* tri, uint32 count, std::vector<video::S3DVertex>& vert_buf,
 		std::vector<uint32>& index_buf, RawVertex* vert, RawNormal* norm, RawUV16* uv16, RawUV32* uv32);
+	//fills regions from the 0x21 tree and 0x22 regions, and lists each region's mesh (null if it has none);
+	//false if this isn't a zone with a tree
+	bool readRegions(ZoneRegions& regions, std::vector<Frag36*>& region_meshes, std::vector<core::vector3df>& region_centers,
+		std::vector<uint8>& region_has_center);
+	//region types from the 0x29 fragments, and where each zone line is
+	void readRegionTypes(RegionMap& map, const std::vector<core::vector3df>& region_centers,
+		const std::vector<uint8>& region_has_center);
+	static bool decodeVisibleList(byte* data, uint32 count, bool rle, uint32 region_count, std::vector<uint32>& out);
 
-	void convertMobModel(Frag14* f14, std::string model_id);
-	
 public:
 	WLD(MemoryStream* mem, S3D* s3d, std::string shortname);
+	virtual ~WLD();
 	
 	static void decodeString(void* str, size_t len);
 
+	class FragList
+	{
+	private:
+		FragHeader* const* mBegin;
+		FragHeader* const* mEnd;
+
+	public:
+		FragList(FragHeader* const* begin, FragHeader* const* end) : mBegin(begin), mEnd(end) { }
+		FragHeader* const* begin() const { return mBegin; }
+		FragHeader* const* end() const { return mEnd; }
+		uint32 size() const { return mEnd - mBegin; }
+		bool empty() const { return mBegin == mEnd; }
+	};
+
+	FragList getFragsByType(uint32 type);
 	FragHeader* getFragByRef(int ref);
+	FragHeader* getFragByName(const char* name);
+	//every animation's track for the bone whose rest track is named base_name; count is 0 if there are none
+	Frag13** getAnimationTracks(const char* base_name, uint32& count);
 	const char* getFragName(FragHeader* frag);
 	const char* getFragName(int ref);
 
@@ -79,6 +144,9 @@ public:
 	void convertZoneObjectDefinitions(ZoneModel* zone);
 	void convertZoneObjectPlacements(ZoneModel* zone);
 
+	//registers each model with the MobManager, to be converted when something first spawns with it
+	void indexMobModels();
+	void convertMobModel(Frag14* f14, std::string model_id);
 	void convertMobModel(const char* id_name);
 	void convertAllMobModels();
 };
@@ -1,13 +1,24 @@
 
 #include "wld_skeleton.h"
 #include "mob.h"
+#include "renderer.h"
+#include "micro_timer.h"
+
+extern Renderer gRenderer;
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define ZEQ_SKIN_SSE
+#endif
+
+bool WLDSkeleton::sReferenceSkinning = false;
 
 WLDSkeleton::WLDSkeleton(uint32 num_bones, scene::SMesh* reference_mesh) :
 	mIsCopy(false),
 	mNumBones(num_bones),
-	mNumFrames(0),
 	mHasPoint(0),
-	mReferenceMesh(reference_mesh)
+	mReferenceMesh(reference_mesh),
+	mAnimations(new AnimationStore)
 {
 	mBasePosition.bones = new BaseFrame[num_bones];
 
@@ -19,23 +30,16 @@ WLDSkeleton::WLDSkeleton(uint32 num_bones, scene::SMesh* reference_mesh) :
 WLDSkeleton::WLDSkeleton(const WLDSkeleton& toCopy) :
 	mIsCopy(true),
 	mNumBones(toCopy.mNumBones),
-	mNumFrames(toCopy.mNumFrames),
-	mHasPoint(toCopy.mHasPoint)
+	mHasPoint(toCopy.mHasPoint),
+	mAnimations(toCopy.mAnimations)
 {
 	//copied WLDSkeletons share base positions and animation frames,
 	//but not weights or reference meshes
 	mBasePosition.bones = toCopy.mBasePosition.bones;
 
-	for (uint32 i = 0; i < mNumFrames; ++i)
-	{
-		mFrames.push_back(toCopy.mFrames[i]);
-	}
-
 	mWeightsByBone = new std::vector<Weight>[mNumBones];
 	for (uint32 i = 0; i < mNumBones; ++i)
 		new (&mWeightsByBone[i]) std::vector<Weight>;
-
-	mAnimations = toCopy.mAnimations;
 }
 
 void WLDSkeleton::getPosRot(Frag12Entry& f12, core::vector3df& pos, core::vector3df& rot)
@@ -86,9 +90,8 @@ void WLDSkeleton::moveVertex(const video::S3DVertex& refVert, video::S3DVertex&
 	//add shifts
 	vert.Pos += by.pos;
 
-	//same for normals
+	//normals are only rotated
 	Util::rotateBy(vert.Normal, by.rot);
-	vert.Normal += by.pos;
 }
 
 void WLDSkeleton::addWeight(int bone, uint32 buffer, uint32 vert)
@@ -142,47 +145,43 @@ void WLDSkeleton::setBasePosition(int bone_id, Frag12Entry& f12, int parent_id,
 	bone.bone.rot = rot;
 }
 
-void WLDSkeleton::addAnimation(std::string animName, uint32 num_frames, uint32 frame_delay)
+void WLDSkeleton::addAnimation(int anim_id, uint32 num_frames, uint32 frame_delay)
 {
-	Animation anim;
-	anim.frame_delay = (float)frame_delay * 0.0005f; //hard to tell what the frame rate conversion factor is supposed to be
-	anim.start_frame = mNumFrames;
-	anim.end_frame = mNumFrames + num_frames - 1;
-
-	mAnimations[animName] = anim;
+	if (anim_id <= 0 || num_frames == 0)
+		return;
 
-	printf("created animation %s with %u frames from %u to %u with %g delay\n", animName.c_str(), num_frames,
-		anim.start_frame, anim.end_frame, anim.frame_delay);
+	AnimationBuilder& build = mAnimationBuilders[anim_id];
+	if (num_frames <= build.num_frames)
+		return;
 
-	mNumFrames += num_frames;
-	for (uint32 i = 0; i < num_frames; ++i)
-	{
-		FrameSkeleton fs;
-		fs.bones = new Frame[mNumBones];
-		mFrames.push_back(fs);
-	}
+	build.num_frames = num_frames;
+	build.frame_delay = frame_delay;
+	build.frames.resize(num_frames * mNumBones);
 }
 
-void WLDSkeleton::addAnimationFrames(std::string animName, Frag12* f12, int bone_id, int parent_id)
+void WLDSkeleton::addAnimationFrames(int anim_id, Frag12* f12, int bone_id, int parent_id)
 {
+	auto it = mAnimationBuilders.find(anim_id);
+	if (it == mAnimationBuilders.end())
+		return;
+
+	AnimationBuilder& build = it->second;
+	const uint32 num_frames = build.num_frames;
 	core::vector3df pos, rot;
-	Animation& anim = mAnimations[animName];
-	uint32 num_frames = (anim.end_frame - anim.start_frame) + 1;
 
 	if (f12)
 	{
 		uint32 count;
-		Frame* frame;
-		for (count = 0; count < f12->count; ++count)
+		Frame* frame = nullptr;
+		for (count = 0; count < f12->count && count < num_frames; ++count)
 		{
-			uint32 n = anim.start_frame + count;
-			frame = &mFrames[n].bones[bone_id];
+			frame = &build.frames[count * mNumBones + bone_id];
 			Frag12Entry& ent = f12->entry[count];
 			getPosRot(ent, pos, rot);
 
 			if (parent_id != -1)
 			{
-				Frame& parent = mFrames[n].bones[parent_id];
+				Frame& parent = build.frames[count * mNumBones + parent_id];
 				inheritPosRot(pos, rot, parent);
 			}
 
@@ -190,18 +189,18 @@ void WLDSkeleton::addAnimationFrames(std::string animName, Frag12* f12, int bone
 			frame->rot = rot;
 		}
 
-		while (count < num_frames)
+		while (frame && count < num_frames)
 		{
 			//less frames than expected (i.e., 1)
 			//fill remaining frames with a copy of the last frame
-			Frame& fr = mFrames[anim.start_frame + count].bones[bone_id];
+			Frame& fr = build.frames[count * mNumBones + bone_id];
 			fr.pos = frame->pos;
 			fr.rot = frame->rot;
 
 			++count;
 		}
 	}
-	else
+	else if (parent_id != -1)
 	{
 		//attachment point, no frag12
 		//all frames are our base position modified by the frame of our parent
@@ -212,43 +211,308 @@ void WLDSkeleton::addAnimationFrames(std::string animName, Frag12* f12, int bone
 			pos = point.pos;
 			rot = point.rot;
 
-			uint32 n = anim.start_frame + count;
-			Frame& parent = mFrames[n].bones[parent_id];
+			Frame& parent = build.frames[count * mNumBones + parent_id];
 			inheritPosRot(pos, rot, parent);
 
-			Frame& frame = mFrames[n].bones[bone_id];
+			Frame& frame = build.frames[count * mNumBones + bone_id];
 			frame.pos = pos;
 			frame.rot = rot;
 		}
 	}
 }
 
+int16 WLDSkeleton::packRotation(float rot)
+{
+	//rotations only matter modulo 2 pi, wrap to [-pi, pi) and use the full int16 range for that
+	static const float TWO_PI = 2.0f * core::PI;
+	rot = fmodf(rot + core::PI, TWO_PI);
+	if (rot < 0.0f)
+		rot += TWO_PI;
+	rot -= core::PI;
+
+	int q = (int)floorf(rot * (32768.0f / core::PI) + 0.5f);
+	if (q > 32767)
+		q -= 65536;
+	return (int16)q;
+}
+
+void WLDSkeleton::finishAnimations()
+{
+	if (mAnimationBuilders.empty())
+		return;
+
+	AnimationStore* store = mAnimations.get();
+
+	for (auto& pair : mAnimationBuilders)
+	{
+		AnimationBuilder& build = pair.second;
+
+		if ((int)store->animations.size() <= pair.first)
+		{
+			Animation none;
+			none.first = 0;
+			none.num_frames = 0;
+			none.frame_delay = 0.0f;
+			none.pos_scale = 0.0f;
+			store->animations.resize(pair.first + 1, none);
+		}
+
+		float maxPos = 0.0f;
+		for (Frame& fr : build.frames)
+		{
+			maxPos = core::max_(maxPos, fabsf(fr.pos.X), fabsf(fr.pos.Y));
+			maxPos = core::max_(maxPos, fabsf(fr.pos.Z));
+		}
+
+		Animation& anim = store->animations[pair.first];
+		anim.first = store->frames.size();
+		anim.num_frames = build.num_frames;
+		anim.frame_delay = (float)build.frame_delay * 0.0005f; //hard to tell what the frame rate conversion factor is supposed to be
+		anim.pos_scale = (maxPos > 0.0f) ? maxPos / 32767.0f : 1.0f;
+
+		const float toPacked = 1.0f / anim.pos_scale;
+		for (Frame& fr : build.frames)
+		{
+			PackedFrame packed;
+			packed.pos[0] = (int16)floorf(fr.pos.X * toPacked + 0.5f);
+			packed.pos[1] = (int16)floorf(fr.pos.Y * toPacked + 0.5f);
+			packed.pos[2] = (int16)floorf(fr.pos.Z * toPacked + 0.5f);
+			packed.rot[0] = packRotation(fr.rot.X);
+			packed.rot[1] = packRotation(fr.rot.Y);
+			packed.rot[2] = packRotation(fr.rot.Z);
+			store->frames.push_back(packed);
+		}
+	}
+
+	mAnimationBuilders.clear();
+}
+
+bool WLDSkeleton::hasAnimation(int anim_id)
+{
+	return anim_id > 0 && anim_id < (int)mAnimations->animations.size() && mAnimations->animations[anim_id].num_frames > 0;
+}
+
+void WLDSkeleton::getAnimationMemory(uint32& packed, uint32& unpacked)
+{
+	uint32 frames = 0;
+	for (Animation& anim : mAnimations->animations)
+		frames += anim.num_frames;
+
+	packed = mAnimations->frames.size() * sizeof(PackedFrame) + mAnimations->animations.size() * sizeof(Animation);
+	//previous layout: a vector entry pointing to a separate new Frame[mNumBones] for every frame, plus a string keyed map entry per animation
+	unpacked = frames * (sizeof(Frame*) + mNumBones * sizeof(Frame)) + frames * 16 //heap block overhead
+		+ mAnimations->animations.size() * (sizeof(Animation) + sizeof(std::string) + 16);
+}
+
+void WLDSkeleton::unpackFrame(const Animation& anim, const PackedFrame& packed, Frame& frame)
+{
+	static const float ROT_SCALE = core::PI / 32768.0f;
+	frame.pos.set(packed.pos[0] * anim.pos_scale, packed.pos[1] * anim.pos_scale, packed.pos[2] * anim.pos_scale);
+	frame.rot.set(packed.rot[0] * ROT_SCALE, packed.rot[1] * ROT_SCALE, packed.rot[2] * ROT_SCALE);
+}
+
+void WLDSkeleton::unpackFrame(const Animation& anim, const PackedFrame& cur, const PackedFrame& next, float percent, Frame& frame)
+{
+	static const float ROT_SCALE = core::PI / 32768.0f;
+
+	float pos[3], rot[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		pos[i] = (float)cur.pos[i] + (float)(next.pos[i] - cur.pos[i]) * percent;
+
+		//take the short way around when a rotation crosses the wrap point
+		int diff = next.rot[i] - cur.rot[i];
+		if (diff > 32767)
+			diff -= 65536;
+		else if (diff < -32768)
+			diff += 65536;
+		rot[i] = (float)cur.rot[i] + (float)diff * percent;
+	}
+
+	frame.pos.set(pos[0] * anim.pos_scale, pos[1] * anim.pos_scale, pos[2] * anim.pos_scale);
+	frame.rot.set(rot[0] * ROT_SCALE, rot[1] * ROT_SCALE, rot[2] * ROT_SCALE);
+}
+
+void WLDSkeleton::moveBone(uint32 bone, scene::SMesh* mesh, Frame& by)
+{
+	//for each vertex assigned to that bone
+	std::vector<Weight>& weights = mWeightsByBone[bone];
+	uint16 prev_index = 65535;
+	video::S3DVertex* refVerts;
+	video::S3DVertex* verts;
+	for (Weight& wt : weights)
+	{
+		if (wt.buffer_index != prev_index)
+		{
+			refVerts = (video::S3DVertex*)mReferenceMesh->getMeshBuffer(wt.buffer_index)->getVertices();
+			verts = (video::S3DVertex*)mesh->getMeshBuffer(wt.buffer_index)->getVertices();
+			prev_index = wt.buffer_index;
+		}
+
+		const video::S3DVertex& refVert = refVerts[wt.vert_index];
+		video::S3DVertex& vert = verts[wt.vert_index];
+
+		moveVertex(refVert, vert, by);
+	}
+}
+
+void WLDSkeleton::buildSkinStreams()
+{
+	uint32 total = 0;
+	for (uint32 b = 0; b < mNumBones; ++b)
+		total += mWeightsByBone[b].size();
+
+	mSkin.px.resize(total);
+	mSkin.py.resize(total);
+	mSkin.pz.resize(total);
+	mSkin.nx.resize(total);
+	mSkin.ny.resize(total);
+	mSkin.nz.resize(total);
+	mSkin.targets.clear();
+	mSkin.targets.reserve(total);
+	mSkin.boneStart.resize(mNumBones + 1);
+
+	uint32 n = 0;
+	for (uint32 b = 0; b < mNumBones; ++b)
+	{
+		mSkin.boneStart[b] = n;
+		for (Weight& wt : mWeightsByBone[b])
+		{
+			video::S3DVertex* refVerts = (video::S3DVertex*)mReferenceMesh->getMeshBuffer(wt.buffer_index)->getVertices();
+			const video::S3DVertex& ref = refVerts[wt.vert_index];
+
+			mSkin.px[n] = ref.Pos.X;
+			mSkin.py[n] = ref.Pos.Y;
+			mSkin.pz[n] = ref.Pos.Z;
+			mSkin.nx[n] = ref.Normal.X;
+			mSkin.ny[n] = ref.Normal.Y;
+			mSkin.nz[n] = ref.Normal.Z;
+			mSkin.targets.push_back(wt);
+			++n;
+		}
+	}
+	mSkin.boneStart[mNumBones] = n;
+}
+
+void WLDSkeleton::makeBoneTransform(const Frame& frame, BoneTransform& out)
+{
+	//equivalent to Util::rotateBy's three rotations in a row, but with the sines and cosines done once per bone
+	const float sx = sinf(frame.rot.X), cx = cosf(frame.rot.X);
+	const float sy = sinf(frame.rot.Y), cy = cosf(frame.rot.Y);
+	const float sz = sinf(frame.rot.Z), cz = cosf(frame.rot.Z);
+
+	out.m[0] = cz * cy;
+	out.m[1] = cz * sy * sx - sz * cx;
+	out.m[2] = cz * sy * cx + sz * sx;
+	out.m[3] = sz * cy;
+	out.m[4] = sz * sy * sx + cz * cx;
+	out.m[5] = sz * sy * cx - cz * sx;
+	out.m[6] = -sy;
+	out.m[7] = cy * sx;
+	out.m[8] = cy * cx;
+
+	out.t[0] = frame.pos.X;
+	out.t[1] = frame.pos.Y;
+	out.t[2] = frame.pos.Z;
+}
+
+bool WLDSkeleton::getBufferVertices(scene::SMesh* mesh, video::S3DVertex** out)
+{
+	uint32 count = mesh->getMeshBufferCount();
+	if (count > MAX_SKIN_BUFFERS)
+		return false;
+
+	for (uint32 i = 0; i < count; ++i)
+		out[i] = (video::S3DVertex*)mesh->getMeshBuffer(i)->getVertices();
+	return true;
+}
+
+void WLDSkeleton::skinBone(uint32 bone, const BoneTransform& xf, video::S3DVertex** buf_verts)
+{
+	const uint32 end = mSkin.boneStart[bone + 1];
+	const float* m = xf.m;
+	const float* t = xf.t;
+	uint32 i = mSkin.boneStart[bone];
+
+#ifdef ZEQ_SKIN_SSE
+	const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+	const __m128 m3 = _mm_set1_ps(m[3]), m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]);
+	const __m128 m6 = _mm_set1_ps(m[6]), m7 = _mm_set1_ps(m[7]), m8 = _mm_set1_ps(m[8]);
+	const __m128 t0 = _mm_set1_ps(t[0]), t1 = _mm_set1_ps(t[1]), t2 = _mm_set1_ps(t[2]);
+	float out[6][4];
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&mSkin.px[i]);
+		__m128 y = _mm_loadu_ps(&mSkin.py[i]);
+		__m128 z = _mm_loadu_ps(&mSkin.pz[i]);
+
+		_mm_storeu_ps(out[0], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m1, y)), _mm_add_ps(_mm_mul_ps(m2, z), t0)));
+		_mm_storeu_ps(out[1], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, x), _mm_mul_ps(m4, y)), _mm_add_ps(_mm_mul_ps(m5, z), t1)));
+		_mm_storeu_ps(out[2], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, x), _mm_mul_ps(m7, y)), _mm_add_ps(_mm_mul_ps(m8, z), t2)));
+
+		x = _mm_loadu_ps(&mSkin.nx[i]);
+		y = _mm_loadu_ps(&mSkin.ny[i]);
+		z = _mm_loadu_ps(&mSkin.nz[i]);
+
+		_mm_storeu_ps(out[3], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m1, y)), _mm_mul_ps(m2, z)));
+		_mm_storeu_ps(out[4], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, x), _mm_mul_ps(m4, y)), _mm_mul_ps(m5, z)));
+		_mm_storeu_ps(out[5], _mm_add_ps(_mm_add_ps(_mm_mul_ps(m6, x), _mm_mul_ps(m7, y)), _mm_mul_ps(m8, z)));
+
+		//the mesh buffers are irrlicht's interleaved vertices, so the results are scattered back one by one
+		for (int k = 0; k < 4; ++k)
+		{
+			const Weight& wt = mSkin.targets[i + k];
+			video::S3DVertex& vert = buf_verts[wt.buffer_index][wt.vert_index];
+			vert.Pos.set(out[0][k], out[1][k], out[2][k]);
+			vert.Normal.set(out[3][k], out[4][k], out[5][k]);
+		}
+	}
+#endif
+
+	//leftovers, or everything without SSE
+	for (; i < end; ++i)
+	{
+		const float x = mSkin.px[i], y = mSkin.py[i], z = mSkin.pz[i];
+		const float nx = mSkin.nx[i], ny = mSkin.ny[i], nz = mSkin.nz[i];
+		const Weight& wt = mSkin.targets[i];
+		video::S3DVertex& vert = buf_verts[wt.buffer_index][wt.vert_index];
+
+		vert.Pos.set(
+			m[0] * x + m[1] * y + m[2] * z + t[0],
+			m[3] * x + m[4] * y + m[5] * z + t[1],
+			m[6] * x + m[7] * y + m[8] * z + t[2]);
+		vert.Normal.set(
+			m[0] * nx + m[1] * ny + m[2] * nz,
+			m[3] * nx + m[4] * ny + m[5] * nz,
+			m[6] * nx + m[7] * ny + m[8] * nz);
+	}
+}
+
+void WLDSkeleton::poseBone(uint32 bone, scene::SMesh* mesh, video::S3DVertex** buf_verts, Frame& frame)
+{
+	if (buf_verts == nullptr)
+	{
+		moveBone(bone, mesh, frame);
+		return;
+	}
+
+	BoneTransform xf;
+	makeBoneTransform(frame, xf);
+	skinBone(bone, xf, buf_verts);
+}
+
 void WLDSkeleton::assumeBasePosition(scene::SMesh* mesh)
 {
+	video::S3DVertex* bufVerts[MAX_SKIN_BUFFERS];
+	bool batched = !sReferenceSkinning && !mSkin.boneStart.empty() && getBufferVertices(mesh, bufVerts);
+
 	//for each bone...
 	for (uint32 b = 0; b < mNumBones; ++b)
 	{
 		BaseFrame& base = mBasePosition.bones[b];
 		Frame& bone = base.bone;
-		//for each vertex assigned to that bone
-		std::vector<Weight>& weights = mWeightsByBone[b];
-		uint16 prev_index = 65535;
-		video::S3DVertex* refVerts;
-		video::S3DVertex* verts;
-		for (Weight& wt : weights)
-		{
-			if (wt.buffer_index != prev_index)
-			{
-				refVerts = (video::S3DVertex*)mReferenceMesh->getMeshBuffer(wt.buffer_index)->getVertices();
-				verts = (video::S3DVertex*)mesh->getMeshBuffer(wt.buffer_index)->getVertices();
-				prev_index = wt.buffer_index;
-			}
-
-			const video::S3DVertex& refVert = refVerts[wt.vert_index];
-			video::S3DVertex& vert = verts[wt.vert_index];
-			
-			moveVertex(refVert, vert, bone);
-		}
+		poseBone(b, mesh, batched ? bufVerts : nullptr, bone);
 
 		if (base.attachment_point)
 		{
@@ -258,167 +522,332 @@ void WLDSkeleton::assumeBasePosition(scene::SMesh* mesh)
 	}
 }
 
-uint32 WLDSkeleton::animate(std::string animName, scene::SMesh* mesh, uint32 cur_frame, float& time, bool& ended)
+uint32 WLDSkeleton::advance(int anim_id, uint32 cur_frame, float& time, bool& ended, float& percent)
 {
-	Animation& anim = mAnimations[animName];
-	uint32 num_frames = (anim.end_frame - anim.start_frame) + 1;
+	percent = 0.0f;
+	if (!hasAnimation(anim_id))
+		return 0;
+
+	const Animation& anim = mAnimations->animations[anim_id];
+	uint32 num_frames = anim.num_frames;
 
-	if (time >= anim.frame_delay)
+	if (time >= anim.frame_delay && anim.frame_delay > 0.0f)
 	{
-		//advance frame
-		uint32 advanceBy = 0;
-		while (time > anim.frame_delay)
-		{
-			time -= anim.frame_delay;
-			++advanceBy;
-		}
+		//advance frame; time can build up over several frames when animation LOD skips a mob
+		uint32 advanceBy = (uint32)(time / anim.frame_delay);
+		time -= (float)advanceBy * anim.frame_delay;
 
-		cur_frame += advanceBy;
-		while (cur_frame >= num_frames)
-			cur_frame -= num_frames;
+		cur_frame = (cur_frame + advanceBy) % num_frames;
 	}
 
-	float percent;
 	uint32 next_frame = cur_frame + 1;
 	if (next_frame == num_frames)
 	{
 		percent = 1.0f;
 		ended = true;
 	}
-	else
+	else if (anim.frame_delay > 0.0f)
 	{
 		percent = time / anim.frame_delay;
 	}
 
-	FrameSkeleton& curFrame = mFrames[anim.start_frame + cur_frame];
+	return cur_frame;
+}
 
-	if (percent < 1.0f)
+void WLDSkeleton::pose(int anim_id, scene::SMesh* mesh, Frame* points, uint32 cur_frame, float percent)
+{
+	if (!hasAnimation(anim_id))
+		return;
+
+	const Animation& anim = mAnimations->animations[anim_id];
+
+	//each frame's bones are contiguous, so this walks the store front to back
+	const PackedFrame* curFrame = &mAnimations->frames[anim.first + cur_frame * mNumBones];
+	const PackedFrame* nextFrame = (percent > 0.0f && percent < 1.0f && cur_frame + 1 < anim.num_frames) ? curFrame + mNumBones : nullptr;
+
+	video::S3DVertex* bufVerts[MAX_SKIN_BUFFERS];
+	bool batched = !sReferenceSkinning && !mSkin.boneStart.empty() && getBufferVertices(mesh, bufVerts);
+
+	//for each bone...
+	for (uint32 b = 0; b < mNumBones; ++b)
 	{
-		//interpolate
-		FrameSkeleton& nextFrame = mFrames[anim.start_frame + next_frame];
+		Frame moveFrame;
+		if (nextFrame)
+			unpackFrame(anim, curFrame[b], nextFrame[b], percent, moveFrame); //interpolate
+		else
+			unpackFrame(anim, curFrame[b], moveFrame);
 
-		//for each bone...
-		for (uint32 b = 0; b < mNumBones; ++b)
+		BaseFrame& base = mBasePosition.bones[b];
+		//if it's not an attachment point, move vertices
+		if (base.attachment_point == nullptr)
+		{
+			poseBone(b, mesh, batched ? bufVerts : nullptr, moveFrame);
+		}
+		else if (points)
 		{
-			Frame& cur = curFrame.bones[b];
-			Frame& next = nextFrame.bones[b];
+			//it's an attachment point, just write the interpolated values (maybe?)
+			Frame& point = points[base.attachment_point - mPoints];
+			point.pos = moveFrame.pos;
+			point.rot = moveFrame.rot;
+		}
+	}
+}
 
-			Frame moveFrame;
-			moveFrame.pos = cur.pos + (next.pos - cur.pos) * percent;
-			moveFrame.rot = cur.rot + (next.rot - cur.rot) * percent;
+uint32 WLDSkeleton::animate(int anim_id, scene::SMesh* mesh, Frame* points, uint32 cur_frame, float& time, bool& ended)
+{
+	float percent;
+	cur_frame = advance(anim_id, cur_frame, time, ended, percent);
+	pose(anim_id, mesh, points, cur_frame, percent);
+	return cur_frame;
+}
 
-			BaseFrame& base = mBasePosition.bones[b];
-			//if it's not an attachment point, move vertices
-			if (base.attachment_point == nullptr)
-			{
-				//for each vertex assigned to that bone
-				std::vector<Weight>& weights = mWeightsByBone[b];
-				uint16 prev_index = 65535;
-				video::S3DVertex* refVerts;
-				video::S3DVertex* verts;
-				for (Weight& wt : weights)
-				{
-					if (wt.buffer_index != prev_index)
-					{
-						refVerts = (video::S3DVertex*)mReferenceMesh->getMeshBuffer(wt.buffer_index)->getVertices();
-						verts = (video::S3DVertex*)mesh->getMeshBuffer(wt.buffer_index)->getVertices();
-						prev_index = wt.buffer_index;
-					}
-
-					const video::S3DVertex& refVert = refVerts[wt.vert_index];
-					video::S3DVertex& vert = verts[wt.vert_index];
-			
-					moveVertex(refVert, vert, moveFrame);
-				}
-			}
-			else
-			{
-				//it's an attachment point, just write the interpolated values (maybe?)
-				base.attachment_point->pos = moveFrame.pos;
-				base.attachment_point->rot = moveFrame.rot;
-			}
-		}
+WLDSkeleton::Pose* WLDSkeleton::getPose(int anim_id, uint32 cur_frame, float percent, uint32 frame_number, bool& created)
+{
+	//poses are shared by every mob at the same point of the same animation, to within 1/POSE_STEPS of a frame
+	uint32 step = (uint32)(percent * (float)POSE_STEPS);
+	if (step >= POSE_STEPS)
+	{
+		//the end of the last frame, which doesn't interpolate
+		step = 0;
+	}
+	if (anim_id == 0)
+		cur_frame = 0;
+
+	uint32 key = ((uint32)anim_id << 24) | (cur_frame << 4) | step;
+	created = false;
+
+	auto it = mPoses.find(key);
+	if (it != mPoses.end())
+	{
+		it->second.lastUsed = frame_number;
+		return &it->second;
+	}
+
+	Pose& p = mPoses[key];
+	p.skeleton = this;
+	p.mesh = new scene::SAnimatedMesh(gRenderer.copyMesh(mReferenceMesh));
+	p.mesh->getMesh(0)->drop(); //held by the animated mesh
+	p.anim_id = anim_id;
+	p.frame = cur_frame;
+	p.percent = (percent >= 1.0f) ? 1.0f : (float)step / (float)POSE_STEPS;
+	p.users = 0;
+	p.lastUsed = frame_number;
+	p.skinned = false;
+	for (int i = 0; i < POINT_COUNT; ++i)
+		p.points[i] = mPoints[i];
+
+	if (anim_id == 0)
+	{
+		//base position, cheap and needed right away by new mobs
+		assumeBasePosition((scene::SMesh*)p.mesh->getMesh(0));
+		p.skinned = true;
 	}
 	else
 	{
-		//no interpolation needed
-		//for each bone...
-		for (uint32 b = 0; b < mNumBones; ++b)
+		created = true;
+	}
+
+	return &p;
+}
+
+void WLDSkeleton::skinPose(Pose& p)
+{
+	pose(p.anim_id, (scene::SMesh*)p.mesh->getMesh(0), p.points, p.frame, p.percent);
+	p.skinned = true;
+}
+
+uint32 WLDSkeleton::evictPoses(uint32 frame_number, uint32 linger)
+{
+	uint32 evicted = 0;
+	for (auto it = mPoses.begin(); it != mPoses.end();)
+	{
+		Pose& p = it->second;
+		if (p.users == 0 && it->first != 0 && frame_number - p.lastUsed > linger)
 		{
-			Frame& cur = curFrame.bones[b];
+			p.mesh->drop();
+			it = mPoses.erase(it);
+			++evicted;
+		}
+		else
+		{
+			++it;
+		}
+	}
+	return evicted;
+}
+
+void WLDSkeleton::benchmarkSkinning(scene::SMesh* mesh, uint32 iterations)
+{
+	if (mSkin.boneStart.empty())
+		buildSkinStreams();
 
-			BaseFrame& base = mBasePosition.bones[b];
-			//if it's not an attachment point, move vertices
-			if (base.attachment_point == nullptr)
+	//the longest animation the model has, or just the base position if it has none
+	int animID = 0;
+	uint32 mostFrames = 0;
+	for (uint32 i = 1; i < mAnimations->animations.size(); ++i)
+	{
+		if (mAnimations->animations[i].num_frames > mostFrames)
+		{
+			mostFrames = mAnimations->animations[i].num_frames;
+			animID = i;
+		}
+	}
+
+	const bool prevReference = sReferenceSkinning;
+
+	auto run = [&](bool reference) -> double
+	{
+		sReferenceSkinning = reference;
+		uint32 frame = 0;
+		float time = 0.0f;
+		bool ended;
+
+		MicroTimer timer;
+		for (uint32 i = 0; i < iterations; ++i)
+		{
+			if (animID)
 			{
-				//for each vertex assigned to that bone
-				std::vector<Weight>& weights = mWeightsByBone[b];
-				uint16 prev_index = 65535;
-				video::S3DVertex* refVerts;
-				video::S3DVertex* verts;
-				for (Weight& wt : weights)
-				{
-					if (wt.buffer_index != prev_index)
-					{
-						refVerts = (video::S3DVertex*)mReferenceMesh->getMeshBuffer(wt.buffer_index)->getVertices();
-						verts = (video::S3DVertex*)mesh->getMeshBuffer(wt.buffer_index)->getVertices();
-						prev_index = wt.buffer_index;
-					}
-
-					const video::S3DVertex& refVert = refVerts[wt.vert_index];
-					video::S3DVertex& vert = verts[wt.vert_index];
-			
-					moveVertex(refVert, vert, cur);
-				}
+				time += 0.016f;
+				frame = animate(animID, mesh, nullptr, frame, time, ended);
 			}
 			else
 			{
-				//it's an attachment point, just write the interpolated values (maybe?)
-				base.attachment_point->pos = cur.pos;
-				base.attachment_point->rot = cur.rot;
+				assumeBasePosition(mesh);
 			}
 		}
-	}
+		return (double)timer.getElapsed();
+	};
 
-	return cur_frame;
+	//pose both ways at the same point in the same animation, to check that they agree
+	auto pose = [&](bool reference, std::vector<core::vector3df>& out)
+	{
+		sReferenceSkinning = reference;
+		float time = 0.0f;
+		bool ended;
+		if (animID)
+			animate(animID, mesh, nullptr, mostFrames / 2, time, ended);
+		else
+			assumeBasePosition(mesh);
+
+		out.clear();
+		for (const Weight& wt : mSkin.targets)
+			out.push_back(((video::S3DVertex*)mesh->getMeshBuffer(wt.buffer_index)->getVertices())[wt.vert_index].Pos);
+	};
+
+	std::vector<core::vector3df> refPos, batchPos;
+	pose(true, refPos);
+	pose(false, batchPos);
+	float maxDiff = 0.0f;
+	for (uint32 i = 0; i < refPos.size(); ++i)
+		maxDiff = core::max_(maxDiff, refPos[i].getDistanceFrom(batchPos[i]));
+
+	const double verts = (double)mSkin.targets.size() * (double)iterations;
+	const double refTime = core::max_(run(true), 1.0);
+	const double batchTime = core::max_(run(false), 1.0);
+	sReferenceSkinning = prevReference;
+
+	printf("skinning %u vertices, %u bones, animation %i, %u iterations\n", (uint32)mSkin.targets.size(), mNumBones, animID, iterations);
+	printf("  reference: %.2f million vertices/s\n", verts / refTime);
+	printf("  batched:   %.2f million vertices/s (%.1fx), max position difference %g\n", verts / batchTime, refTime / batchTime, maxDiff);
 }
 
 
-WLDSkeletonInstance::WLDSkeletonInstance(scene::SMesh* mesh, WLDSkeleton* skele, Mob* owner) :
-	mMesh(mesh),
+WLDSkeletonInstance::WLDSkeletonInstance(WLDSkeleton* skele, Mob* owner) :
+	mNode(nullptr),
+	mPose(nullptr),
 	mCurTime(0),
 	mCurFrame(0),
+	mCurPercent(0),
+	mCurAnimation(0),
+	mEnded(false),
 	mSkeleton(skele),
 	mOwner(owner)
 {
-
+	assumeBasePosition();
 }
 
 WLDSkeletonInstance::~WLDSkeletonInstance()
 {
-	mMesh->drop();
+	if (mPose)
+		--mPose->users;
+}
+
+scene::IAnimatedMesh* WLDSkeletonInstance::getMesh()
+{
+	return mPose->mesh;
+}
+
+void WLDSkeletonInstance::usePose(WLDSkeleton::Pose* pose)
+{
+	if (pose == mPose)
+		return;
+
+	if (mPose)
+		--mPose->users;
+	if (pose)
+		++pose->users;
+	mPose = pose;
+
+	if (mNode && pose)
+		mNode->setMesh(pose->mesh);
 }
 
 void WLDSkeletonInstance::assumeBasePosition()
 {
-	mSkeleton->assumeBasePosition(mMesh);
+	bool created;
+	usePose(mSkeleton->getPose(0, 0, 0.0f, 0, created));
 }
 
-void WLDSkeletonInstance::setAnimation(std::string animName)
+void WLDSkeletonInstance::setAnimation(int anim_id)
 {
-	mCurAnimation = animName;
+	mCurAnimation = anim_id;
 	mCurFrame = 0;
 	mCurTime = 0.0f;
+	mEnded = false;
 }
 
-void WLDSkeletonInstance::animate(float delta)
+void WLDSkeletonInstance::update(float delta, SkinningWork& work)
 {
-	if (mCurAnimation.empty())
+	if (mCurAnimation == 0)
 		return;
+
+	if (mEnded)
+	{
+		//the last frame was shown last time around, loop
+		mEnded = false;
+		mCurTime = 0.0f;
+		mCurFrame = 0;
+	}
+
 	bool ended = false;
 	mCurTime += delta;
-	mCurFrame = mSkeleton->animate(mCurAnimation, mMesh, mCurFrame, mCurTime, ended);
+	mCurFrame = mSkeleton->advance(mCurAnimation, mCurFrame, mCurTime, ended, mCurPercent);
 
-	if (ended)
-		setAnimation(mCurAnimation);
+	bool created;
+	WLDSkeleton::Pose* pose = mSkeleton->getPose(mCurAnimation, mCurFrame, mCurPercent, work.frame, created);
+	if (created)
+	{
+		work.poses.push_back(pose);
+		work.vertices += mSkeleton->getSkinnedVertexCount();
+	}
+	usePose(pose);
+
+	mEnded = ended;
+}
+
+const WLDSkeleton::Frame* WLDSkeletonInstance::getPoints()
+{
+	return mPose->points;
+}
+
+void SkinningWork::clear()
+{
+	poses.clear();
+	vertices = 0;
+}
+
+void SkinningWork::run(uint32 begin, uint32 end)
+{
+	for (uint32 i = begin; i < end; ++i)
+		poses[i]->skeleton->skinPose(*poses[i]);
 }
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 #include "types.h"
 #include "util.h"
@@ -17,6 +18,7 @@ using namespace irr;
 using namespace WLD_Structs;
 
 class Mob;
+class WLDSkeletonInstance;
 
 class WLDSkeleton : public Model
 {
@@ -45,7 +47,6 @@ public:
 		POINT_COUNT //not a real position
 	};
 
-private:
 	//each frame has a complete skeleton, interpolate between current skeleton and next skeleton
 	struct Frame
 	{
@@ -53,20 +54,56 @@ private:
 		core::vector3df rot;
 	};
 
+	//a skinned copy of the reference mesh at one point of one animation, shared by every mob that is there
+	struct Pose
+	{
+		WLDSkeleton* skeleton;
+		scene::SAnimatedMesh* mesh;
+		int anim_id; //0 = base position
+		uint32 frame;
+		float percent; //quantized
+		uint32 users; //instances currently showing this pose
+		uint32 lastUsed; //frame number
+		bool skinned;
+		Frame points[POINT_COUNT];
+	};
+
+private:
+
 	struct BaseFrame
 	{
 		Frame bone;
 		Frame* attachment_point;
 	};
 
-	struct FrameSkeleton
+	struct BaseSkeleton
 	{
-		Frame* bones;
+		BaseFrame* bones;
 	};
 
-	struct BaseSkeleton
+	//a bone's rotation and shift for one frame, computed once and applied to all of the bone's vertices
+	struct BoneTransform
 	{
-		BaseFrame* bones;
+		float m[9]; //row major, same rotation order as Util::rotateBy (x, then y, then z)
+		float t[3];
+	};
+
+	//reference vertices regrouped by bone as structure-of-arrays, so the skinning kernel can do 4 at a time
+	//built once the model's weights are final; each bone's vertices are [boneStart[b], boneStart[b + 1])
+	struct SkinStreams
+	{
+		std::vector<float> px, py, pz;
+		std::vector<float> nx, ny, nz;
+		std::vector<Weight> targets;
+		std::vector<uint32> boneStart;
+	};
+
+	//animation frames are stored quantized, 12 bytes per bone per frame:
+	//positions are scaled to the animation's largest offset, rotations wrap at +/- pi
+	struct PackedFrame
+	{
+		int16 pos[3];
+		int16 rot[3];
 	};
 
 	//for animations, the root bone and occasionally other bones will only have 1 frame;
@@ -74,30 +111,63 @@ private:
 	//for all other bones, the number of frames should be the same as the number in the animation
 	struct Animation
 	{
-		uint32 start_frame;
-		uint32 end_frame;
+		uint32 first; //index of the animation's first PackedFrame
+		uint32 num_frames; //0 if the model doesn't have this animation
 		float frame_delay;
+		float pos_scale;
+	};
+
+	//one per model, shared by every copy of its skeleton (e.g. head meshes)
+	struct AnimationStore
+	{
+		std::vector<Animation> animations; //indexed by animation id (see Translate::animationID)
+		std::vector<PackedFrame> frames; //each animation's frames back to back, every frame a complete skeleton
+	};
+
+	//full precision frames while the animation is being read, so that child bones inherit exact parent values
+	struct AnimationBuilder
+	{
+		AnimationBuilder() : num_frames(0), frame_delay(0) { }
+
+		uint32 num_frames;
+		uint32 frame_delay;
+		std::vector<Frame> frames;
 	};
 
 	bool mIsCopy;
 	uint32 mNumBones;
-	uint32 mNumFrames;
 	uint8 mHasPoint;
 	BaseSkeleton mBasePosition;
-	Frame mPoints[POINT_COUNT]; //basically a buffer that's only valid immediately after a mob is animated
+	Frame mPoints[POINT_COUNT]; //attachment points in the base position; animated ones are written to the instance
 	scene::SMesh* mReferenceMesh;
-	std::vector<FrameSkeleton> mFrames; //could be changed to one big flat array of frames
 	std::vector<Weight>* mWeightsByBone;
-	std::unordered_map<std::string, Animation, std::hash<std::string>> mAnimations;
+	std::shared_ptr<AnimationStore> mAnimations; //freed with the last copy
+	std::unordered_map<int, AnimationBuilder> mAnimationBuilders;
+	SkinStreams mSkin;
+	std::unordered_map<uint32, Pose> mPoses; //by animation id, frame and step; main thread only
 	int mModelRace;
 	int8 mModelGender;
 
 private:
 	static void getPosRot(Frag12Entry& f12, core::vector3df& pos, core::vector3df& rot);
+	static int16 packRotation(float rot);
+	void unpackFrame(const Animation& anim, const PackedFrame& packed, Frame& frame);
+	void unpackFrame(const Animation& anim, const PackedFrame& cur, const PackedFrame& next, float percent, Frame& frame);
+	void moveBone(uint32 bone, scene::SMesh* mesh, Frame& by);
+	static void makeBoneTransform(const Frame& frame, BoneTransform& out);
+	void skinBone(uint32 bone, const BoneTransform& xf, video::S3DVertex** buf_verts);
+	bool getBufferVertices(scene::SMesh* mesh, video::S3DVertex** out);
+	void poseBone(uint32 bone, scene::SMesh* mesh, video::S3DVertex** buf_verts, Frame& frame);
 	static void inheritPosRot(core::vector3df& pos, core::vector3df& rot, Frame& parent);
 	static void inheritPos(core::vector3df& pos, core::vector3df& rot, Frame& parent);
 	static void moveVertex(const video::S3DVertex& refVert, video::S3DVertex& vert, Frame& by);
 
+public:
+	static const uint32 MAX_SKIN_BUFFERS = 32;
+	static const uint32 POSE_STEPS = 4; //poses per animation frame
+	//use the original per-vertex rotateBy path instead of the batched kernel; for comparison only
+	static bool sReferenceSkinning;
+
 public:
 	WLDSkeleton(uint32 num_bones, scene::SMesh* reference_mesh);
 	WLDSkeleton(const WLDSkeleton& toCopy); //copy constructor
@@ -108,6 +178,9 @@ public:
 
 	void addWeight(int bone, uint32 buffer, uint32 vert);
 	std::vector<Weight>& getWeights(uint32 bone) { return mWeightsByBone[bone]; }
+	//call once the weights and reference mesh are final, before the skeleton is used by any mob
+	void buildSkinStreams();
+	uint32 getSkinnedVertexCount() { return mSkin.targets.size(); }
 
 	bool hasRightHandPoint() { return (mHasPoint & POINT_RIGHT) != 0; }
 	bool hasLeftHandPoint() { return (mHasPoint & POINT_LEFT) != 0; }
@@ -116,40 +189,83 @@ public:
 
 	void setBasePosition(int bone, Frag12Entry& f12, int parent = -1, int point = -1);
 	void assumeBasePosition(scene::SMesh* mesh);
-	void addAnimation(std::string animName, uint32 num_frames, uint32 frame_delay);
-	void addAnimationFrames(std::string animName, Frag12* f12, int bone_id, int parent_id = -1);
-	uint32 animate(std::string animName, scene::SMesh* mesh, uint32 cur_frame, float& time, bool& ended);
+	//may be called more than once for the same animation, the longest frame count wins
+	void addAnimation(int anim_id, uint32 num_frames, uint32 frame_delay);
+	void addAnimationFrames(int anim_id, Frag12* f12, int bone_id, int parent_id = -1);
+	//packs everything added so far into the shared store; call before making copies
+	void finishAnimations();
+	bool hasAnimation(int anim_id);
+	//bytes used by the packed frames, and what they would take as one float Frame allocation per skeleton frame
+	void getAnimationMemory(uint32& packed, uint32& unpacked);
+	//moves cur_frame and time along, and gives how far it is towards the next frame
+	uint32 advance(int anim_id, uint32 cur_frame, float& time, bool& ended, float& percent);
+	//only writes to mesh and points (one per PointPosition, may be null), so poses can be skinned in parallel
+	void pose(int anim_id, scene::SMesh* mesh, Frame* points, uint32 cur_frame, float percent);
+	uint32 animate(int anim_id, scene::SMesh* mesh, Frame* points, uint32 cur_frame, float& time, bool& ended);
+
+	//main thread only; created is set if the pose is new and still needs skinning (see skinPose)
+	Pose* getPose(int anim_id, uint32 cur_frame, float percent, uint32 frame_number, bool& created);
+	void skinPose(Pose& p);
+	//frees poses nobody has shown for more than linger frames, returns how many
+	uint32 evictPoses(uint32 frame_number, uint32 linger);
+	uint32 getPoseCount() { return mPoses.size(); }
+	//times the reference and batched skinning paths on a copy of the reference mesh and prints vertices/s for both
+	void benchmarkSkinning(scene::SMesh* mesh, uint32 iterations);
 
 	void setModelRaceGender(int race, int gender) { mModelRace = race; mModelGender = gender; }
 	int getModelRace() const { return mModelRace; }
 	int8 getModelGender() const { return mModelGender; }
 };
 
-//the skeleton itself has no state, so it is fully reusable between instances of mobs
+//skinning gathered by the main thread for one frame, then done in parallel
+struct SkinningWork
+{
+	SkinningWork() : frame(0), vertices(0) { }
+
+	std::vector<WLDSkeleton::Pose*> poses; //new this frame
+	uint32 frame;
+	uint64 vertices;
+
+	uint32 size() { return poses.size(); }
+	void clear();
+	void run(uint32 begin, uint32 end); //any thread
+};
+
+//the skeleton itself has no state, so it is fully reusable between instances of mobs;
+//instances show one of the skeleton's shared poses
 class WLDSkeletonInstance
 {
 public:
-	scene::SMesh* mMesh;
+	scene::IAnimatedMeshSceneNode* mNode;
+	WLDSkeleton::Pose* mPose;
 	float mCurTime;
 	uint32 mCurFrame; //of the current animation, not absolute
-	std::string mCurAnimation; //change to id number later
+	float mCurPercent;
+	int mCurAnimation; //0 = none
+	bool mEnded;
 	WLDSkeleton* mSkeleton;
 	Mob* mOwner;
 
+private:
+	void usePose(WLDSkeleton::Pose* pose);
+
 public:
-	WLDSkeletonInstance(scene::SMesh* mesh, WLDSkeleton* skele, Mob* owner);
+	WLDSkeletonInstance(WLDSkeleton* skele, Mob* owner);
 	~WLDSkeletonInstance();
 
-	scene::SMesh* getMesh() { return mMesh; }
+	scene::IAnimatedMesh* getMesh();
+	void setSceneNode(scene::IAnimatedMeshSceneNode* node) { mNode = node; }
 
 	bool hasRightHandPoint() { return mSkeleton->hasRightHandPoint(); }
 	bool hasLeftHandPoint() { return mSkeleton->hasLeftHandPoint(); }
 	bool hasHeadPoint() { return mSkeleton->hasHeadPoint(); }
 	bool hasShieldPoint() { return mSkeleton->hasShieldPoint(); }
+	const WLDSkeleton::Frame* getPoints();
 
 	void assumeBasePosition();
-	void setAnimation(std::string animName);
-	void animate(float delta);
+	void setAnimation(int anim_id);
+	//main thread; advances the animation and switches poses, adding any skinning that needs doing to work
+	void update(float delta, SkinningWork& work);
 };
 
 #endif
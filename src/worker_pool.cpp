@@ -0,0 +1,137 @@
+
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool() :
+	mStopping(false)
+{
+
+}
+
+WorkerPool::~WorkerPool()
+{
+	close();
+}
+
+void WorkerPool::initialize(uint32 num_threads)
+{
+	if (!mThreads.empty())
+		return; //already running
+
+	if (num_threads == 0)
+	{
+		uint32 hw = std::thread::hardware_concurrency();
+		num_threads = (hw > 1) ? hw - 1 : 1;
+	}
+
+	mStopping = false;
+	for (uint32 i = 0; i < num_threads; ++i)
+		mThreads.push_back(std::thread(&WorkerPool::workerLoop, this));
+}
+
+void WorkerPool::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mJobAvailable.notify_all();
+
+	for (std::thread& thread : mThreads)
+		thread.join();
+	mThreads.clear();
+
+	//anything left over never got to run
+	while (!mJobs.empty())
+		mJobs.pop();
+}
+
+void WorkerPool::addJob(const std::function<void()>& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push(job);
+	}
+	mJobAvailable.notify_one();
+}
+
+WorkerPool::ParallelFor::ParallelFor(uint32 count, uint32 grain, const std::function<void(uint32, uint32)>& func) :
+	func(func),
+	count(count),
+	grain(grain),
+	numChunks((count + grain - 1) / grain),
+	nextChunk(0),
+	chunksDone(0)
+{
+
+}
+
+void WorkerPool::runChunks(ParallelFor& pf)
+{
+	for (;;)
+	{
+		uint32 chunk = pf.nextChunk++;
+		if (chunk >= pf.numChunks)
+			return;
+
+		uint32 begin = chunk * pf.grain;
+		uint32 end = begin + pf.grain;
+		if (end > pf.count)
+			end = pf.count;
+		pf.func(begin, end);
+
+		if (++pf.chunksDone == pf.numChunks)
+		{
+			std::lock_guard<std::mutex> lock(pf.mutex);
+			pf.allDone.notify_all();
+		}
+	}
+}
+
+void WorkerPool::parallelFor(uint32 count, uint32 grain, const std::function<void(uint32, uint32)>& func, uint32 max_helpers)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	std::shared_ptr<ParallelFor> pf = std::make_shared<ParallelFor>(count, grain, func);
+
+	//no point waking more helpers than there are chunks beyond the one the caller starts on
+	uint32 helpers = pf->numChunks - 1;
+	if (helpers > max_helpers)
+		helpers = max_helpers;
+	if (helpers > mThreads.size())
+		helpers = mThreads.size();
+
+	for (uint32 i = 0; i < helpers; ++i)
+		addJob([pf]() { runChunks(*pf); });
+
+	runChunks(*pf);
+
+	//everything has been claimed, wait for helpers still working on theirs
+	std::unique_lock<std::mutex> lock(pf->mutex);
+	while (pf->chunksDone < pf->numChunks)
+		pf->allDone.wait(lock);
+}
+
+void WorkerPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			while (!mStopping && mJobs.empty())
+				mJobAvailable.wait(lock);
+
+			if (mStopping)
+				return;
+
+			job = mJobs.front();
+			mJobs.pop();
+		}
+
+		job();
+	}
+}
@@ -0,0 +1,62 @@
+
+#ifndef _ZEQ_WORKER_POOL_H
+#define _ZEQ_WORKER_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <queue>
+#include <atomic>
+#include <memory>
+
+#include "types.h"
+
+//fixed set of background threads pulling jobs off a shared queue
+//jobs must not touch irrlicht's driver or scene manager, or lua; use Renderer::runOnMainThread for those
+class WorkerPool
+{
+private:
+	//shared between the caller of parallelFor and its helper jobs, which may start after the caller has returned
+	struct ParallelFor
+	{
+		ParallelFor(uint32 count, uint32 grain, const std::function<void(uint32, uint32)>& func);
+
+		std::function<void(uint32, uint32)> func;
+		uint32 count;
+		uint32 grain;
+		uint32 numChunks;
+		std::atomic<uint32> nextChunk;
+		std::atomic<uint32> chunksDone;
+		std::mutex mutex;
+		std::condition_variable allDone;
+	};
+
+	std::vector<std::thread> mThreads;
+	std::queue<std::function<void()>> mJobs;
+	std::mutex mMutex;
+	std::condition_variable mJobAvailable;
+	bool mStopping;
+
+private:
+	void workerLoop();
+	static void runChunks(ParallelFor& pf);
+
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	//0 = one less than the number of hardware threads, leaving one for the main thread
+	void initialize(uint32 num_threads = 0);
+	void close();
+
+	void addJob(const std::function<void()>& job);
+	//runs func(begin, end) over [0, count) in chunks of up to grain, with up to max_helpers workers joining the
+	//calling thread; returns once every chunk is done. The caller takes any chunk no worker has picked up yet,
+	//so this never waits behind unrelated jobs (e.g. zone loads) that are hogging the workers
+	void parallelFor(uint32 count, uint32 grain, const std::function<void(uint32, uint32)>& func, uint32 max_helpers = 0xFFFFFFFF);
+	uint32 getNumThreads() { return mThreads.size(); }
+};
+
+#endif
@@ -23,6 +23,19 @@
 #define CONFIG_VAR_FULLSCREEN "fullscreen"
 #define CONFIG_VAR_RENDERER "renderer"
 #define CONFIG_VAR_SHOW_ZONE_WALLS "showzonewalls"
+#define CONFIG_VAR_USE_32BIT_INDICES "use32bitindices"
+#define CONFIG_VAR_PREFETCH_BUDGET "prefetchbudget"
+#define CONFIG_VAR_FILE_CACHE_BUDGET "filecachebudget"
+#define CONFIG_VAR_ANIMATION_THREADS "animationthreads"
+#define CONFIG_VAR_ANIMATION_FULL_RATE_DIST "animationfullratedistance"
+#define CONFIG_VAR_ANIMATION_HALF_RATE_DIST "animationhalfratedistance"
+#define CONFIG_VAR_ANIMATION_RANGE "animationrange"
+#define CONFIG_VAR_MERGE_ZONE_OBJECTS "mergezoneobjects"
+#define CONFIG_VAR_DRAW_DISTANCE "drawdistance"
+#define CONFIG_VAR_USE_REGION_VISIBILITY "useregionvisibility"
+#define CONFIG_VAR_TARGET_FPS "targetfps"
+#define CONFIG_VAR_PROFILER "profiler"
+#define CONFIG_VAR_HEADLESS "headless"
 
 namespace Lua
 {
@@ -44,6 +44,8 @@ ZON::~ZON()
 	//zon file may come from the EQ folder directly rather than from an S3D, need to release file data in that case
 	if (mDeleteMe && mRawData)
 		delete mRawData;
+	else if (mRawData)
+		mContainingS3D->releaseFile(mRawData);
 }
 
 TER* ZON::getTER()
@@ -63,7 +65,15 @@ TER* ZON::getTER()
 		if (file == nullptr)
 			return nullptr;
 
-		return new TER(file, mContainingS3D, mShortName);
+		try
+		{
+			return new TER(file, mContainingS3D, mShortName);
+		}
+		catch (ZEQException&)
+		{
+			mContainingS3D->releaseFile(file);
+			throw;
+		}
 	}
 
 	return nullptr;
@@ -93,8 +103,12 @@ void ZON::readObjects(ZoneModel* zoneModel)
 		if (file == nullptr)
 			continue;
 
-		MOD mod(file, mContainingS3D, name);
-		mod.convertStaticModel(zoneModel);
+		{
+			MOD mod(file, mContainingS3D, name);
+			mod.convertStaticModel(zoneModel);
+			mMeshStats.add(mod.getMeshStats());
+		}
+		mContainingS3D->releaseFile(name);
 	}
 
 	//now on to model placements
@@ -122,3 +136,30 @@ void ZON::readObjects(ZoneModel* zoneModel)
 		zoneModel->addObjectPlacement(name, op);
 	}
 }
+
+void ZON::readRegions(ZoneModel* zoneModel)
+{
+	RegionMap& map = zoneModel->getRegionMap();
+
+	for (uint32 i = 0; i < mHeader->region_count; ++i)
+	{
+		Region& reg = mRegions[i];
+		if (reg.name_index >= mHeader->strings_len)
+			continue;
+
+		uint32 zoneLine;
+		uint32 types = RegionMap::parseName(&mStringBlock[reg.name_index], zoneLine);
+		if (types == 0)
+			continue;
+
+		//the boxes can be rotated, but as far as anyone can tell they never are
+		core::vector3df center(reg.centerX, reg.centerZ, reg.centerY);
+		core::vector3df extent(reg.extentX, reg.extentZ, reg.extentY);
+		map.addBox(core::aabbox3df(center - extent, center + extent), types, zoneLine);
+
+		if ((types & RegionMap::ZONE_LINE) && zoneLine != RegionMap::NO_ZONE_LINE)
+			map.addZoneLinePosition(zoneLine, center);
+	}
+
+	map.build();
+}
@@ -70,6 +70,7 @@ public:
 	TER* getTER();
 	void setZonePosition(ZoneModel* zoneModel);
 	void readObjects(ZoneModel* zoneModel);
+	void readRegions(ZoneModel* zoneModel);
 };
 
 #endif
@@ -9,51 +9,99 @@ extern Renderer gRenderer;
 extern FileLoader gFileLoader;
 extern Player gPlayer;
 extern GUI gGUI;
+extern ZonePrefetcher gZonePrefetcher;
 
 ZoneConnection::ZoneConnection(WorldConnection* world) :
 	Connection(world->getZoneServer()->ip, world->getZoneServer()->port),
 	mCharacterName(world->getCharacterName()),
-	mGuildList(world->takeGuildList())
+	mGuildList(world->takeGuildList()),
+	mZoneLoader(nullptr)
 {
 
 }
 
 ZoneConnection::~ZoneConnection()
 {
+	if (mZoneLoader)
+		delete mZoneLoader;
 	sendCamp();
 }
 
 void ZoneConnection::processInboundPackets()
 {
-	uint32 reack_count = 0;
+	//keep rendering (and servicing the zone load) while we wait on the server,
+	//only sending keepalives once it has been quiet for a while
+	uint32 idle = 0;
 	for (;;)
 	{
-			int len = recvWithTimeout(3000);
-			if (len <= 0)
+		idle += (uint32)(gRenderer.loopStep() * 1000.0f);
+		checkZoneLoad();
+
+		int len = recvWithTimeout(RECV_TIMEOUT);
+		if (len <= 0)
+		{
+			if (idle >= KEEPALIVE_INTERVAL)
 			{
-			if (!mAckMgr->resendUnackedPackets())
+				idle = 0;
+				if (!mAckMgr->resendUnackedPackets())
 					mAckMgr->sendKeepAliveAck();
 			}
+		}
+		else
+		{
+			idle = 0;
+		}
 
-			if (!mPacketReceiver->handleProtocol(len))
-				continue;
-			//else we have some packets to process here
-			std::queue<ReadPacket*>& queue = mAckMgr->getPacketQueue();
-			while (!queue.empty())
-			{
-				ReadPacket* packet = queue.front();
-				queue.pop();
-				uint16 opcode = *(uint16*)packet->data;
-				bool ret = processPacket(opcode, packet->data + 2, packet->len - 2);
-				delete packet;
-				if (ret)
-					return;
-			}
+		if (!mPacketReceiver->handleProtocol(len))
+			continue;
+		//else we have some packets to process here
+		std::queue<ReadPacket*>& queue = mAckMgr->getPacketQueue();
+		while (!queue.empty())
+		{
+			ReadPacket* packet = queue.front();
+			queue.pop();
+			uint16 opcode = *(uint16*)packet->data;
+			bool ret = processPacket(opcode, packet->data + 2, packet->len - 2);
+			delete packet;
+			if (ret)
+				return;
 		}
+	}
+}
+
+void ZoneConnection::checkZoneLoad()
+{
+	if (mZoneLoader == nullptr || !mZoneLoader->update())
+		return;
+
+	ZoneModel* zoneModel = mZoneLoader->takeZoneModel();
+	delete mZoneLoader;
+	mZoneLoader = nullptr;
+
+	//attaching to the scene has to happen here on the main thread
+	gRenderer.useZoneModel(zoneModel);
+	gMobMgr.correctPrematureSpawns();
+
+	//zone lines the zone file places, for prefetching whatever is on the other side; the zone points may come before
+	//or after this, the prefetcher keeps the positions either way
+	std::vector<std::pair<uint32, core::vector3df>> zoneLines;
+	zoneModel->getRegionMap().getZoneLinePositions(zoneLines);
+	for (auto& line : zoneLines)
+		gZonePrefetcher.setZoneLinePosition(line.first, line.second);
+
+	Rocket::Core::String msg = "Entering ";
+	msg += mZoneLongName.c_str();
+	msg += ".";
+	gGUI.displayChat(0, msg);
+
+	//the server sends spawns in response to this, so it waits until the zone is ready
+	Packet packet(0, OP_ReqClientSpawn, mAckMgr);
+	packet.send(this, getCRCKey());
 }
 
 bool ZoneConnection::processPacket(uint16 opcode, byte* data, uint32 len)
 {
+	PROFILE_SCOPE("ZoneConnection::processPacket");
 	switch (opcode)
 	{
 	case OP_PlayerProfile:
@@ -101,31 +149,41 @@ bool ZoneConnection::processPacket(uint16 opcode, byte* data, uint32 len)
 		NewZone_Struct* nz = (NewZone_Struct*)data;
 		printf("Zone: %s - %s\n", nz->zone_short_name, nz->zone_long_name);
 
-		ZoneModel* zoneModel = ZoneModel::load(nz->zone_short_name);
-		if (zoneModel == nullptr)
-			throw ZEQException("bad zone shortname '%s'", nz->zone_short_name);
-		mAckMgr->sendKeepAliveAck();
-		gRenderer.useZoneModel(zoneModel);
-		mAckMgr->sendKeepAliveAck();
-		gFileLoader.handleZoneChr(nz->zone_short_name);
-		mAckMgr->sendKeepAliveAck();
-		gMobMgr.correctPrematureSpawns();
+		//geometry, objects and character models are converted in the background; see checkZoneLoad()
+		mZoneLongName = nz->zone_long_name;
+		if (mZoneLoader)
+			delete mZoneLoader;
 
-		Rocket::Core::String msg = "Entering ";
-		msg += nz->zone_long_name;
-		msg += ".";
-		gGUI.displayChat(0, msg);
+		LoadProgressCallback progress = [](float progress, const char* stage)
+		{
+			gGUI.displayLoadProgress(progress, stage);
+		};
 
-		//send client spawn request
-		Packet packet(0, OP_ReqClientSpawn, mAckMgr);
-		packet.send(this, getCRCKey());
+		//if we saw this zone coming, its geometry is already loaded or on the way
+		gZonePrefetcher.setCurrentZone(nz->zone_short_name);
+		mZoneLoader = gZonePrefetcher.claim(nz->zone_short_name);
+		if (mZoneLoader)
+		{
+			mZoneLoader->continueWithCharacters(progress);
+		}
+		else
+		{
+			mZoneLoader = new ZoneLoader(nz->zone_short_name, true, progress);
+			mZoneLoader->start();
+		}
 		break;
 	}
 	case OP_SendZonePoints:
 	{
 		printf("OP_SendZonePoints\n");
-		uint32 count = *(uint32*)data;
-		ZonePoints* zp = (ZonePoints*)(data + sizeof(uint32));
+		ZonePoints* zp = (ZonePoints*)data;
+		//setZonePoints trusts the count, so make sure the packet holds that many
+		if (len < sizeof(uint32) || zp->count > (len - sizeof(uint32)) / sizeof(ZonePoint_Entry))
+		{
+			printf("OP_SendZonePoints: %u bytes is too short\n", len);
+			break;
+		}
+		gZonePrefetcher.setZonePoints(zp);
 		break;
 	}
 	case OP_ZoneSpawns:
@@ -295,6 +353,7 @@ void ZoneConnection::connect()
 
 void ZoneConnection::poll()
 {
+	PROFILE_SCOPE("ZoneConnection::poll");
 		int len = recvPacket();
 		if (len <= 0)
 		{
@@ -11,15 +11,27 @@
 #include "structs_titanium.h"
 #include "mob_manager.h"
 #include "zone_model.h"
+#include "zone_loader.h"
+#include "zone_prefetcher.h"
 #include "file_loader.h"
 #include "eqstr.h"
 
 class ZoneConnection : public Connection
 {
+private:
+	static const uint32 RECV_TIMEOUT = 5; //milliseconds; short so that the window keeps drawing while we wait
+	static const uint32 KEEPALIVE_INTERVAL = 3000; //milliseconds of silence before we poke the server
+
 private:
 	std::string mCharacterName;
 	GuildsList_Struct* mGuildList;
 
+	ZoneLoader* mZoneLoader;
+	std::string mZoneLongName;
+
+private:
+	void checkZoneLoad();
+
 public:
 	ZoneConnection(WorldConnection* world);
 	~ZoneConnection();
@@ -0,0 +1,208 @@
+
+#include "zone_loader.h"
+#include "worker_pool.h"
+#include "file_loader.h"
+#include "renderer.h"
+
+extern WorkerPool gWorkerPool;
+extern FileLoader gFileLoader;
+extern Renderer gRenderer;
+
+ZoneLoader::ZoneLoader(std::string shortname, bool load_characters, LoadProgressCallback callback) :
+	mShortName(shortname),
+	mLoadCharacters(load_characters),
+	mCallback(callback),
+	mProgress(0.0f),
+	mProgressChanged(false),
+	mRunning(false),
+	mGeometryDone(false),
+	mZoneModel(nullptr)
+{
+
+}
+
+ZoneLoader::~ZoneLoader()
+{
+	//the job may be waiting on the main thread for textures, keep servicing it until it finishes
+	while (isRunning())
+	{
+		gRenderer.processMainThreadCalls();
+		std::this_thread::yield();
+	}
+
+	if (mZoneModel)
+		delete mZoneModel;
+}
+
+void ZoneLoader::start()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRunning = true;
+	}
+
+	setProgress(0.0f, "Loading zone");
+	gWorkerPool.addJob([this]() { run(); });
+}
+
+void ZoneLoader::continueWithCharacters(LoadProgressCallback callback)
+{
+	bool startJob = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mCallback = callback;
+		mProgressChanged = true;
+		if (mLoadCharacters)
+			return;
+		mLoadCharacters = true;
+
+		//if the geometry is already done, the job has exited and we need another one for the characters;
+		//otherwise the running job will pick up the flag when it gets there
+		if (mGeometryDone && mError.empty())
+		{
+			mRunning = true;
+			startJob = true;
+		}
+	}
+
+	if (startJob)
+		gWorkerPool.addJob([this]() { loadCharacters(); });
+}
+
+void ZoneLoader::run()
+{
+	bool characters = false;
+
+	try
+	{
+		ZoneModel* zoneModel = ZoneModel::load(mShortName, [this](float progress, const char* stage)
+		{
+			//zone geometry is the bulk of the work when characters are loaded as well
+			setProgress(progress * 0.8f, stage);
+		});
+
+		if (zoneModel == nullptr)
+			throw ZEQException("bad zone shortname '%s'", mShortName.c_str());
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		mZoneModel = zoneModel;
+		mGeometryDone = true;
+		characters = mLoadCharacters;
+		if (!characters)
+		{
+			mProgress = 1.0f;
+			mStage = "Zone loaded";
+			mProgressChanged = true;
+			mRunning = false;
+		}
+	}
+	catch (ZEQException& e)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mError = e.what();
+		mRunning = false;
+	}
+	catch (std::exception& e)
+	{
+		//out of memory and the like; nothing else can catch it on this thread
+		std::lock_guard<std::mutex> lock(mMutex);
+		mError = e.what();
+		mRunning = false;
+	}
+
+	if (characters)
+		loadCharacters();
+}
+
+void ZoneLoader::loadCharacters()
+{
+	setProgress(0.8f, "Loading characters");
+
+	try
+	{
+		gFileLoader.handleZoneChr(mShortName);
+	}
+	catch (ZEQException& e)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mError = e.what();
+	}
+	catch (std::exception& e)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mError = e.what();
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mProgress = 1.0f;
+	mStage = "Entering zone";
+	mProgressChanged = true;
+	mRunning = false;
+}
+
+void ZoneLoader::setProgress(float progress, const char* stage)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mProgress = progress;
+	mStage = stage;
+	mProgressChanged = true;
+}
+
+bool ZoneLoader::isRunning()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mRunning;
+}
+
+bool ZoneLoader::update()
+{
+	float progress;
+	std::string stage;
+	bool changed;
+	bool finished;
+	std::string error;
+	LoadProgressCallback callback;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		progress = mProgress;
+		stage = mStage;
+		changed = mProgressChanged;
+		mProgressChanged = false;
+		finished = !mRunning;
+		error = mError;
+		callback = mCallback;
+	}
+
+	if (changed && callback)
+		callback(progress, stage.c_str());
+
+	if (finished && !error.empty())
+		throw ZEQException("ZoneLoader: %s", error.c_str());
+
+	return finished;
+}
+
+bool ZoneLoader::hasFailed()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return !mError.empty();
+}
+
+uint64 ZoneLoader::getMemoryUsage()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mZoneModel ? mZoneModel->getMemoryUsage() : 0;
+}
+
+ZoneModel* ZoneLoader::takeZoneModel()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mRunning)
+		return nullptr;
+
+	ZoneModel* ret = mZoneModel;
+	mZoneModel = nullptr;
+	return ret;
+}
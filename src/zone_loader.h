@@ -0,0 +1,54 @@
+
+#ifndef _ZEQ_ZONE_LOADER_H
+#define _ZEQ_ZONE_LOADER_H
+
+#include <string>
+#include <mutex>
+
+#include "types.h"
+#include "exception.h"
+#include "zone_model.h"
+
+//loads a zone's geometry, objects and (optionally) its character models on a worker thread
+//the caller polls update() from the main thread, which forwards progress and reports completion;
+//attaching the result to the scene is left to the caller, since that must happen on the main thread
+class ZoneLoader
+{
+private:
+	std::string mShortName;
+	bool mLoadCharacters;
+	LoadProgressCallback mCallback;
+
+	std::mutex mMutex;
+	float mProgress;
+	std::string mStage;
+	bool mProgressChanged;
+	std::string mError;
+
+	bool mRunning;
+	bool mGeometryDone;
+	ZoneModel* mZoneModel;
+
+private:
+	void run();
+	void loadCharacters();
+	void setProgress(float progress, const char* stage);
+	bool isRunning();
+
+public:
+	ZoneLoader(std::string shortname, bool load_characters, LoadProgressCallback callback = nullptr);
+	~ZoneLoader();
+
+	void start();
+	//turns a geometry-only load (e.g. a prefetch) into a full one, whether or not it has finished yet
+	void continueWithCharacters(LoadProgressCallback callback);
+	//main thread only; returns true once the load has finished, throws if it failed
+	bool update();
+	bool hasFailed();
+	uint64 getMemoryUsage(); //0 until the geometry has loaded
+
+	const std::string& getShortName() { return mShortName; }
+	ZoneModel* takeZoneModel();
+};
+
+#endif
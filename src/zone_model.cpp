@@ -71,48 +71,109 @@ void ZoneModel::addObjectPlacement(const char* name, ObjectPlacement& placement)
 	}
 }
 
-ZoneModel* ZoneModel::load(std::string shortname)
+void ZoneModel::buildCollision()
 {
+	mCollision.build(this);
+	mFloor.build(&mCollision);
+}
+
+uint64 ZoneModel::getMemoryUsage()
+{
+	uint64 bytes = getTextureMemoryUsage();
+
+	if (mMesh)
+		bytes += getMeshMemoryUsage(mMesh->getMesh(0));
+	if (mNonCollisionMesh)
+		bytes += getMeshMemoryUsage(mNonCollisionMesh->getMesh(0));
+
+	for (auto& pair : mObjectDefinitions)
+		bytes += getMeshMemoryUsage(pair.second->getMesh(0));
+	for (auto& pair : mNoCollisionObjectDefinitions)
+		bytes += getMeshMemoryUsage(pair.second->getMesh(0));
+
+	bytes += mCollision.getMemoryUsage();
+	bytes += mFloor.getMemoryUsage();
+	bytes += mRegions.getMemoryUsage();
+	bytes += mRegionMap.getMemoryUsage();
+
+	return bytes;
+}
+
+ZoneModel* ZoneModel::load(std::string shortname, const LoadProgressCallback& progress)
+{
+	PROFILE_SCOPE("ZoneModel::load");
+	if (progress)
+		progress(0.0f, "Reading zone archive");
+
 	//try WLD
 	WLD* wld = gFileLoader.getWLD(shortname, nullptr, false);
 	if (wld)
-		return loadFromWLD(shortname, wld);
+		return loadFromWLD(shortname, wld, progress);
 
 	//try ZON
 	ZON* zon = gFileLoader.getZON(shortname);
 	if (zon)
-		return loadFromZON(shortname, zon);
+		return loadFromZON(shortname, zon, progress);
 
 	return nullptr;
 }
 
-ZoneModel* ZoneModel::loadFromWLD(std::string shortname, WLD* wld)
+ZoneModel* ZoneModel::loadFromWLD(std::string shortname, WLD* wld, const LoadProgressCallback& progress)
 {
-	ZoneModel* zoneModel = wld->convertZoneModel();
+	if (progress)
+		progress(0.1f, "Converting zone geometry");
+
+	ZoneModel* zoneModel;
+	{
+		PROFILE_SCOPE("WLD::convertZoneModel");
+		zoneModel = wld->convertZoneModel();
+	}
+	MeshStats stats = wld->getMeshStats();
+
+	if (progress)
+		progress(0.6f, "Converting zone objects");
 
 	WLD* objWLD = gFileLoader.getWLD(shortname + "_obj", nullptr, false);
 	if (objWLD)
 	{
+		PROFILE_SCOPE("WLD::convertZoneObjectDefinitions");
 		objWLD->convertZoneObjectDefinitions(zoneModel);
+		stats.add(objWLD->getMeshStats());
 		delete objWLD;
 	}
 
+	stats.print(shortname.c_str());
+
+	if (progress)
+		progress(0.9f, "Placing zone objects");
+
 	WLD* placeWLD = gFileLoader.getWLD("objects", shortname.c_str(), false);
 	if (placeWLD)
 	{
+		PROFILE_SCOPE("WLD::convertZoneObjectPlacements");
 		placeWLD->convertZoneObjectPlacements(zoneModel);
 		delete placeWLD;
 	}
 
 	delete wld;
 
-	gFileLoader.unloadS3D(shortname);
-	gFileLoader.unloadS3D(shortname + "_obj");
+	if (progress)
+		progress(0.95f, "Building collision");
+	{
+		PROFILE_SCOPE("ZoneModel::buildCollision");
+		zoneModel->buildCollision();
+	}
+
+	//the archives stay in the file cache, in case we come back or a neighbour shares them
+	gFileLoader.printCacheStats();
+
+	if (progress)
+		progress(1.0f, "Zone loaded");
 
 	return zoneModel;
 }
 
-ZoneModel* ZoneModel::loadFromZON(std::string shortname, ZON* zon)
+ZoneModel* ZoneModel::loadFromZON(std::string shortname, ZON* zon, const LoadProgressCallback& progress)
 {
 	TER* ter = zon->getTER();
 	if (ter == nullptr)
@@ -121,15 +182,43 @@ ZoneModel* ZoneModel::loadFromZON(std::string shortname, ZON* zon)
 		return nullptr;
 	}
 
-	ZoneModel* zoneModel = ter->convertZoneModel();
+	if (progress)
+		progress(0.1f, "Converting terrain");
+
+	ZoneModel* zoneModel;
+	{
+		PROFILE_SCOPE("TER::convertZoneModel");
+		zoneModel = ter->convertZoneModel();
+	}
+
+	if (progress)
+		progress(0.6f, "Converting zone objects");
 
 	zon->setZonePosition(zoneModel);
-	zon->readObjects(zoneModel);
+	{
+		PROFILE_SCOPE("ZON::readObjects");
+		zon->readObjects(zoneModel);
+	}
+	zon->readRegions(zoneModel);
+
+	MeshStats stats = ter->getMeshStats();
+	stats.add(zon->getMeshStats());
+	stats.print(shortname.c_str());
 
 	delete ter;
 	delete zon;
 
-	gFileLoader.unloadS3D(shortname);
+	if (progress)
+		progress(0.95f, "Building collision");
+	{
+		PROFILE_SCOPE("ZoneModel::buildCollision");
+		zoneModel->buildCollision();
+	}
+
+	gFileLoader.printCacheStats();
+
+	if (progress)
+		progress(1.0f, "Zone loaded");
 
 	return zoneModel;
 }
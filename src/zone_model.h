@@ -14,12 +14,19 @@
 #include "model.h"
 #include "s3d.h"
 #include "animated_texture.h"
+#include "collision_world.h"
+#include "floor_map.h"
+#include "zone_regions.h"
+#include "region_map.h"
 
 using namespace irr;
 
 class WLD;
 class ZON;
 
+//progress from 0 to 1, plus a short description of the current stage
+typedef std::function<void(float, const char*)> LoadProgressCallback;
+
 struct ObjectPlacement
 {
 	scene::IAnimatedMesh* mesh;
@@ -38,10 +45,16 @@ private:
 	std::unordered_map<std::string, scene::IAnimatedMesh*, std::hash<std::string>> mObjectDefinitions;
 	std::unordered_map<std::string, scene::IAnimatedMesh*, std::hash<std::string>> mNoCollisionObjectDefinitions;
 	std::vector<ObjectPlacement> mObjectPlacements;
+	CollisionWorld mCollision;
+	FloorMap mFloor;
+	ZoneRegions mRegions;
+	RegionMap mRegionMap;
+	std::vector<uint32> mBufferGroups; //region group of each mesh buffer, empty without regions
+	std::vector<uint32> mNonCollisionBufferGroups;
 
 private:
-	static ZoneModel* loadFromWLD(std::string shortname, WLD* wld);
-	static ZoneModel* loadFromZON(std::string shortname, ZON* zon);
+	static ZoneModel* loadFromWLD(std::string shortname, WLD* wld, const LoadProgressCallback& progress);
+	static ZoneModel* loadFromZON(std::string shortname, ZON* zon, const LoadProgressCallback& progress);
 
 public:
 	ZoneModel();
@@ -50,7 +63,7 @@ public:
 	float getX() { return mX; }
 	float getY() { return mY; }
 	float getZ() { return mZ; }
-	void setPosition(float x, float y, float z) { mX = x; mY = y; mZ = z; }
+	void setPosition(float x, float y, float z) { mX = x; mY = y; mZ = z; mRegionMap.setOffset(core::vector3df(x, y, z)); }
 
 	void setMeshes(scene::SMesh* mesh, scene::SMesh* nocollide_mesh);
 	scene::IAnimatedMesh* getMesh() { return mMesh; }
@@ -60,8 +73,22 @@ public:
 	void addNoCollisionObjectDefinition(const char* name, scene::SMesh* mesh);
 	void addObjectPlacement(const char* name, ObjectPlacement& placement);
 	const std::vector<ObjectPlacement>& getObjectPlacements() { return mObjectPlacements; }
+	//s3d zones only, empty otherwise
+	ZoneRegions& getRegions() { return mRegions; }
+	//water, lava, zone lines and so on; either kind of zone
+	RegionMap& getRegionMap() { return mRegionMap; }
+	std::vector<uint32>& getBufferGroups() { return mBufferGroups; }
+	std::vector<uint32>& getNonCollisionBufferGroups() { return mNonCollisionBufferGroups; }
+	//built once the geometry and placements are in, see load()
+	CollisionWorld& getCollision() { return mCollision; }
+	FloorMap& getFloorMap() { return mFloor; }
+	void buildCollision();
+
+	//rough count of the bytes held by this zone's geometry and textures
+	uint64 getMemoryUsage();
 
-	static ZoneModel* load(std::string shortname);
+	//safe to call from a worker thread
+	static ZoneModel* load(std::string shortname, const LoadProgressCallback& progress = nullptr);
 };
 
 #endif
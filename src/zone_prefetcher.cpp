@@ -0,0 +1,277 @@
+
+#include "zone_prefetcher.h"
+#include "translate.h"
+#include "zeq_lua.h"
+#include <algorithm>
+
+ZonePrefetcher::ZonePrefetcher() :
+	mInFlight(nullptr),
+	mBudget(0),
+	mSinceRerank(0)
+{
+
+}
+
+ZonePrefetcher::~ZonePrefetcher()
+{
+	close();
+}
+
+void ZonePrefetcher::initialize()
+{
+	mBudget = (uint64)Lua::getConfigInt(CONFIG_VAR_PREFETCH_BUDGET, DEFAULT_BUDGET_MB) * 1024 * 1024;
+}
+
+void ZonePrefetcher::close()
+{
+	for (auto& pair : mCache)
+		delete pair.second.loader;
+	mCache.clear();
+	mInFlight = nullptr;
+	mCandidates.clear();
+	mZoneLinePositions.clear();
+	mZoneLineTargets.clear();
+}
+
+void ZonePrefetcher::setCurrentZone(const std::string& shortname)
+{
+	mCurrentZone = shortname;
+	//the old zone's lines mean nothing here; wait for the new zone points
+	mCandidates.clear();
+	mZoneLinePositions.clear();
+	mZoneLineTargets.clear();
+}
+
+void ZonePrefetcher::setZonePoints(ZonePoints* zp)
+{
+	mCandidates.clear();
+	mZoneLineTargets.clear();
+
+	for (uint32 i = 0; i < zp->count; ++i)
+	{
+		ZonePoint_Entry& zpe = zp->zpe[i];
+		std::string shortname = Translate::zoneShortName(zpe.zoneid);
+		if (shortname.empty() || shortname == mCurrentZone)
+			continue;
+
+		mZoneLineTargets[zpe.iterator] = shortname;
+
+		//several lines often lead to the same zone, it only needs to be listed once
+		bool dupe = false;
+		for (Candidate& c : mCandidates)
+		{
+			if (c.shortname == shortname)
+			{
+				dupe = true;
+				break;
+			}
+		}
+		if (dupe)
+			continue;
+
+		Candidate c;
+		c.shortname = shortname;
+		c.hasPosition = false;
+		c.distanceSq = 0.0f;
+		mCandidates.push_back(c);
+	}
+
+	//any lines the zone has already placed; a zone with several lines goes by whichever of them comes up first
+	for (auto& pair : mZoneLinePositions)
+		setCandidatePosition(pair.first, pair.second);
+
+	//anything cached that can't be reached from here is dead weight
+	for (auto it = mCache.begin(); it != mCache.end();)
+	{
+		if (rankOf(it->first) < 0 && it->second.loader != mInFlight)
+		{
+			delete it->second.loader;
+			it = mCache.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	mSinceRerank = RERANK_INTERVAL;
+}
+
+void ZonePrefetcher::setZoneLinePosition(uint32 number, const core::vector3df& pos)
+{
+	mZoneLinePositions[number] = pos;
+	setCandidatePosition(number, pos);
+	mSinceRerank = RERANK_INTERVAL;
+}
+
+void ZonePrefetcher::setCandidatePosition(uint32 number, const core::vector3df& pos)
+{
+	auto it = mZoneLineTargets.find(number);
+	if (it == mZoneLineTargets.end())
+		return;
+
+	for (Candidate& c : mCandidates)
+	{
+		if (c.shortname == it->second)
+		{
+			if (!c.hasPosition)
+			{
+				c.hasPosition = true;
+				c.position = pos;
+			}
+			return;
+		}
+	}
+}
+
+void ZonePrefetcher::update(float delta, const core::vector3df& pos)
+{
+	if (mBudget == 0 || mCandidates.empty())
+		return;
+
+	if (mInFlight)
+	{
+		bool finished;
+		try
+		{
+			finished = mInFlight->update();
+		}
+		catch (ZEQException& e)
+		{
+			//a zone we can't load now won't load when we get there either, but that's for the real load to report
+			printf("ZonePrefetcher: %s\n", e.what());
+			mCache.erase(mInFlight->getShortName());
+			delete mInFlight;
+			mInFlight = nullptr;
+			return;
+		}
+
+		if (!finished)
+			return;
+
+		Cached& cached = mCache[mInFlight->getShortName()];
+		cached.bytes = mInFlight->getMemoryUsage();
+		printf("ZonePrefetcher: %s ready, %.2f MB\n", mInFlight->getShortName().c_str(),
+			(double)cached.bytes / (1024.0 * 1024.0));
+		mInFlight = nullptr;
+		evict();
+	}
+
+	mSinceRerank += (uint32)(delta * 1000.0f);
+	if (mSinceRerank < RERANK_INTERVAL)
+		return;
+	mSinceRerank = 0;
+
+	rerank(pos);
+	evict();
+	startNext();
+}
+
+void ZonePrefetcher::rerank(const core::vector3df& pos)
+{
+	for (Candidate& c : mCandidates)
+	{
+		if (c.hasPosition)
+			c.distanceSq = c.position.getDistanceFromSQ(pos);
+	}
+
+	//zone lines we know the position of go by distance, the rest keep the server's order behind them
+	std::stable_sort(mCandidates.begin(), mCandidates.end(), [](const Candidate& a, const Candidate& b)
+	{
+		if (a.hasPosition != b.hasPosition)
+			return a.hasPosition;
+		return a.hasPosition && a.distanceSq < b.distanceSq;
+	});
+}
+
+void ZonePrefetcher::evict()
+{
+	for (;;)
+	{
+		uint64 total = 0;
+		std::unordered_map<std::string, Cached>::iterator worst = mCache.end();
+		int worstRank = -1;
+
+		for (auto it = mCache.begin(); it != mCache.end(); ++it)
+		{
+			total += it->second.bytes;
+			if (it->second.loader == mInFlight)
+				continue;
+
+			int rank = rankOf(it->first);
+			if (rank < 0)
+				rank = (int)mCandidates.size();
+			if (rank > worstRank)
+			{
+				worstRank = rank;
+				worst = it;
+			}
+		}
+
+		if (total <= mBudget || worst == mCache.end())
+			return;
+
+		printf("ZonePrefetcher: evicting %s\n", worst->first.c_str());
+		delete worst->second.loader;
+		mCache.erase(worst);
+	}
+}
+
+void ZonePrefetcher::startNext()
+{
+	if (mInFlight)
+		return;
+
+	uint64 total = 0;
+	for (auto& pair : mCache)
+		total += pair.second.bytes;
+
+	for (Candidate& c : mCandidates)
+	{
+		if (mCache.count(c.shortname))
+			continue;
+
+		//don't bother if the best we could do is push out something ranked higher
+		if (total >= mBudget)
+			return;
+
+		mInFlight = new ZoneLoader(c.shortname, false);
+		Cached cached;
+		cached.loader = mInFlight;
+		cached.bytes = 0;
+		mCache[c.shortname] = cached;
+		mInFlight->start();
+		return;
+	}
+}
+
+int ZonePrefetcher::rankOf(const std::string& shortname)
+{
+	for (uint32 i = 0; i < mCandidates.size(); ++i)
+	{
+		if (mCandidates[i].shortname == shortname)
+			return i;
+	}
+	return -1;
+}
+
+ZoneLoader* ZonePrefetcher::claim(const std::string& shortname)
+{
+	auto it = mCache.find(shortname);
+	if (it == mCache.end())
+		return nullptr;
+
+	ZoneLoader* loader = it->second.loader;
+	mCache.erase(it);
+	if (loader == mInFlight)
+		mInFlight = nullptr;
+
+	if (loader->hasFailed())
+	{
+		delete loader;
+		return nullptr;
+	}
+
+	printf("ZonePrefetcher: %s was prefetched\n", shortname.c_str());
+	return loader;
+}
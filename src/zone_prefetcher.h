@@ -0,0 +1,77 @@
+
+#ifndef _ZEQ_ZONE_PREFETCHER_H
+#define _ZEQ_ZONE_PREFETCHER_H
+
+#include <irrlicht.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "types.h"
+#include "zone_loader.h"
+#include "structs_titanium.h"
+
+using namespace irr;
+
+//loads the zones reachable from the current one in the background, one at a time, so that zoning into them
+//only has to wait for the character models; finished zones are kept until they no longer fit the memory budget
+class ZonePrefetcher
+{
+private:
+	static const uint32 RERANK_INTERVAL = 2000; //milliseconds
+	static const uint32 DEFAULT_BUDGET_MB = 256;
+
+	struct Candidate
+	{
+		std::string shortname;
+		bool hasPosition;
+		core::vector3df position;
+		float distanceSq;
+	};
+
+	struct Cached
+	{
+		ZoneLoader* loader;
+		uint64 bytes; //0 until the load finishes
+	};
+
+private:
+	std::string mCurrentZone;
+	std::vector<Candidate> mCandidates;
+	//zone line positions by zone point number, kept for the zone points that may not have come yet
+	std::unordered_map<uint32, core::vector3df> mZoneLinePositions;
+	std::unordered_map<uint32, std::string> mZoneLineTargets; //zone point number to the zone it leads to
+	std::unordered_map<std::string, Cached> mCache;
+	ZoneLoader* mInFlight;
+	uint64 mBudget;
+	uint32 mSinceRerank;
+
+private:
+	void rerank(const core::vector3df& pos);
+	void evict();
+	void startNext();
+	int rankOf(const std::string& shortname);
+	//for the candidate the zone line leads to, unless it already has one
+	void setCandidatePosition(uint32 number, const core::vector3df& pos);
+
+public:
+	ZonePrefetcher();
+	~ZonePrefetcher();
+
+	void initialize();
+	void close();
+
+	void setCurrentZone(const std::string& shortname);
+	void setZonePoints(ZonePoints* zp);
+	//the server only sends where each zone line leads, not where it is; whoever finds it in the zone's geometry reports it here,
+	//before or after the zone points
+	void setZoneLinePosition(uint32 number, const core::vector3df& pos);
+
+	//main thread only; delta in seconds, as from Renderer::loopStep
+	void update(float delta, const core::vector3df& pos);
+
+	//hands over a prefetched (or still loading) zone, or nullptr if we don't have it
+	ZoneLoader* claim(const std::string& shortname);
+};
+
+#endif
@@ -0,0 +1,142 @@
+
+#include "zone_regions.h"
+
+#include <algorithm>
+
+ZoneRegions::ZoneRegions() :
+	mGroupCount(0)
+{
+
+}
+
+void ZoneRegions::clear()
+{
+	mNodes.clear();
+	mVisibleStart.clear();
+	mVisible.clear();
+	mHasVisibility.clear();
+	mGroups.clear();
+	mGroupCount = 0;
+}
+
+void ZoneRegions::addNode(const core::vector3df& normal, float distance, uint32 region, uint32 front, uint32 back)
+{
+	Node node;
+	node.normal = normal;
+	node.distance = distance;
+	node.region = region;
+	node.front = front;
+	node.back = back;
+	mNodes.push_back(node);
+}
+
+void ZoneRegions::addRegion(const std::vector<uint32>& visible, bool known)
+{
+	if (mVisibleStart.empty())
+		mVisibleStart.push_back(0);
+
+	if (known)
+		mVisible.insert(mVisible.end(), visible.begin(), visible.end());
+	mVisibleStart.push_back(mVisible.size());
+	mHasVisibility.push_back(known ? 1 : 0);
+}
+
+//spreads the low 10 bits of v out to every third bit
+static uint32 spreadBits(uint32 v)
+{
+	v &= 0x3FF;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+void ZoneRegions::buildGroups(const std::vector<core::vector3df>& centers, const std::vector<uint32>& triangles)
+{
+	const uint32 count = getRegionCount();
+	mGroups.assign(count, 0);
+	mGroupCount = 0;
+	if (count == 0)
+		return;
+
+	core::aabbox3df bounds(centers[0]);
+	for (uint32 i = 1; i < count; ++i)
+		bounds.addInternalPoint(centers[i]);
+	core::vector3df extent = bounds.getExtent();
+	core::vector3df scale(
+		extent.X > 0.0f ? 1023.0f / extent.X : 0.0f,
+		extent.Y > 0.0f ? 1023.0f / extent.Y : 0.0f,
+		extent.Z > 0.0f ? 1023.0f / extent.Z : 0.0f);
+
+	//morton order keeps regions that are next to each other in the list close together in space
+	std::vector<std::pair<uint32, uint32>> order(count);
+	for (uint32 i = 0; i < count; ++i)
+	{
+		core::vector3df q = (centers[i] - bounds.MinEdge) * scale;
+		order[i].first = spreadBits((uint32)q.X) | (spreadBits((uint32)q.Y) << 1) | (spreadBits((uint32)q.Z) << 2);
+		order[i].second = i;
+	}
+	std::sort(order.begin(), order.end());
+
+	uint32 held = 0;
+	bool open = false;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		uint32 region = order[i].second;
+		mGroups[region] = mGroupCount;
+		held += triangles[region];
+		open = true;
+		if (held >= GROUP_TRIANGLES)
+		{
+			++mGroupCount;
+			held = 0;
+			open = false;
+		}
+	}
+	if (open)
+		++mGroupCount;
+}
+
+int32 ZoneRegions::findRegion(const core::vector3df& pos) const
+{
+	if (mNodes.empty())
+		return -1;
+
+	//a malformed tree could loop, but a real path can't be longer than the tree
+	uint32 index = 1;
+	for (uint32 steps = 0; steps < mNodes.size(); ++steps)
+	{
+		const Node& node = mNodes[index - 1];
+		if (node.front == 0 && node.back == 0)
+		{
+			if (node.region == 0 || node.region > getRegionCount())
+				return -1;
+			return (int32)node.region - 1;
+		}
+
+		index = (node.normal.dotProduct(pos) + node.distance > 0.0f) ? node.front : node.back;
+		if (index == 0 || index > mNodes.size())
+			return -1;
+	}
+
+	return -1;
+}
+
+bool ZoneRegions::getVisibleGroups(int32 region, std::vector<uint8>& out) const
+{
+	if (region < 0 || (uint32)region >= getRegionCount() || !mHasVisibility[region])
+		return false;
+
+	out.assign(mGroupCount, 0);
+	out[mGroups[region]] = 1;
+	for (uint32 i = mVisibleStart[region]; i < mVisibleStart[region + 1]; ++i)
+		out[mGroups[mVisible[i]]] = 1;
+	return true;
+}
+
+uint64 ZoneRegions::getMemoryUsage() const
+{
+	return (uint64)mNodes.size() * sizeof(Node) + (uint64)(mVisibleStart.size() + mVisible.size() + mGroups.size()) * sizeof(uint32) +
+		(uint64)mHasVisibility.size();
+}
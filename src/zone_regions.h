@@ -0,0 +1,64 @@
+
+#ifndef _ZEQ_ZONE_REGIONS_H
+#define _ZEQ_ZONE_REGIONS_H
+
+#include <irrlicht.h>
+
+#include <vector>
+
+#include "types.h"
+
+using namespace irr;
+
+//the bsp tree of an s3d zone, which divides it into convex regions, and each region's potentially visible set;
+//regions are too small to draw one at a time, so they are gathered into groups of nearby regions and a group
+//is drawn if any of its regions can be seen from the camera's region
+class ZoneRegions
+{
+public:
+	static const uint32 NO_GROUP = 0xFFFFFFFF; //geometry that isn't in any region, always drawn
+
+private:
+	static const uint32 GROUP_TRIANGLES = 2048; //a group is closed once it holds this many
+
+	//same layout as the file, converted to irrlicht axes; indices are 1-based, 0 for none
+	struct Node
+	{
+		core::vector3df normal;
+		float distance;
+		uint32 region;
+		uint32 front;
+		uint32 back;
+	};
+
+	std::vector<Node> mNodes;
+	std::vector<uint32> mVisibleStart; //index of each region's first visible region, plus one past the end
+	std::vector<uint32> mVisible; //0-based region indices
+	std::vector<uint8> mHasVisibility; //regions whose lists couldn't be read see everything
+	std::vector<uint32> mGroups; //group of each region
+	uint32 mGroupCount;
+
+public:
+	ZoneRegions();
+
+	void clear();
+	void addNode(const core::vector3df& normal, float distance, uint32 region, uint32 front, uint32 back);
+	//regions are added in file order
+	void addRegion(const std::vector<uint32>& visible, bool known);
+	//centers and triangle counts of each region's geometry; regions close together in space share a group
+	void buildGroups(const std::vector<core::vector3df>& centers, const std::vector<uint32>& triangles);
+
+	bool empty() const { return mNodes.empty() || mGroups.empty(); }
+	uint32 getRegionCount() const { return mVisibleStart.empty() ? 0 : mVisibleStart.size() - 1; }
+	uint32 getGroupCount() const { return mGroupCount; }
+	uint32 getGroup(uint32 region) const { return mGroups[region]; }
+
+	//0-based index of the region containing pos, in the zone mesh's space; -1 if it's outside all of them
+	int32 findRegion(const core::vector3df& pos) const;
+	//marks the groups visible from region; false if that can't be narrowed down, in which case draw everything
+	bool getVisibleGroups(int32 region, std::vector<uint8>& out) const;
+
+	uint64 getMemoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+
+#include "zone_scene_node.h"
+
+ZoneSceneNode::ZoneSceneNode(scene::IMesh* mesh, scene::ISceneNode* parent, scene::ISceneManager* sceneMgr, s32 id) :
+	scene::ISceneNode(parent, sceneMgr, id),
+	mMesh(mesh),
+	mDrawDistance(0.0f),
+	mRegions(nullptr),
+	mUseRegions(true),
+	mVisibleTriangles(0)
+{
+	mMesh->grab();
+	mBox = mMesh->getBoundingBox();
+
+	for (uint32 i = 0; i < mMesh->getMeshBufferCount(); ++i)
+		mMaterials.push_back(mMesh->getMeshBuffer(i)->getMaterial());
+}
+
+ZoneSceneNode::~ZoneSceneNode()
+{
+	mMesh->drop();
+}
+
+void ZoneSceneNode::setRegions(const ZoneRegions* regions, const std::vector<uint32>& buffer_groups)
+{
+	//without a group for every buffer, some geometry would never be considered
+	if (regions == nullptr || regions->empty() || buffer_groups.size() != mMesh->getMeshBufferCount())
+	{
+		mRegions = nullptr;
+		mBufferGroups.clear();
+		return;
+	}
+
+	mRegions = regions;
+	mBufferGroups = buffer_groups;
+}
+
+bool ZoneSceneNode::isBufferCulled(const core::aabbox3df& box, const scene::SViewFrustum& frustum, const core::vector3df& eye) const
+{
+	//frustum planes face outwards; a box entirely in front of any of them is out of view
+	for (uint32 i = 0; i < scene::SViewFrustum::VF_PLANE_COUNT; ++i)
+	{
+		if (box.classifyPlaneRelation(frustum.planes[i]) == core::ISREL3D_FRONT)
+			return true;
+	}
+
+	if (mDrawDistance > 0.0f)
+	{
+		//distance to the nearest point of the box
+		core::vector3df nearest(
+			core::clamp(eye.X, box.MinEdge.X, box.MaxEdge.X),
+			core::clamp(eye.Y, box.MinEdge.Y, box.MaxEdge.Y),
+			core::clamp(eye.Z, box.MinEdge.Z, box.MaxEdge.Z));
+		if (nearest.getDistanceFromSQ(eye) > mDrawDistance * mDrawDistance)
+			return true;
+	}
+
+	return false;
+}
+
+void ZoneSceneNode::OnRegisterSceneNode()
+{
+	if (!IsVisible)
+		return;
+
+	video::IVideoDriver* driver = SceneManager->getVideoDriver();
+	scene::ICameraSceneNode* cam = SceneManager->getActiveCamera();
+
+	mVisibleSolid.clear();
+	mVisibleTransparent.clear();
+
+	//cull in the mesh's own space, the buffer boxes are already there
+	scene::SViewFrustum frustum;
+	core::vector3df eye;
+	if (cam)
+	{
+		core::matrix4 inverse;
+		AbsoluteTransformation.getInverse(inverse);
+		frustum = *cam->getViewFrustum();
+		frustum.transform(inverse);
+		eye = cam->getAbsolutePosition();
+		inverse.transformVect(eye);
+	}
+
+	//everything the camera's region can see; outside of every region, or without a list for it, nothing is ruled out
+	bool pvs = cam && mRegions && mUseRegions && mRegions->getVisibleGroups(mRegions->findRegion(eye), mVisibleGroups);
+
+	mVisibleTriangles = 0;
+	for (uint32 i = 0; i < mMesh->getMeshBufferCount(); ++i)
+	{
+		if (pvs && mBufferGroups[i] != ZoneRegions::NO_GROUP && !mVisibleGroups[mBufferGroups[i]])
+			continue;
+
+		scene::IMeshBuffer* buf = mMesh->getMeshBuffer(i);
+		if (cam && isBufferCulled(buf->getBoundingBox(), frustum, eye))
+			continue;
+		mVisibleTriangles += buf->getIndexCount() / 3;
+
+		video::IMaterialRenderer* rnd = driver->getMaterialRenderer(mMaterials[i].MaterialType);
+		if (rnd && rnd->isTransparent())
+			mVisibleTransparent.push_back(i);
+		else
+			mVisibleSolid.push_back(i);
+	}
+
+	if (!mVisibleSolid.empty())
+		SceneManager->registerNodeForRendering(this, scene::ESNRP_SOLID);
+	if (!mVisibleTransparent.empty())
+		SceneManager->registerNodeForRendering(this, scene::ESNRP_TRANSPARENT);
+
+	ISceneNode::OnRegisterSceneNode();
+}
+
+void ZoneSceneNode::render()
+{
+	video::IVideoDriver* driver = SceneManager->getVideoDriver();
+	const std::vector<uint32>& visible =
+		(SceneManager->getSceneNodeRenderPass() == scene::ESNRP_TRANSPARENT) ? mVisibleTransparent : mVisibleSolid;
+
+	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
+	for (uint32 i : visible)
+	{
+		driver->setMaterial(mMaterials[i]);
+		driver->drawMeshBuffer(mMesh->getMeshBuffer(i));
+	}
+}
@@ -0,0 +1,61 @@
+
+#ifndef _ZEQ_ZONE_SCENE_NODE_H
+#define _ZEQ_ZONE_SCENE_NODE_H
+
+#include <irrlicht.h>
+
+#include <vector>
+
+#include "types.h"
+#include "zone_regions.h"
+
+using namespace irr;
+
+//draws a zone mesh made by ModelSource::createChunkedMeshBuffers: every buffer is one material in one chunk
+//with its own bounding box, so buffers outside the view frustum or beyond the draw distance are skipped each frame;
+//materials are copied per buffer like irrlicht's mesh node, so animated textures can swap them by index.
+//in s3d zones, buffers are also skipped if their region group can't be seen from the camera's region
+class ZoneSceneNode : public scene::ISceneNode
+{
+private:
+	scene::IMesh* mMesh;
+	core::aabbox3df mBox;
+	core::array<video::SMaterial> mMaterials;
+	float mDrawDistance; //0 for no limit
+
+	//potentially visible sets, when the zone has regions
+	const ZoneRegions* mRegions;
+	std::vector<uint32> mBufferGroups;
+	std::vector<uint8> mVisibleGroups;
+	bool mUseRegions;
+
+	//buffer indices that passed culling this frame, by render pass
+	std::vector<uint32> mVisibleSolid;
+	std::vector<uint32> mVisibleTransparent;
+	uint32 mVisibleTriangles;
+
+private:
+	bool isBufferCulled(const core::aabbox3df& box, const scene::SViewFrustum& frustum, const core::vector3df& eye) const;
+
+public:
+	ZoneSceneNode(scene::IMesh* mesh, scene::ISceneNode* parent, scene::ISceneManager* sceneMgr, s32 id = -1);
+	virtual ~ZoneSceneNode();
+
+	virtual void OnRegisterSceneNode();
+	virtual void render();
+
+	virtual const core::aabbox3df& getBoundingBox() const { return mBox; }
+	virtual video::SMaterial& getMaterial(u32 num) { return mMaterials[num]; }
+	virtual u32 getMaterialCount() const { return mMaterials.size(); }
+
+	void setDrawDistance(float dist) { mDrawDistance = dist; }
+	//buffer_groups gives the region group of each buffer, see ZoneRegions
+	void setRegions(const ZoneRegions* regions, const std::vector<uint32>& buffer_groups);
+	void setUseRegions(bool use) { mUseRegions = use; }
+	uint32 getBufferCount() const { return mMesh->getMeshBufferCount(); }
+	//buffers drawn in the last frame
+	uint32 getVisibleCount() const { return mVisibleSolid.size() + mVisibleTransparent.size(); }
+	uint32 getVisibleTriangleCount() const { return mVisibleTriangles; }
+};
+
+#endif
@@ -4,6 +4,8 @@
 
 #include "types.h"
 
+#include <string>
+
 struct ZoneViewerData
 {
 	ZoneViewerData()
@@ -14,6 +16,7 @@ struct ZoneViewerData
 
 	bool applyGravity;
 	bool applyCollision;
+	std::string shortname;
 };
 
 #endif